@@ -0,0 +1,401 @@
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define HUFFMAN_HAVE_ASYNC_IO 1
+#else
+#define HUFFMAN_HAVE_ASYNC_IO 0
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define HUFFMAN_HAVE_IO_URING 1
+#else
+#define HUFFMAN_HAVE_IO_URING 0
+#endif
+
+#if HUFFMAN_HAVE_ASYNC_IO
+
+// Offset of a read or write that uses, and advances, the descriptor's file position
+constexpr uint64_t kCurrentPosition = ~uint64_t(0);
+
+// Most requests an AsyncIo queue holds at once
+constexpr unsigned kAsyncIoDepth = 8;
+
+// A finished read or write
+struct AsyncCompletion {
+    uint64_t tag = 0;  // The tag given when the request was submitted
+    int64_t result = 0; // Bytes transferred, or -errno
+};
+
+// A queue of reads and writes that run while the caller keeps working. On Linux the requests go
+// to an io_uring driven through raw system calls; where io_uring is missing or refused (old
+// kernels, seccomp filters) a dedicated I/O thread performs them in submission order instead.
+// Set HUFFMAN_IO=threads to force the thread. A queue is used by one thread at a time, each
+// file should have its own so that it takes only its own completions, and the buffers of a
+// request must stay valid until its completion has been taken.
+class AsyncIo {
+public:
+    // The ring or thread is set up by the first request, so an unused queue costs nothing.
+    AsyncIo() = default;
+
+    ~AsyncIo() {
+        AsyncCompletion completion;
+        while (wait(completion)) {
+        }
+#if HUFFMAN_HAVE_IO_URING
+        if (ringReady) {
+            munmap(submissionEntries, kAsyncIoDepth * sizeof(io_uring_sqe));
+            munmap(ringMapping, ringMappingSize);
+            ::close(ringDescriptor);
+        }
+#endif
+        if (worker.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                stopping = true;
+            }
+            requestReady.notify_one();
+            worker.join();
+        }
+    }
+
+    AsyncIo(const AsyncIo&) = delete;
+    AsyncIo& operator=(const AsyncIo&) = delete;
+
+    // Whether requests go to an io_uring rather than the I/O thread; known after the first request.
+    bool usesIoUring() const { return ringReady; }
+
+    // Requests submitted whose completions have not been taken yet.
+    unsigned pending() const { return pendingCount + static_cast<unsigned>(early.size()); }
+
+    /**
+     * @brief Queues a read; waits for an earlier completion first if the queue is full, which is
+     * then returned by the next wait() as usual.
+     * @param descriptor The file to read.
+     * @param destination Receives the bytes.
+     * @param size The number of bytes wanted; fewer may arrive, as with read().
+     * @param offset The file offset, or kCurrentPosition.
+     * @param tag Returned with the completion.
+     */
+    void read(int descriptor, uint8_t* destination, size_t size, uint64_t offset, uint64_t tag) {
+        submit({Request::Read, descriptor, destination, size, offset, tag});
+    }
+
+    /**
+     * @brief Queues a write, like read(); fewer bytes than `size` may be written.
+     * @param descriptor The file to write.
+     * @param source The bytes to write.
+     * @param size The number of bytes.
+     * @param offset The file offset, or kCurrentPosition.
+     * @param tag Returned with the completion.
+     */
+    void write(int descriptor, const uint8_t* source, size_t size, uint64_t offset, uint64_t tag) {
+        submit({Request::Write, descriptor, const_cast<uint8_t*>(source), size, offset, tag});
+    }
+
+    /**
+     * @brief Takes the next completion, blocking until one is available.
+     * @param completion Receives it.
+     * @return False if no request is pending.
+     */
+    bool wait(AsyncCompletion& completion) {
+        if (!early.empty()) {
+            completion = early.front();
+            early.pop_front();
+            return true;
+        }
+        if (pendingCount == 0) {
+            return false;
+        }
+        takeCompletion(completion);
+        --pendingCount;
+        return true;
+    }
+
+    /**
+     * @brief Takes the next completion if one is available, without blocking.
+     * @param completion Receives it.
+     * @return False if no request has completed.
+     */
+    bool poll(AsyncCompletion& completion) {
+        if (!early.empty()) {
+            return wait(completion);
+        }
+        if (pendingCount == 0) {
+            return false;
+        }
+#if HUFFMAN_HAVE_IO_URING
+        if (ringReady) {
+            if (__atomic_load_n(completionTail, __ATOMIC_ACQUIRE) == *completionHead) {
+                return false;
+            }
+            return wait(completion);
+        }
+#endif
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            if (completions.empty()) {
+                return false;
+            }
+        }
+        return wait(completion);
+    }
+
+private:
+    struct Request {
+        enum Kind { Read, Write } kind;
+        int descriptor;
+        uint8_t* buffer;
+        size_t size;
+        uint64_t offset;
+        uint64_t tag;
+    };
+
+    void submit(const Request& request) {
+        if (pendingCount == kAsyncIoDepth) {
+            // Make room; the completion is handed out later, in order
+            AsyncCompletion completion;
+            takeCompletion(completion);
+            --pendingCount;
+            early.push_back(completion);
+        }
+        ++pendingCount;
+#if HUFFMAN_HAVE_IO_URING
+        if (!started) {
+            const char* forced = std::getenv("HUFFMAN_IO");
+            ringReady = (!forced || std::strcmp(forced, "threads") != 0) && setupRing();
+            started = true;
+        }
+        if (ringReady) {
+            submitToRing(request);
+            return;
+        }
+#endif
+        if (!worker.joinable()) {
+            worker = std::thread([this] { workerLoop(); });
+        }
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            requests.push_back(request);
+        }
+        requestReady.notify_one();
+    }
+
+    // Blocks for the completion of one submitted request.
+    void takeCompletion(AsyncCompletion& completion) {
+#if HUFFMAN_HAVE_IO_URING
+        if (ringReady) {
+            takeFromRing(completion);
+            return;
+        }
+#endif
+        std::unique_lock<std::mutex> lock(queueMutex);
+        completionReady.wait(lock, [this] { return !completions.empty(); });
+        completion = completions.front();
+        completions.pop_front();
+    }
+
+    // Performs the requests of the thread backend one after another, retrying interrupted calls.
+    void workerLoop() {
+        for (;;) {
+            Request request;
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                requestReady.wait(lock, [this] { return stopping || !requests.empty(); });
+                if (requests.empty()) {
+                    return;
+                }
+                request = requests.front();
+                requests.pop_front();
+            }
+            ssize_t result;
+            do {
+                const bool positioned = request.offset != kCurrentPosition;
+                const off_t offset = static_cast<off_t>(request.offset);
+                if (request.kind == Request::Read) {
+                    result = positioned ? ::pread(request.descriptor, request.buffer, request.size, offset)
+                                        : ::read(request.descriptor, request.buffer, request.size);
+                } else {
+                    result = positioned ? ::pwrite(request.descriptor, request.buffer, request.size, offset)
+                                        : ::write(request.descriptor, request.buffer, request.size);
+                }
+            } while (result < 0 && errno == EINTR);
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                completions.push_back({request.tag, result < 0 ? -int64_t(errno) : int64_t(result)});
+            }
+            completionReady.notify_one();
+        }
+    }
+
+#if HUFFMAN_HAVE_IO_URING
+    // Creates the ring and maps its queues; false leaves the thread backend in charge.
+    bool setupRing() {
+        io_uring_params params{};
+        const long descriptor = syscall(__NR_io_uring_setup, kAsyncIoDepth, &params);
+        if (descriptor < 0) {
+            return false;
+        }
+        ringDescriptor = static_cast<int>(descriptor);
+        // Reads and writes at the file position, and one mapping for both queues (Linux 5.6)
+        if ((params.features & IORING_FEAT_RW_CUR_POS) == 0 || (params.features & IORING_FEAT_SINGLE_MMAP) == 0) {
+            ::close(ringDescriptor);
+            return false;
+        }
+        ringMappingSize = std::max<size_t>(params.sq_off.array + params.sq_entries * sizeof(uint32_t),
+                                           params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+        void* ring = mmap(nullptr, ringMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringDescriptor,
+                          IORING_OFF_SQ_RING);
+        if (ring == MAP_FAILED) {
+            ::close(ringDescriptor);
+            return false;
+        }
+        void* entries = mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, ringDescriptor, IORING_OFF_SQES);
+        if (entries == MAP_FAILED) {
+            munmap(ring, ringMappingSize);
+            ::close(ringDescriptor);
+            return false;
+        }
+        ringMapping = ring;
+        uint8_t* base = static_cast<uint8_t*>(ring);
+        submissionTail = reinterpret_cast<uint32_t*>(base + params.sq_off.tail);
+        submissionMask = *reinterpret_cast<uint32_t*>(base + params.sq_off.ring_mask);
+        submissionArray = reinterpret_cast<uint32_t*>(base + params.sq_off.array);
+        submissionEntries = static_cast<io_uring_sqe*>(entries);
+        completionHead = reinterpret_cast<uint32_t*>(base + params.cq_off.head);
+        completionTail = reinterpret_cast<uint32_t*>(base + params.cq_off.tail);
+        completionMask = *reinterpret_cast<uint32_t*>(base + params.cq_off.ring_mask);
+        completionEntries = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+        return true;
+    }
+
+    // Fills the next submission entry and hands it to the kernel. At most kAsyncIoDepth requests
+    // are pending, so a slot is always free.
+    void submitToRing(const Request& request) {
+        const uint32_t tail = *submissionTail;
+        const uint32_t slot = tail & submissionMask;
+        io_uring_sqe& entry = submissionEntries[slot];
+        std::memset(&entry, 0, sizeof(entry));
+        entry.opcode = request.kind == Request::Read ? IORING_OP_READ : IORING_OP_WRITE;
+        entry.fd = request.descriptor;
+        entry.addr = reinterpret_cast<uint64_t>(request.buffer);
+        entry.len = static_cast<uint32_t>(std::min<size_t>(request.size, 0x7FFFF000)); // The largest read() transfers
+        entry.off = request.offset; // ~0 is -1, the file position
+        entry.user_data = request.tag;
+        submissionArray[slot] = slot;
+        __atomic_store_n(submissionTail, tail + 1, __ATOMIC_RELEASE);
+        ringTags[ringTagCount++] = request.tag;
+        ++unsubmittedEntries;
+        submitEntries();
+    }
+
+    // Hands the queued entries to the kernel. A busy ring (EAGAIN, EBUSY, or nothing taken) is
+    // retried once a completion has made room; entries it cannot take are withdrawn and complete
+    // with -errno, so every request still gets exactly one completion.
+    void submitEntries() {
+        while (unsubmittedEntries > 0) {
+            const long submitted = syscall(__NR_io_uring_enter, ringDescriptor, unsubmittedEntries, 0, 0, nullptr, 0);
+            if (submitted > 0) {
+                unsubmittedEntries -= std::min(static_cast<uint32_t>(submitted), unsubmittedEntries);
+                continue;
+            }
+            const int error = submitted < 0 ? errno : EAGAIN;
+            if (error == EINTR) {
+                continue;
+            }
+            if ((error == EAGAIN || error == EBUSY) && ringTagCount > unsubmittedEntries) {
+                AsyncCompletion completion;
+                takeFromRing(completion);
+                --pendingCount;
+                early.push_back(completion);
+                continue;
+            }
+            // The kernel has not seen these entries, so moving the tail back withdraws them
+            const unsigned firstWithdrawn = ringTagCount - unsubmittedEntries;
+            for (unsigned i = firstWithdrawn; i < ringTagCount; ++i) {
+                early.push_back({ringTags[i], -int64_t(error)});
+                --pendingCount;
+            }
+            ringTagCount = firstWithdrawn;
+            __atomic_store_n(submissionTail, *submissionTail - unsubmittedEntries, __ATOMIC_RELEASE);
+            unsubmittedEntries = 0;
+        }
+    }
+
+    // Waits for and consumes the oldest completion entry. If the kernel refuses to wait for any
+    // reason but EINTR, the oldest request in the ring completes with -errno instead of hanging.
+    void takeFromRing(AsyncCompletion& completion) {
+        for (;;) {
+            const uint32_t head = *completionHead;
+            if (__atomic_load_n(completionTail, __ATOMIC_ACQUIRE) == head) {
+                if (syscall(__NR_io_uring_enter, ringDescriptor, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR) {
+                    completion = {ringTags[0], -int64_t(errno)};
+                    std::copy(ringTags.begin() + 1, ringTags.begin() + ringTagCount--, ringTags.begin());
+                    return;
+                }
+                continue;
+            }
+            const io_uring_cqe& entry = completionEntries[head & completionMask];
+            completion = {entry.user_data, entry.res};
+            __atomic_store_n(completionHead, head + 1, __ATOMIC_RELEASE);
+            uint64_t* const tag = std::find(ringTags.begin(), ringTags.begin() + ringTagCount, completion.tag);
+            if (tag != ringTags.begin() + ringTagCount) {
+                std::copy(tag + 1, ringTags.begin() + ringTagCount--, tag);
+                return;
+            }
+            // A late completion of a request already failed above; it was reported then
+        }
+    }
+
+    int ringDescriptor = -1;
+    void* ringMapping = nullptr;
+    size_t ringMappingSize = 0;
+    uint32_t* submissionTail = nullptr;
+    uint32_t submissionMask = 0;
+    uint32_t* submissionArray = nullptr;
+    io_uring_sqe* submissionEntries = nullptr;
+    uint32_t* completionHead = nullptr;
+    uint32_t* completionTail = nullptr;
+    uint32_t completionMask = 0;
+    io_uring_cqe* completionEntries = nullptr;
+    std::array<uint64_t, kAsyncIoDepth> ringTags{}; // Tags of the requests in the ring, oldest first
+    unsigned ringTagCount = 0;
+    uint32_t unsubmittedEntries = 0;                  // Queued entries the kernel has not taken yet
+#endif
+    bool started = false;
+    bool ringReady = false;
+    unsigned pendingCount = 0;          // Submitted and not yet taken from the backend
+    std::deque<AsyncCompletion> early;  // Taken to make room, not yet returned by wait()
+
+    // Thread backend, started on the first request
+    std::thread worker;
+    std::deque<Request> requests;
+    std::deque<AsyncCompletion> completions;
+    std::mutex queueMutex;
+    std::condition_variable requestReady;
+    std::condition_variable completionReady;
+    bool stopping = false;
+};
+
+#else
+class AsyncIo {}; // No asynchronous reads or writes on this platform
+#endif // HUFFMAN_HAVE_ASYNC_IO
+
+#endif // ASYNC_IO_H
@@ -0,0 +1,195 @@
+#ifndef BIT_WRITER_H
+#define BIT_WRITER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "compiler.h"
+#include "huffman_format.h"
+
+// Bytes past the end of its stream that packCodes may overwrite
+constexpr size_t kPackSlack = 8;
+
+// Packs variable-length codes MSB-first into a caller-sized byte buffer through a 64-bit accumulator.
+// The caller must provide room for the final byte count plus 4 bytes of slack.
+class BitWriter {
+public:
+    explicit BitWriter(uint8_t* destination) : cursor(destination) {}
+
+    // Appends the low `length` bits of `code` (length <= 64).
+    HUFFMAN_ALWAYS_INLINE void write(uint64_t code, unsigned length) {
+        if (length > 32) {
+            writeBits(static_cast<uint32_t>(code >> 32), length - 32);
+            length = 32;
+        }
+        writeBits(static_cast<uint32_t>(code), length);
+    }
+
+    // Emits the pending bits, zero-padded to a whole byte, and returns the end of the written data.
+    uint8_t* finish() {
+        while (bitCount >= 8) {
+            bitCount -= 8;
+            *cursor++ = static_cast<uint8_t>(accumulator >> bitCount);
+        }
+        if (bitCount > 0) {
+            *cursor++ = static_cast<uint8_t>(accumulator << (8 - bitCount));
+            bitCount = 0;
+        }
+        return cursor;
+    }
+
+private:
+    // At most 31 bits are pending on entry, so adding up to 32 more never overflows the accumulator.
+    HUFFMAN_ALWAYS_INLINE void writeBits(uint32_t code, unsigned length) {
+        accumulator = (accumulator << length) | (code & ((uint64_t(1) << length) - 1));
+        bitCount += length;
+        if (bitCount >= 32) {
+            bitCount -= 32;
+            const uint32_t word = static_cast<uint32_t>(accumulator >> bitCount);
+            cursor[0] = static_cast<uint8_t>(word >> 24);
+            cursor[1] = static_cast<uint8_t>(word >> 16);
+            cursor[2] = static_cast<uint8_t>(word >> 8);
+            cursor[3] = static_cast<uint8_t>(word);
+            cursor += 4;
+        }
+    }
+
+    uint8_t* cursor;
+    uint64_t accumulator = 0;
+    unsigned bitCount = 0;
+};
+
+// Stores a word MSB-first. Written out store by store so the compiler merges it into one
+// byte-swapped 8-byte write.
+HUFFMAN_ALWAYS_INLINE void storeBigEndian(uint64_t word, uint8_t* destination) {
+    destination[0] = static_cast<uint8_t>(word >> 56);
+    destination[1] = static_cast<uint8_t>(word >> 48);
+    destination[2] = static_cast<uint8_t>(word >> 40);
+    destination[3] = static_cast<uint8_t>(word >> 32);
+    destination[4] = static_cast<uint8_t>(word >> 24);
+    destination[5] = static_cast<uint8_t>(word >> 16);
+    destination[6] = static_cast<uint8_t>(word >> 8);
+    destination[7] = static_cast<uint8_t>(word);
+}
+
+/**
+ * @brief Packs codes of at most MaxBits bits a group at a time. A group holds as many codes as
+ * fit in 56 bits; they are merged into a left-aligned accumulator, whose whole bytes are then
+ * stored with one 8-byte write, so there is no flush test per code.
+ * @tparam MaxBits The longest code length, 1..28.
+ * @param codes The code of every byte value.
+ * @param data The bytes to code.
+ * @param size The number of bytes.
+ * @param destination Receives the stream; must have room for its byte count plus kPackSlack bytes.
+ * @return The end of the stream.
+ */
+template <unsigned MaxBits>
+HUFFMAN_ALWAYS_INLINE uint8_t* packBoundedCodes(const HuffmanCodeTable& codes, const uint8_t* data, size_t size, uint8_t* destination) {
+    static_assert(MaxBits >= 1 && MaxBits <= 28, "two codes must fit in a group");
+    constexpr size_t groupSize = 56 / MaxBits;
+    uint64_t accumulator = 0; // Pending bits from the top down
+    unsigned bitCount = 0;    // Fewer than 8 between groups, so a group never fills all 64 bits
+    const auto append = [&](uint8_t byte) {
+        const HuffmanCode& code = codes[byte];
+        bitCount += code.length;
+        accumulator |= code.bits << (64 - bitCount);
+    };
+    const auto flush = [&] {
+        storeBigEndian(accumulator, destination);
+        destination += bitCount >> 3;
+        accumulator <<= bitCount & ~7u;
+        bitCount &= 7;
+    };
+
+    size_t i = 0;
+    for (; i + groupSize <= size; i += groupSize) {
+        for (size_t j = 0; j < groupSize; ++j) {
+            append(data[i + j]);
+        }
+        flush();
+    }
+    for (; i < size; ++i) {
+        append(data[i]);
+        flush();
+    }
+    // The last partial byte was stored by the final flush; its low bits are zero
+    return destination + (bitCount != 0);
+}
+
+/**
+ * @brief Packs the code of every byte of a buffer into one zero-padded stream, with the loop
+ * instantiated for the longest code length.
+ * @param codes The code of every byte value.
+ * @param maxLength The longest length in `codes`.
+ * @param data The bytes to code.
+ * @param size The number of bytes.
+ * @param destination Receives the stream; must have room for its byte count plus kPackSlack bytes.
+ * @return The end of the stream.
+ */
+HUFFMAN_ALWAYS_INLINE uint8_t* packCodes(const HuffmanCodeTable& codes, unsigned maxLength, const uint8_t* data, size_t size,
+                                         uint8_t* destination) {
+    if (maxLength <= 8) {
+        return packBoundedCodes<8>(codes, data, size, destination);
+    }
+    if (maxLength <= 11) {
+        return packBoundedCodes<11>(codes, data, size, destination);
+    }
+    if (maxLength <= 14) {
+        return packBoundedCodes<14>(codes, data, size, destination);
+    }
+    if (maxLength <= 18) {
+        return packBoundedCodes<18>(codes, data, size, destination);
+    }
+    if (maxLength <= 28) {
+        return packBoundedCodes<28>(codes, data, size, destination);
+    }
+    BitWriter bitWriter(destination);
+    for (size_t i = 0; i < size; ++i) {
+        const HuffmanCode& code = codes[data[i]];
+        bitWriter.write(code.bits, code.length);
+    }
+    return bitWriter.finish();
+}
+
+/**
+ * @brief Packs a context Huffman stream: each byte with the codes of the byte before it, the
+ * first as if preceded by a zero byte. Codes are grouped as in packBoundedCodes.
+ * @param contextCodes The codes of every previous byte, each at most kMaxContextCodeLength bits.
+ * @param data The bytes to code.
+ * @param size The number of bytes.
+ * @param destination Receives the stream; must have room for its byte count plus kPackSlack bytes.
+ * @return The end of the stream.
+ */
+inline uint8_t* packContextCodes(const HuffmanCodeTable* const* contextCodes, const uint8_t* data, size_t size, uint8_t* destination) {
+    constexpr size_t groupSize = 56 / kMaxContextCodeLength;
+    uint64_t accumulator = 0;
+    unsigned bitCount = 0;
+    unsigned context = 0;
+    const auto append = [&](uint8_t byte) {
+        const HuffmanCode& code = (*contextCodes[context])[byte];
+        bitCount += code.length;
+        accumulator |= code.bits << (64 - bitCount);
+        context = byte;
+    };
+    const auto flush = [&] {
+        storeBigEndian(accumulator, destination);
+        destination += bitCount >> 3;
+        accumulator <<= bitCount & ~7u;
+        bitCount &= 7;
+    };
+
+    size_t i = 0;
+    for (; i + groupSize <= size; i += groupSize) {
+        for (size_t j = 0; j < groupSize; ++j) {
+            append(data[i + j]);
+        }
+        flush();
+    }
+    for (; i < size; ++i) {
+        append(data[i]);
+        flush();
+    }
+    return destination + (bitCount != 0);
+}
+
+#endif // BIT_WRITER_H
@@ -0,0 +1,202 @@
+#ifndef CODE_LENGTHS_H
+#define CODE_LENGTHS_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "histogram.h"
+#include "huffman_format.h"
+
+/**
+ * @brief Computes optimal code lengths with the in-place algorithm of Moffat and Katajainen.
+ * The used symbols are sorted by frequency into one array, which then holds in turn the weights
+ * of the merged nodes and their parent indices, the depths of the internal nodes and finally the
+ * depths of the leaves. Nodes are merged in the order of the two-queue method: leaves come from
+ * the sorted run, internal nodes are created in order of weight, so no heap or tree is needed.
+ * @tparam SymbolCount The alphabet size: 256 for bytes, smaller for the table code (table_header.h).
+ * @param frequencies The count of every symbol.
+ * @param codeLengths Receives the code length of every symbol (0 for unused symbols).
+ * @return False if a code would exceed kMaxCodeLength bits.
+ */
+template <size_t SymbolCount>
+bool computeCodeLengths(const std::array<uint64_t, SymbolCount>& frequencies, std::array<uint8_t, SymbolCount>& codeLengths) {
+    static_assert(SymbolCount <= 256, "symbols are stored as bytes");
+    codeLengths.fill(0);
+    std::array<uint8_t, SymbolCount> symbols;
+    size_t leafCount = 0;
+    for (unsigned symbol = 0; symbol < SymbolCount; ++symbol) {
+        if (frequencies[symbol] > 0) {
+            symbols[leafCount++] = static_cast<uint8_t>(symbol);
+        }
+    }
+    if (leafCount <= 1) { // A lone symbol still needs a one-bit code
+        if (leafCount == 1) {
+            codeLengths[symbols[0]] = 1;
+        }
+        return true;
+    }
+    std::sort(symbols.begin(), symbols.begin() + leafCount, [&](uint8_t a, uint8_t b) {
+        return frequencies[a] != frequencies[b] ? frequencies[a] < frequencies[b] : a < b;
+    });
+    std::array<uint64_t, SymbolCount> node;
+    for (size_t i = 0; i < leafCount; ++i) {
+        node[i] = frequencies[symbols[i]];
+    }
+
+    // 1. Merge the two lightest of the next leaf and the oldest unmerged internal node, n - 1
+    //    times. Internal node `next` overwrites a leaf already taken; a merged node's slot
+    //    stores the index of its parent instead of its weight
+    node[0] += node[1];
+    size_t root = 0; // Oldest internal node not yet merged
+    size_t leaf = 2; // Lightest leaf not yet merged
+    for (size_t next = 1; next + 1 < leafCount; ++next) {
+        if (leaf >= leafCount || node[root] < node[leaf]) {
+            node[next] = node[root];
+            node[root++] = next;
+        } else {
+            node[next] = node[leaf++];
+        }
+        if (leaf >= leafCount || (root < next && node[root] < node[leaf])) {
+            node[next] += node[root];
+            node[root++] = next;
+        } else {
+            node[next] += node[leaf++];
+        }
+    }
+
+    // 2. Turn the parent indices into depths, from the root (the last internal node) down
+    node[leafCount - 2] = 0;
+    for (size_t next = leafCount - 2; next-- > 0;) {
+        node[next] = node[node[next]] + 1;
+    }
+
+    // 3. Hand out leaf depths: each level has twice the nodes of the internal nodes above it, and
+    //    those not used as internal nodes are leaves, the heaviest leaves taking the shallowest
+    size_t available = 1;
+    size_t internalRoot = leafCount - 1; // One past the next internal node, deepest last
+    size_t nextLeaf = leafCount;         // One past the next leaf to assign, heaviest first
+    for (uint64_t depth = 0; available > 0; ++depth) {
+        size_t used = 0;
+        while (internalRoot > 0 && node[internalRoot - 1] == depth) {
+            ++used;
+            --internalRoot;
+        }
+        for (; available > used; --available) {
+            if (depth > kMaxCodeLength) {
+                return false;
+            }
+            node[--nextLeaf] = depth;
+        }
+        available = 2 * used;
+    }
+    for (size_t i = 0; i < leafCount; ++i) {
+        codeLengths[symbols[i]] = static_cast<uint8_t>(node[i]);
+    }
+    return true;
+}
+
+/**
+ * @brief Computes optimal code lengths of at most `maxLength` bits with the package-merge algorithm.
+ * Level k lists the leaves merged with the pairwise packages of level k - 1, by weight. Taking the
+ * 2n - 2 lightest items of the last level, then the first 2p items of each level below (where p is
+ * the number of packages taken above it), gives each symbol a length equal to the number of levels
+ * in which it is taken.
+ * @tparam SymbolCount The alphabet size, as for computeCodeLengths.
+ * @param frequencies The count of every symbol.
+ * @param maxLength The longest code allowed.
+ * @param codeLengths Receives the code length of every symbol (0 for unused symbols).
+ * @return False if the used symbols cannot all fit in codes of maxLength bits.
+ */
+template <size_t SymbolCount>
+bool computeLimitedCodeLengths(const std::array<uint64_t, SymbolCount>& frequencies, unsigned maxLength,
+                               std::array<uint8_t, SymbolCount>& codeLengths) {
+    static_assert(SymbolCount <= 256, "symbols are stored as bytes");
+    codeLengths.fill(0);
+    std::array<uint8_t, SymbolCount> leaves;
+    size_t leafCount = 0;
+    for (unsigned symbol = 0; symbol < SymbolCount; ++symbol) {
+        if (frequencies[symbol] > 0) {
+            leaves[leafCount++] = static_cast<uint8_t>(symbol);
+        }
+    }
+    // Equal weights keep symbol order, as a stable sort would, without its temporary buffer
+    std::sort(leaves.begin(), leaves.begin() + leafCount,
+              [&](uint8_t a, uint8_t b) { return frequencies[a] != frequencies[b] ? frequencies[a] < frequencies[b] : a < b; });
+    if (leafCount <= 1) {
+        if (leafCount == 1) {
+            codeLengths[leaves[0]] = 1;
+        }
+        return true;
+    }
+    if (maxLength == 0 || maxLength > kMaxCodeLength || (maxLength < 64 && (uint64_t(1) << maxLength) < leafCount)) {
+        return false;
+    }
+
+    // An item is a leaf (symbol >= 0) or a package of two consecutive items of the level below.
+    // A level holds fewer than 2 * leafCount items, so every level gets that many slots of one
+    // per-thread buffer, which keeps its storage from call to call.
+    struct Item {
+        uint64_t weight;
+        int symbol;
+    };
+    thread_local std::vector<Item> items;
+    items.resize(maxLength * 2 * leafCount);
+    std::array<size_t, kMaxCodeLength> levelSizes{};
+    const auto level = [&](unsigned index) { return items.data() + index * 2 * leafCount; };
+    for (size_t leaf = 0; leaf < leafCount; ++leaf) {
+        level(0)[leaf] = {frequencies[leaves[leaf]], leaves[leaf]};
+    }
+    levelSizes[0] = leafCount;
+    const Item* const leafItems = level(0);
+    for (unsigned index = 1; index < maxLength; ++index) {
+        const Item* const below = level(index - 1);
+        const size_t belowSize = levelSizes[index - 1];
+        Item* const current = level(index);
+        size_t size = 0;
+        size_t leaf = 0;
+        size_t pair = 0;
+        while (leaf < leafCount || pair + 1 < belowSize) {
+            const bool takeLeaf = pair + 1 >= belowSize ||
+                                  (leaf < leafCount && leafItems[leaf].weight <= below[pair].weight + below[pair + 1].weight);
+            if (takeLeaf) {
+                current[size++] = leafItems[leaf++];
+            } else {
+                current[size++] = {below[pair].weight + below[pair + 1].weight, -1};
+                pair += 2;
+            }
+        }
+        levelSizes[index] = size;
+    }
+
+    size_t taken = 2 * leafCount - 2;
+    for (unsigned index = maxLength; index-- > 0;) {
+        size_t packages = 0;
+        for (size_t i = 0; i < taken; ++i) {
+            const Item& item = level(index)[i];
+            if (item.symbol >= 0) {
+                ++codeLengths[item.symbol];
+            } else {
+                ++packages;
+            }
+        }
+        taken = 2 * packages;
+    }
+    return true;
+}
+
+/**
+ * @brief Returns the number of payload bits that a set of code lengths produces.
+ * @param frequencies The count of every symbol.
+ * @param codeLengths The code length of every symbol.
+ */
+inline uint64_t encodedBitCount(const ByteHistogram& frequencies, const CodeLengths& codeLengths) {
+    uint64_t totalBits = 0;
+    for (unsigned symbol = 0; symbol < 256; ++symbol) {
+        totalBits += frequencies[symbol] * codeLengths[symbol];
+    }
+    return totalBits;
+}
+
+#endif // CODE_LENGTHS_H
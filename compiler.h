@@ -0,0 +1,28 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+// Forces inlining of the small hot-loop helpers, so that they are compiled with the instruction
+// set of each kernel variant that calls them (see kernels.h).
+#if defined(__GNUC__) || defined(__clang__)
+#define HUFFMAN_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define HUFFMAN_ALWAYS_INLINE inline
+#endif
+
+// Keeps a function out of line. A replaced operator delete needs it: inlined, its free() call
+// draws a spurious mismatched-deallocation warning from GCC.
+#if defined(__GNUC__) || defined(__clang__)
+#define HUFFMAN_NOINLINE __attribute__((noinline))
+#else
+#define HUFFMAN_NOINLINE
+#endif
+
+// x86-64 builds carry BMI2 and AVX2 kernel variants, selected at startup from CPUID.
+#if (defined(__x86_64__) || defined(_M_X64)) && (defined(__GNUC__) || defined(__clang__))
+#define HUFFMAN_X86_DISPATCH 1
+#define HUFFMAN_TARGET(isa) __attribute__((target(isa)))
+#else
+#define HUFFMAN_X86_DISPATCH 0
+#endif
+
+#endif // COMPILER_H
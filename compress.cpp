@@ -1,145 +1,758 @@
 #include <iostream>
-#include <fstream>
 #include <string>
 #include <vector>
-#include <queue>
-#include <unordered_map>
-#include <bitset>
-#include <streambuf>
-
-// Represents a node in the Huffman tree
-struct HuffmanNode {
-    char character;
-    int frequency;
-    HuffmanNode *left, *right;
-
-    HuffmanNode(char c, int freq) : character(c), frequency(freq), left(nullptr), right(nullptr) {}
+#include <atomic>
+#include <array>
+#include <cstdint>
+#include <algorithm>
+
+#include "bit_writer.h"
+#include "code_lengths.h"
+#include "context_model.h"
+#include "file_io.h"
+#include "histogram.h"
+#include "huffman_encoder.h"
+#include "huffman_format.h"
+#include "huffman_stats.h"
+#include "kernels.h"
+#include "run_length.h"
+#include "table_header.h"
+#include "thread_pool.h"
+
+namespace {
+
+// What encodeBlock reports about a block besides its bytes
+struct BlockResult {
+    uint64_t lengthLimitCostBits = 0; // Payload bits added by the code length limit
+    size_t tableSize = 0;             // Bytes of the table header after the mode byte; 0 unless a Huffman mode won
+    CodeLengths codeLengths{};        // The block's code lengths, when tableSize is set
 };
 
-// Custom comparator for the priority queue to build a min-heap based on frequency
-struct NodeComparator {
-    bool operator()(const HuffmanNode* a, const HuffmanNode* b) const {
-        return a->frequency > b->frequency;
-    }
+} // namespace
+
+// A block coded on the thread pool, in one of the encoder's slots. The slots keep their buffers
+// from block to block and file to file, so once they have grown, pooled blocks allocate nothing.
+struct CompressedBlock {
+    std::vector<uint8_t> input;  // Input bytes of the block that could not be viewed in place
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    const CompressionOptions* options = nullptr;
+    std::vector<uint8_t> bytes;  // Block header, table header and packed payload; empty on failure
+    BlockResult result;
+    CompressionStats stats;      // Counters of this block when stats are collected
+    std::atomic<bool> done{false};
+
+    // Codes the block with a full table; the writer links it to its predecessor.
+    void run();
+};
+
+namespace {
+
+// How a block is to be coded, as planBlock works out from its histogram and code lengths alone
+struct BlockPlan {
+    BlockMode mode = BlockMode::Stored;
+    bool interleaved = false;         // Huffman streams are interleaved
+    CodeLengths codeLengths{};
+    HuffmanCodeTable codes{};
+    unsigned maxLength = 0;           // Longest code
+    uint64_t totalBits = 0;           // Huffman payload bits
+    uint64_t lengthLimitCostBits = 0; // Payload bits added by the code length limit
+    size_t tableEnd = 0;              // End of the table header in the block buffer
+    const ContextModel* contextModel = nullptr;       // Of a context Huffman block
+    const std::vector<uint8_t>* contextHeader = nullptr;
+    uint64_t contextBits = 0;         // Context Huffman payload bits
+    uint64_t payloadSize = 0;         // Bytes after the block header without the checksum; at most
+                                      // this for Huffman modes, 0 (not sized) for run-length blocks
 };
 
 /**
- * @brief Recursively traverses the Huffman tree to generate the binary codes for each character.
- * @param root The current node in the Huffman tree.
- * @param huffmanCodeTable A map to store the generated character-to-code mappings.
- * @param codeInProgress The binary code string being built during traversal.
+ * @brief Picks the smallest of a block's Huffman, context Huffman, stored and run-length forms,
+ * sizing each from the histogram and the code lengths without coding the payload.
+ * @param blockData The input bytes of the block.
+ * @param blockSize The number of input bytes, at most kMaxBlockSize.
+ * @param options The code length limit, stream interleaving and context mode.
+ * @param tables The previous table of the block's group, which the table header may refer to.
+ * @param encodedBlock The buffer the block goes to; receives room for the block header, the mode
+ *        byte and the block's Huffman table header.
+ * @param plan Receives the chosen mode and what coding it needs.
+ * @param timer Times the phases.
+ * @param histogramPool The pool frequencies are also counted on; null counts on the calling thread.
+ * @return False if a code would exceed kMaxCodeLength bits.
  */
-void generateHuffmanCodes(HuffmanNode* root, std::unordered_map<char, std::string>& huffmanCodeTable, const std::string& codeInProgress) {
-    if (!root) {
-        return;
+bool planBlock(const uint8_t* blockData, size_t blockSize, const CompressionOptions& options, const TableContext& tables,
+               std::vector<uint8_t>& encodedBlock, BlockPlan& plan, EncodePhaseTimer& timer, ThreadPool* histogramPool) {
+    // 1. Calculate character frequencies
+    const ByteHistogram frequencies = computeHistogram(blockData, blockSize, histogramPool);
+    timer.lap(EncodePhase::Frequency);
+
+    // 2. Compute the code lengths from the sorted frequencies
+    CodeLengths& codeLengths = plan.codeLengths;
+    if (!computeCodeLengths(frequencies, codeLengths)) {
+        return false;
+    }
+    timer.lap(EncodePhase::TreeBuild);
+
+    // 3. If the codes are longer than the limit, recompute the lengths with package-merge
+    plan.totalBits = encodedBitCount(frequencies, codeLengths);
+    plan.lengthLimitCostBits = 0;
+    if (options.maxCodeLength != 0 && *std::max_element(codeLengths.begin(), codeLengths.end()) > options.maxCodeLength) {
+        if (!computeLimitedCodeLengths(frequencies, options.maxCodeLength, codeLengths)) {
+            return false;
+        }
+        const uint64_t limitedBits = encodedBitCount(frequencies, codeLengths);
+        plan.lengthLimitCostBits = limitedBits - plan.totalBits;
+        plan.totalBits = limitedBits;
     }
-    // A leaf node contains a character
-    if (!root->left && !root->right) {
-        huffmanCodeTable[root->character] = codeInProgress;
+    assignCanonicalCodes(codeLengths, plan.codes);
+    plan.maxLength = *std::max_element(codeLengths.begin(), codeLengths.end());
+    timer.lap(EncodePhase::CodeGeneration);
+
+    // 4. Size each representation from the histogram and the code lengths; runs are counted only
+    //    while run-length coding can still be the smallest
+    const size_t blockStart = encodedBlock.size();
+    encodedBlock.resize(blockStart + kBlockHeaderSize + 1);
+    writeTableHeader(codeLengths, tables, encodedBlock);
+    plan.tableEnd = encodedBlock.size();
+    plan.interleaved = options.interleaveStreams && blockSize >= kMinInterleavedBlockSize;
+    const uint64_t huffmanSize = plan.tableEnd - blockStart - kBlockHeaderSize + (plan.totalBits + 7) / 8 +
+                                 (plan.interleaved ? kJumpTableSize + kInterleavedStreamCount - 1 : 0);
+    const uint64_t storedSize = 1 + blockSize;
+    thread_local ContextModel contextModel;
+    thread_local std::vector<uint8_t> contextHeader;
+    plan.contextModel = &contextModel;
+    plan.contextHeader = &contextHeader;
+    plan.contextBits = 0;
+    uint64_t contextSize = UINT64_MAX;
+    if (options.contextTables != 0 && blockSize >= kMinContextBlockSize) {
+        plan.contextBits = buildContextModel(blockData, blockSize, options.contextTables, options.maxCodeLength, contextModel);
+        if (plan.contextBits != 0) {
+            contextHeader.clear();
+            writeContextModel(contextModel, contextHeader);
+            contextSize = 1 + contextHeader.size() + kJumpTableSize + (plan.contextBits + 7) / 8 + kInterleavedStreamCount - 1;
+        }
+    }
+    const uint64_t codedSize = std::min(huffmanSize, contextSize);
+    const size_t runLimit = static_cast<size_t>(std::min(codedSize, storedSize) / 2);
+    plan.mode = plan.interleaved ? BlockMode::InterleavedHuffman : BlockMode::Huffman;
+    plan.payloadSize = huffmanSize;
+    if (activeKernels().countRuns(blockData, blockSize, runLimit) < runLimit) {
+        plan.mode = BlockMode::RunLength;
+        plan.payloadSize = 0;
+    } else if (storedSize <= codedSize) {
+        plan.mode = BlockMode::Stored;
+        plan.payloadSize = storedSize;
+    } else if (contextSize < huffmanSize) {
+        plan.mode = BlockMode::ContextHuffman;
+        plan.payloadSize = contextSize;
     }
-    generateHuffmanCodes(root->left, huffmanCodeTable, codeInProgress + "0");
-    generateHuffmanCodes(root->right, huffmanCodeTable, codeInProgress + "1");
+    encodedBlock[blockStart + kBlockHeaderSize] = static_cast<uint8_t>(plan.mode);
+    timer.lap(EncodePhase::Encode);
+    return true;
 }
 
 /**
- * @brief Serializes the Huffman tree structure to a file for later decompression.
- * @param root The root of the Huffman tree.
- * @param treeFileStream The output file stream for the tree data.
+ * @brief Codes one block in the smallest of its Huffman, context Huffman, stored and run-length forms.
+ * @param blockData The input bytes of the block.
+ * @param blockSize The number of input bytes, at most kMaxBlockSize.
+ * @param options The code length limit and stream interleaving.
+ * @param tables The previous table of the block's group, which the table header may refer to.
+ * @param encodedBlock The buffer the encoded block is appended to.
+ * @param result Receives the cost of the length limit and the table written.
+ * @param stats Receives the block's counters and phase times; null when stats are off.
+ * @param histogramPool The pool frequencies are also counted on; worthwhile only for a large lone block.
+ * @return False if a code would exceed kMaxCodeLength bits.
  */
-void serializeHuffmanTree(const HuffmanNode* root, std::ofstream& treeFileStream) {
-    if (!root) {
-        return;
+bool encodeBlock(const uint8_t* blockData, size_t blockSize, const CompressionOptions& options, const TableContext& tables,
+                 std::vector<uint8_t>& encodedBlock, BlockResult& result, CompressionStats* stats, ThreadPool* histogramPool = nullptr) {
+    EncodePhaseTimer timer(stats ? &stats->phaseNanoseconds : nullptr);
+
+    // 1. Count the frequencies, build the codes and pick the mode
+    const size_t blockStart = encodedBlock.size();
+    BlockPlan plan;
+    if (!planBlock(blockData, blockSize, options, tables, encodedBlock, plan, timer, histogramPool)) {
+        return false;
     }
-    // Mark leaf nodes with '1' followed by the character
-    if (!root->left && !root->right) {
-        treeFileStream << '1' << root->character;
-    } else { // Mark internal nodes with '0'
-        treeFileStream << '0';
-        serializeHuffmanTree(root->left, treeFileStream);
-        serializeHuffmanTree(root->right, treeFileStream);
+    const BlockMode mode = plan.mode;
+    const bool interleaved = plan.interleaved;
+    const size_t tableEnd = plan.tableEnd;
+    const uint64_t totalBits = plan.totalBits;
+    const CodeLengths& codeLengths = plan.codeLengths;
+    const Kernels& kernels = activeKernels();
+    result.lengthLimitCostBits = plan.lengthLimitCostBits;
+
+    // 2. Write the payload of the chosen mode; Huffman codes are packed straight into the block
+    //    buffer, one segment per stream behind the jump table when interleaved
+    if (mode == BlockMode::Huffman || mode == BlockMode::InterleavedHuffman) {
+        const unsigned streamCount = interleaved ? kInterleavedStreamCount : 1;
+        const size_t streamsStart = tableEnd + (interleaved ? kJumpTableSize : 0);
+        const size_t segmentSize = interleaved ? interleavedSegmentSize(blockSize) : blockSize;
+        encodedBlock.resize(streamsStart + (totalBits + 7) / 8 + streamCount + kPackSlack);
+        uint8_t* streamStart = encodedBlock.data() + streamsStart;
+        for (unsigned stream = 0; stream < streamCount; ++stream) {
+            const size_t segmentStart = std::min(blockSize, stream * segmentSize);
+            const size_t segmentEnd = stream + 1 == streamCount ? blockSize : std::min(blockSize, segmentStart + segmentSize);
+            uint8_t* const streamEnd = kernels.packCodes(plan.codes, plan.maxLength, blockData + segmentStart,
+                                                         segmentEnd - segmentStart, streamStart);
+            if (stream + 1 < streamCount) {
+                storeLittleEndian32(static_cast<uint32_t>(streamEnd - streamStart), encodedBlock.data() + tableEnd + 4 * stream);
+            }
+            streamStart = streamEnd;
+        }
+        encodedBlock.resize(static_cast<size_t>(streamStart - encodedBlock.data()));
+        result.tableSize = tableEnd - blockStart - kBlockHeaderSize - 1;
+        result.codeLengths = codeLengths;
+    } else if (mode == BlockMode::ContextHuffman) {
+        // Always four streams: their independent context chains are what makes decoding fast
+        result.lengthLimitCostBits = 0;
+        result.tableSize = 0;
+        encodedBlock.resize(blockStart + kBlockHeaderSize + 1);
+        const ContextModel& contextModel = *plan.contextModel;
+        encodedBlock.insert(encodedBlock.end(), plan.contextHeader->begin(), plan.contextHeader->end());
+        thread_local std::array<HuffmanCodeTable, kMaxContextTables> tableCodes;
+        std::array<const HuffmanCodeTable*, 256> contextCodes;
+        for (unsigned table = 0; table < contextModel.tableCount; ++table) {
+            assignCanonicalCodes(contextModel.codeLengths[table], tableCodes[table]);
+        }
+        for (unsigned context = 0; context < 256; ++context) {
+            contextCodes[context] = &tableCodes[contextModel.contextTables[context]];
+        }
+        const size_t jumpTableStart = encodedBlock.size();
+        const size_t segmentSize = interleavedSegmentSize(blockSize);
+        encodedBlock.resize(jumpTableStart + kJumpTableSize + (plan.contextBits + 7) / 8 + kInterleavedStreamCount + kPackSlack);
+        uint8_t* streamStart = encodedBlock.data() + jumpTableStart + kJumpTableSize;
+        for (unsigned stream = 0; stream < kInterleavedStreamCount; ++stream) {
+            const size_t segmentStart = std::min(blockSize, stream * segmentSize);
+            const size_t segmentEnd = stream + 1 == kInterleavedStreamCount ? blockSize : std::min(blockSize, segmentStart + segmentSize);
+            uint8_t* const streamEnd = packContextCodes(contextCodes.data(), blockData + segmentStart, segmentEnd - segmentStart, streamStart);
+            if (stream + 1 < kInterleavedStreamCount) {
+                storeLittleEndian32(static_cast<uint32_t>(streamEnd - streamStart), encodedBlock.data() + jumpTableStart + 4 * stream);
+            }
+            streamStart = streamEnd;
+        }
+        encodedBlock.resize(static_cast<size_t>(streamStart - encodedBlock.data()));
+    } else {
+        result.lengthLimitCostBits = 0;
+        result.tableSize = 0;
+        encodedBlock.resize(blockStart + kBlockHeaderSize + 1);
+        if (mode == BlockMode::Stored) {
+            encodedBlock.insert(encodedBlock.end(), blockData, blockData + blockSize);
+        } else {
+            writeRuns(blockData, blockSize, encodedBlock);
+        }
+    }
+    timer.lap(EncodePhase::Pack);
+
+    // 3. Append the checksum of the raw bytes, then fill in the header
+    if (options.checksums) {
+        const size_t checksumStart = encodedBlock.size();
+        encodedBlock.resize(checksumStart + kBlockChecksumSize);
+        storeLittleEndian32(kernels.crc32c(blockData, blockSize), encodedBlock.data() + checksumStart);
     }
+    writeBlockHeader(static_cast<uint32_t>(blockSize), static_cast<uint32_t>(encodedBlock.size() - blockStart - kBlockHeaderSize),
+                     encodedBlock.data() + blockStart);
+    timer.lap(EncodePhase::Checksum);
+
+    if (kStatsEnabled && stats) {
+        stats->bytesIn += blockSize;
+        ++stats->blockCount;
+        ++stats->blocksByMode[static_cast<size_t>(mode)];
+        if (mode == BlockMode::Huffman || mode == BlockMode::InterleavedHuffman) {
+            for (const uint8_t length : codeLengths) {
+                stats->codeLengthCounts[length] += length != 0;
+            }
+        }
+    }
+    return true;
 }
 
 /**
- * @brief Compresses a file using the Huffman coding algorithm.
- * @param sourcePath The path to the input file to be compressed.
- * @param destinationPath The path where the compressed output file will be saved.
+ * @brief Recodes the table header of a block coded without a previous table against the previous
+ * table of its group, for blocks coded on the pool before the blocks ahead of them were known.
+ * @param bytes The encoded block, starting with its block header; its encoded size is updated
+ *        when the table is replaced.
+ * @param result What encodeBlock reported for the block.
+ * @param tables The previous table of the block's group.
+ * @param table Receives the replacement table header, or is left empty if the block's own is no larger.
  */
-void huffmanEncodeFile(const std::string& sourcePath, const std::string& destinationPath) {
-    std::ifstream inputFileStream(sourcePath, std::ios::binary);
-    if (!inputFileStream) {
-        std::cerr << "Error: Cannot open input file: " << sourcePath << std::endl;
+void relinkBlockTable(std::vector<uint8_t>& bytes, const BlockResult& result, const TableContext& tables, std::vector<uint8_t>& table) {
+    table.clear();
+    if (result.tableSize == 0 || !tables.hasPrevious) {
+        return;
+    }
+    writeTableHeader(result.codeLengths, tables, table, true);
+    if (table.size() >= result.tableSize) {
+        table.clear();
         return;
     }
+    writeBlockHeader(loadLittleEndian32(bytes.data()),
+                     static_cast<uint32_t>(bytes.size() - kBlockHeaderSize - result.tableSize + table.size()), bytes.data());
+}
 
-    std::ofstream outputFileStream(destinationPath, std::ios::binary);
-    std::ofstream treeFileStream(destinationPath + ".tree", std::ios::binary);
+/**
+ * @brief Checks the block size and code length limit of a set of options.
+ * @param options The options to check.
+ * @param error Receives the reason when the options are invalid.
+ * @return False if an option is out of range.
+ */
+bool validateOptions(const CompressionOptions& options, std::string& error) {
+    if (options.blockSize == 0 || options.blockSize > kMaxBlockSize) {
+        error = "Block size must be between 1 and " + std::to_string(kMaxBlockSize) + " bytes";
+        return false;
+    }
+    if (options.maxCodeLength != 0 && (options.maxCodeLength < 8 || options.maxCodeLength > kMaxCodeLength)) {
+        error = "Maximum code length must be between 8 and " + std::to_string(kMaxCodeLength) + " bits";
+        return false;
+    }
+    if (options.contextTables == 1 || options.contextTables > kMaxContextTables) {
+        error = "Context tables must be between 2 and " + std::to_string(kMaxContextTables);
+        return false;
+    }
+    return true;
+}
 
-    // 1. Read the file and calculate character frequencies
-    std::unordered_map<char, int> frequencyMap;
-    const std::string fileData((std::istreambuf_iterator<char>(inputFileStream)), std::istreambuf_iterator<char>());
-    inputFileStream.close();
+} // namespace
 
-    // 2. Build the Huffman tree using a priority queue
-    std::priority_queue<HuffmanNode*, std::vector<HuffmanNode*>, NodeComparator> minHeap;
-    for (const auto& pair : frequencyMap) {
-        minHeap.push(new HuffmanNode(pair.first, pair.second));
+void CompressedBlock::run() {
+    bytes.clear();
+    stats = {};
+    if (!encodeBlock(data, size, *options, TableContext{}, bytes, result, options->collectStats ? &stats : nullptr)) {
+        bytes.clear();
+        result = {};
     }
+}
+
+HuffmanEncoder::HuffmanEncoder(const CompressionOptions& options)
+    : options(options), threadCount(options.threadCount ? options.threadCount : std::max(1u, std::thread::hardware_concurrency())) {}
 
-    while (minHeap.size() > 1) {
-        HuffmanNode* leftChild = minHeap.top();
-        minHeap.pop();
-        HuffmanNode* rightChild = minHeap.top();
-        minHeap.pop();
-        
-        HuffmanNode* parentNode = new HuffmanNode('\0', leftChild->frequency + rightChild->frequency);
-        parentNode->left = leftChild;
-        parentNode->right = rightChild;
-        minHeap.push(parentNode);
+HuffmanEncoder::HuffmanEncoder(const CompressionOptions& options, ThreadPool& sharedPool)
+    : options(options), threadCount(sharedPool.size()), sharedPool(&sharedPool) {}
+
+HuffmanEncoder::~HuffmanEncoder() = default;
+
+bool HuffmanEncoder::encode(std::span<const uint8_t> input, std::vector<uint8_t>& output) {
+    output.clear();
+    if (!validateOptions(options, lastError)) {
+        return false;
     }
-    HuffmanNode* treeRoot = minHeap.top();
+    InputFile inputFile;
+    inputFile.openMemory(input.data(), input.size());
+    OutputFile outputFile;
+    outputFile.openBuffer(output);
+    return encodeBlocks(inputFile, outputFile);
+}
 
-    // 3. Save the tree structure to a separate file for decompression
-    serializeHuffmanTree(treeRoot, treeFileStream);
-    treeFileStream.close();
+bool HuffmanEncoder::encode(InputFile& inputFile, OutputFile& outputFile) {
+    return validateOptions(options, lastError) && encodeBlocks(inputFile, outputFile);
+}
 
-    // 4. Generate the Huffman codes for each character
-    std::unordered_map<char, std::string> huffmanCodeTable;
-    generateHuffmanCodes(treeRoot, huffmanCodeTable, "");
+bool HuffmanEncoder::encodeFile(const std::string& sourcePath, const std::string& destinationPath) {
+    if (!validateOptions(options, lastError)) {
+        return false;
+    }
+    InputFile inputFile;
+    if (!inputFile.open(sourcePath)) {
+        lastError = "Cannot open input file: " + sourcePath;
+        return false;
+    }
+    OutputFile outputFile;
+    if (!outputFile.open(destinationPath)) {
+        lastError = "Cannot create output file: " + destinationPath;
+        return false;
+    }
+    const bool encoded = encodeBlocks(inputFile, outputFile);
+    if (!outputFile.close()) {
+        lastError = "Cannot write output file: " + destinationPath;
+        return false;
+    }
+    return encoded;
+}
+
+/**
+ * @brief Codes the whole input as a container: header, blocks, terminator and block index.
+ * Blocks go to the thread pool with at most two per thread in flight, so memory use does not
+ * depend on the input size. A lone block, or every block when the encoder has one thread,
+ * is coded on the calling thread instead.
+ * @param inputFile The input, positioned at its start.
+ * @param outputFile The destination of the container.
+ * @return False if a block cannot be coded.
+ */
+bool HuffmanEncoder::encodeBlocks(InputFile& inputFile, OutputFile& outputFile) {
+    lastStats = {};
+    CompressionStats* const stats = kStatsEnabled && options.collectStats ? &lastStats : nullptr;
+    EncodePhaseTimer ioTimer(stats ? &stats->phaseNanoseconds : nullptr);
 
-    // 5. Encode the original file content into a bit string
-    std::string bitString = "";
-    for (const char& c : fileData) {
-        bitString += huffmanCodeTable[c];
+    // 1. Write the file header; with async I/O the input is read ahead while blocks are coded,
+    //    and the output written behind them
+    if (options.asyncIo) {
+        inputFile.startReadAhead(readIo);
+        outputFile.startWriteBehind(writeIo);
     }
+    blockBuffer.clear();
+    writeFileHeader(options.blockSize, options.checksums ? kChecksumFlag : 0, blockBuffer);
+    outputFile.write(blockBuffer.data(), blockBuffer.size());
+    ioTimer.lap(EncodePhase::Write);
+    uint64_t bytesWritten = blockBuffer.size();
 
-    // 6. Pad the bit string to make its length a multiple of 8
-    // The first byte of the compressed file stores the number of padding bits
-    int paddingBits = (8 - bitString.length() % 8) % 8;
-    outputFileStream.put(static_cast<char>(paddingBits));
-    
-    for (int i = 0; i < paddingBits; ++i) {
-        bitString += '0';
+    // 2. Take the input block by block (a view into the mapping, or a buffered read) and hand
+    //    each block to the pool
+    // 3. Write finished blocks in input order, waiting on the oldest once the window is full,
+    //    and record where each one landed for the block index
+    const size_t maxBlocksInFlight = 2 * size_t(threadCount);
+    while (threadCount > 1 && blockSlots.size() < maxBlocksInFlight) {
+        blockSlots.push_back(std::make_unique<CompressedBlock>());
     }
+    size_t blocksWritten = 0; // Blocks from here to the end of the index are in flight
+    ThreadPool* pool = sharedPool ? sharedPool : threadPool.get();
+    blockIndex.blocks.clear();
+    blockIndex.rawSize = 0;
+    lastLengthLimitCostBits = 0;
+    bool failed = false;
+    TableContext tables; // The previous table of the group being written
+    const auto writeBlock = [&](std::vector<uint8_t>& bytes, const BlockResult& result, size_t blockNumber, bool relink) {
+        failed = failed || bytes.empty();
+        if (relink && !bytes.empty()) {
+            relinkBlockTable(bytes, result, tables, linkedTable);
+        }
+        ioTimer.restart();
+        size_t blockSize = bytes.size();
+        if (relink && !linkedTable.empty()) {
+            // Header and mode byte, the linked table, then the payload after the block's own table
+            const size_t tableStart = kBlockHeaderSize + 1;
+            outputFile.write(bytes.data(), tableStart);
+            outputFile.write(linkedTable.data(), linkedTable.size());
+            outputFile.write(bytes.data() + tableStart + result.tableSize, bytes.size() - tableStart - result.tableSize);
+            blockSize += linkedTable.size() - result.tableSize;
+        } else {
+            outputFile.write(bytes.data(), bytes.size());
+        }
+        ioTimer.lap(EncodePhase::Write);
+        blockIndex.blocks[blockNumber].encodedOffset = bytesWritten;
+        bytesWritten += blockSize;
+        lastLengthLimitCostBits += result.lengthLimitCostBits;
+        if (result.tableSize != 0) {
+            tables.remember(result.codeLengths);
+        }
+    };
+    const auto writeOldestBlock = [&] {
+        const size_t blockNumber = blocksWritten++;
+        CompressedBlock& compressedBlock = *blockSlots[blockNumber % maxBlocksInFlight];
+        pool->wait(compressedBlock.done);
+        if (stats) {
+            stats->add(compressedBlock.stats);
+        }
+        tables.startBlock(blockNumber);
+        writeBlock(compressedBlock.bytes, compressedBlock.result, blockNumber, true);
+    };
 
-    // 7. Write the encoded data to the output file byte by byte
-    for (size_t i = 0; i < bitString.length(); i += 8) {
-        std::bitset<8> byte(bitString.substr(i, 8));
-        outputFileStream.put(static_cast<unsigned char>(byte.to_ulong()));
+    for (;;) {
+        // The slot of the block being read is free: its previous block was written before this read
+        const uint8_t* blockData = nullptr;
+        CompressedBlock* const slot = threadCount > 1 ? blockSlots[blockIndex.blocks.size() % maxBlocksInFlight].get() : nullptr;
+        ioTimer.restart();
+        const size_t blockSize = inputFile.readView(options.blockSize, 0, blockData, slot ? slot->input : inputBuffer);
+        ioTimer.lap(EncodePhase::Read);
+        if (blockSize == 0) {
+            break;
+        }
+        const bool firstBlock = blockIndex.blocks.empty();
+        blockIndex.blocks.push_back({0, blockIndex.rawSize});
+        blockIndex.rawSize += blockSize;
+
+        if (threadCount == 1 || (firstBlock && inputFile.atEnd())) {
+            // An input that fits in one block gets no block parallelism, so its histogram is split
+            // over the pool. On a shared pool the other workers have files of their own.
+            BlockResult result;
+            blockBuffer.clear();
+            tables.startBlock(blockIndex.blocks.size() - 1);
+            ThreadPool* histogramPool = nullptr;
+            if (threadCount > 1 && firstBlock && !sharedPool && blockSize >= 2 * kMinParallelHistogramBytes) {
+                if (!pool) {
+                    threadPool = std::make_unique<ThreadPool>(threadCount);
+                    pool = threadPool.get();
+                }
+                histogramPool = pool;
+            }
+            if (!encodeBlock(blockData, blockSize, options, tables, blockBuffer, result, stats, histogramPool)) {
+                blockBuffer.clear();
+                result = {};
+            }
+            writeBlock(blockBuffer, result, blockIndex.blocks.size() - 1, false);
+            ++blocksWritten;
+            continue;
+        }
+        if (!pool) {
+            threadPool = std::make_unique<ThreadPool>(threadCount);
+            pool = threadPool.get();
+        }
+        slot->data = blockData;
+        slot->size = blockSize;
+        slot->options = &options;
+        pool->post(*slot);
+        if (blockIndex.blocks.size() - blocksWritten >= maxBlocksInFlight) {
+            writeOldestBlock();
+        }
+    }
+    while (blocksWritten < blockIndex.blocks.size()) {
+        writeOldestBlock();
     }
 
-    outputFileStream.close();
-    std::cout << "Compression complete. Output saved to: " << destinationPath << std::endl;
+    // 4. Terminate the block sequence and append the block index footer
+    blockBuffer.assign(kBlockHeaderSize, 0);
+    writeBlockHeader(0, 0, blockBuffer.data());
+    writeBlockIndex(blockIndex, bytesWritten + kBlockHeaderSize, blockBuffer);
+    ioTimer.restart();
+    outputFile.write(blockBuffer.data(), blockBuffer.size());
+    inputFile.stopReadAhead();
+    outputFile.stopWriteBehind(); // A failed write is reported when the file is closed
+    ioTimer.lap(EncodePhase::Write);
+    lastEncodedSize = bytesWritten + blockBuffer.size();
+    if (stats) {
+        stats->bytesOut = lastEncodedSize;
+    }
+
+    if (inputFile.readFailed()) {
+        lastError = "Cannot read input file";
+        return false;
+    }
+    if (failed) {
+        lastError = "Huffman code exceeds " + std::to_string(kMaxCodeLength) + " bits";
+        return false;
+    }
+    return true;
+}
+
+bool HuffmanEncoder::estimateSize(std::span<const uint8_t> input, SizeEstimate& estimate, unsigned sampleInterval) {
+    InputFile inputFile;
+    inputFile.openMemory(input.data(), input.size());
+    return estimateSize(inputFile, estimate, sampleInterval);
+}
+
+bool HuffmanEncoder::estimateFile(const std::string& sourcePath, SizeEstimate& estimate, unsigned sampleInterval) {
+    InputFile inputFile;
+    if (!inputFile.open(sourcePath)) {
+        estimate = {};
+        lastError = "Cannot open input file: " + sourcePath;
+        return false;
+    }
+    return estimateSize(inputFile, estimate, sampleInterval);
+}
+
+bool HuffmanEncoder::estimateSize(InputFile& inputFile, SizeEstimate& estimate, unsigned sampleInterval) {
+    estimate = {};
+    if (!validateOptions(options, lastError)) {
+        return false;
+    }
+    sampleInterval = std::max(1u, sampleInterval);
+
+    // 1. Plan each sampled block as encodeBlock would and total the sizes; the blocks in between
+    //    are skipped, by seeking when the input allows it, and each sampled block then gets a
+    //    full table since the table before it is unknown
+    TableContext tables;
+    EncodePhaseTimer timer(nullptr);
+    for (uint64_t blockNumber = 0;; ++blockNumber) {
+        const bool sampled = blockNumber % sampleInterval == 0;
+        size_t blockSize = 0;
+        const uint8_t* blockData = nullptr;
+        if (!sampled && inputFile.isSeekable()) {
+            blockSize = static_cast<size_t>(std::min<uint64_t>(options.blockSize, inputFile.size() - estimate.rawSize));
+            if (blockSize != 0 && !inputFile.seek(estimate.rawSize + blockSize)) {
+                blockSize = 0;
+            }
+        } else {
+            blockSize = inputFile.readView(options.blockSize, 0, blockData, inputBuffer);
+        }
+        if (blockSize == 0) {
+            break;
+        }
+        estimate.rawSize += blockSize;
+        ++estimate.blockCount;
+        if (!sampled) {
+            continue;
+        }
+
+        tables.startBlock(sampleInterval == 1 ? blockNumber : 0);
+        BlockPlan plan;
+        blockBuffer.clear();
+        if (!planBlock(blockData, blockSize, options, tables, blockBuffer, plan, timer, nullptr)) {
+            lastError = "Huffman code exceeds " + std::to_string(kMaxCodeLength) + " bits";
+            return false;
+        }
+        if (plan.mode == BlockMode::RunLength) {
+            blockBuffer.clear();
+            writeRuns(blockData, blockSize, blockBuffer);
+            plan.payloadSize = 1 + blockBuffer.size();
+        }
+        if (plan.mode == BlockMode::Huffman || plan.mode == BlockMode::InterleavedHuffman) {
+            tables.remember(plan.codeLengths);
+        }
+        estimate.sampledSize += kBlockHeaderSize + plan.payloadSize + (options.checksums ? kBlockChecksumSize : 0);
+        estimate.sampledBytes += blockSize;
+        ++estimate.sampledBlocks;
+        ++estimate.blocksByMode[static_cast<size_t>(plan.mode)];
+    }
+    if (inputFile.readFailed()) {
+        lastError = "Cannot read input file";
+        return false;
+    }
+
+    // 2. Scale the sampled blocks to the whole input and add the container's own bytes
+    uint64_t blocksSize = estimate.sampledSize;
+    if (estimate.sampledBytes != 0 && estimate.rawSize > estimate.sampledBytes) {
+        blocksSize += static_cast<uint64_t>(static_cast<double>(estimate.rawSize - estimate.sampledBytes) *
+                                            static_cast<double>(estimate.sampledSize) / static_cast<double>(estimate.sampledBytes));
+    }
+    estimate.estimatedSize = kFileHeaderSize + blocksSize + kBlockHeaderSize + estimate.blockCount * kIndexEntrySize + kIndexTrailerSize;
+    return true;
+}
+
+HuffmanStreamEncoder::HuffmanStreamEncoder(const CompressionOptions& options) : options(options) {}
+
+bool HuffmanStreamEncoder::feed(std::span<const uint8_t> chunk, std::vector<uint8_t>& output) {
+    if (!started && !begin(output)) {
+        return false;
+    }
+    // 1. Top up the partial block and code it once it is full
+    if (!pending.empty()) {
+        const size_t taken = std::min<size_t>(options.blockSize - pending.size(), chunk.size());
+        pending.insert(pending.end(), chunk.begin(), chunk.begin() + taken);
+        chunk = chunk.subspan(taken);
+        if (pending.size() < options.blockSize) {
+            return true;
+        }
+        if (!writeBlock(pending.data(), pending.size(), output)) {
+            return false;
+        }
+        pending.clear();
+    }
+    // 2. Code whole blocks straight from the chunk
+    while (chunk.size() >= options.blockSize) {
+        if (!writeBlock(chunk.data(), options.blockSize, output)) {
+            return false;
+        }
+        chunk = chunk.subspan(options.blockSize);
+    }
+    // 3. Keep the remainder for the next call
+    pending.assign(chunk.begin(), chunk.end());
+    return true;
+}
+
+bool HuffmanStreamEncoder::flush(std::vector<uint8_t>& output) {
+    if (!started && !begin(output)) {
+        return false;
+    }
+    if (pending.empty()) {
+        return true;
+    }
+    const bool written = writeBlock(pending.data(), pending.size(), output);
+    pending.clear();
+    return written;
 }
 
+bool HuffmanStreamEncoder::finish(std::vector<uint8_t>& output) {
+    if (!flush(output)) {
+        return false;
+    }
+    const size_t footerStart = output.size();
+    output.resize(footerStart + kBlockHeaderSize);
+    writeBlockHeader(0, 0, output.data() + footerStart);
+    writeBlockIndex(blockIndex, bytesWritten + kBlockHeaderSize, output);
+
+    started = false;
+    blockIndex.blocks.clear();
+    blockIndex.rawSize = 0;
+    bytesWritten = 0;
+    tables = {};
+    return true;
+}
+
+// Validates the options and emits the file header of a new container.
+bool HuffmanStreamEncoder::begin(std::vector<uint8_t>& output) {
+    if (!validateOptions(options, lastError)) {
+        return false;
+    }
+    writeFileHeader(options.blockSize, options.checksums ? kChecksumFlag : 0, output);
+    bytesWritten = kFileHeaderSize;
+    started = true;
+    return true;
+}
+
+// Codes one block onto the end of `output` and records it in the block index.
+bool HuffmanStreamEncoder::writeBlock(const uint8_t* blockData, size_t blockSize, std::vector<uint8_t>& output) {
+    const size_t blockStart = output.size();
+    BlockResult result;
+    tables.startBlock(blockIndex.blocks.size());
+    if (!encodeBlock(blockData, blockSize, options, tables, output, result, nullptr)) {
+        output.resize(blockStart);
+        lastError = "Huffman code exceeds " + std::to_string(kMaxCodeLength) + " bits";
+        return false;
+    }
+    blockIndex.blocks.push_back({bytesWritten, blockIndex.rawSize});
+    blockIndex.rawSize += blockSize;
+    bytesWritten += output.size() - blockStart;
+    if (result.tableSize != 0) {
+        tables.remember(result.codeLengths);
+    }
+    return true;
+}
+
+bool HuffmanMessageEncoder::addDictionary(const HuffmanDictionary& dictionary) {
+    if (!isValidCodeLengths(dictionary.codeLengths)) {
+        lastError = "Invalid code lengths in dictionary " + std::to_string(dictionary.id);
+        return false;
+    }
+    CodeTable& table = tables[dictionary.id];
+    assignCanonicalCodes(dictionary.codeLengths, table.codes);
+    table.maxLength = *std::max_element(dictionary.codeLengths.begin(), dictionary.codeLengths.end());
+    return true;
+}
 
-int main() {
-    // === IMPORTANT: Change this line to the path of your input file ===
-    const std::string sourceFile = "input.txt"; 
-    
-    const std::string compressedFile = "compressed_output.huff";
-    
-    huffmanEncodeFile(sourceFile, compressedFile);
-    
-    return 0;
-}
\ No newline at end of file
+bool HuffmanMessageEncoder::encode(uint32_t dictionaryId, std::span<const uint8_t> message, std::vector<uint8_t>& output) {
+    output.clear();
+    const auto found = tables.find(dictionaryId);
+    if (found == tables.end()) {
+        lastError = "Unknown dictionary " + std::to_string(dictionaryId);
+        return false;
+    }
+    if (message.size() > UINT32_MAX) {
+        lastError = "Message exceeds " + std::to_string(UINT32_MAX) + " bytes";
+        return false;
+    }
+    const CodeTable& table = found->second;
+
+    // 1. Write the header, then size the payload for the longest code
+    output.resize(kMessageHeaderSize + (uint64_t(message.size()) * table.maxLength + 7) / 8 + 4);
+    storeLittleEndian32(dictionaryId, output.data());
+    storeLittleEndian32(static_cast<uint32_t>(message.size()), output.data() + 4);
+
+    // 2. Pack the codes straight from the dictionary's table
+    BitWriter bitWriter(output.data() + kMessageHeaderSize);
+    for (const uint8_t byte : message) {
+        const HuffmanCode& code = table.codes[byte];
+        if (code.length == 0) {
+            output.clear();
+            lastError = "Byte value " + std::to_string(byte) + " has no code in dictionary " + std::to_string(dictionaryId);
+            return false;
+        }
+        bitWriter.write(code.bits, code.length);
+    }
+    output.resize(static_cast<size_t>(bitWriter.finish() - output.data()));
+    return true;
+}
+
+bool huffmanEncodeFile(const std::string& sourcePath, const std::string& destinationPath, const CompressionOptions& options) {
+    HuffmanEncoder encoder(options);
+    if (!encoder.encodeFile(sourcePath, destinationPath)) {
+        std::cerr << "Error: " << encoder.error() << std::endl;
+        return false;
+    }
+    std::cout << "Compression complete. Output saved to: " << destinationPath << std::endl;
+    if (options.maxCodeLength != 0) {
+        const uint64_t costBytes = (encoder.lengthLimitCostBits() + 7) / 8;
+        std::cout << "Code length limit of " << options.maxCodeLength << " bits added " << costBytes << " bytes ("
+                  << 100.0 * static_cast<double>(costBytes) / static_cast<double>(encoder.encodedSize()) << "% of the output)" << std::endl;
+    }
+    if (options.collectStats) {
+        printStats(encoder.stats(), std::cout);
+    }
+    return true;
+}
@@ -0,0 +1,18 @@
+#include <string>
+
+#include "huffman_encoder.h"
+
+int main(int argc, char** argv) {
+    // === IMPORTANT: Change this line to the path of your input file ===
+    const std::string sourceFile = "input.txt"; 
+    
+    const std::string compressedFile = "compressed_output.huff";
+
+    // --stats reports bytes, block modes, code lengths and the time spent in each phase
+    CompressionOptions options;
+    for (int i = 1; i < argc; ++i) {
+        options.collectStats = options.collectStats || std::string(argv[i]) == "--stats";
+    }
+    
+    return huffmanEncodeFile(sourceFile, compressedFile, options) ? 0 : 1;
+}
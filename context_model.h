@@ -0,0 +1,242 @@
+#ifndef CONTEXT_MODEL_H
+#define CONTEXT_MODEL_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "code_lengths.h"
+#include "histogram.h"
+#include "huffman_format.h"
+#include "table_header.h"
+
+// Order-1 modeling for context Huffman blocks. The byte before each byte is its context; the
+// contexts are clustered by how alike their symbol statistics are, and each cluster shares one
+// code table, so the tables stay few and cheap to store while each fits its contexts closely.
+
+// Reassignment rounds of the clustering; it usually settles within a few.
+constexpr unsigned kContextClusterRounds = 6;
+
+// The code tables of a context Huffman block and the table each context uses
+struct ContextModel {
+    unsigned tableCount = 0;
+    std::array<uint8_t, 256> contextTables{}; // Table of every previous byte
+    std::array<CodeLengths, kMaxContextTables> codeLengths{};
+};
+
+/**
+ * @brief Counts every (previous byte, byte) pair of a block, each interleaved segment starting
+ * in context 0 as the decoder does.
+ * @param data The bytes of the block.
+ * @param size The number of bytes.
+ * @param counts Receives 256 rows of 256 counts, one row per context; its storage is reused.
+ */
+inline void countContexts(const uint8_t* data, size_t size, std::vector<uint32_t>& counts) {
+    counts.assign(256 * 256, 0);
+    const size_t segmentSize = interleavedSegmentSize(size);
+    for (unsigned stream = 0; stream < kInterleavedStreamCount; ++stream) {
+        const size_t segmentStart = std::min(size, stream * segmentSize);
+        const size_t segmentEnd = stream + 1 == kInterleavedStreamCount ? size : std::min(size, segmentStart + segmentSize);
+        unsigned context = 0;
+        for (size_t i = segmentStart; i < segmentEnd; ++i) {
+            ++counts[context * 256 + data[i]];
+            context = data[i];
+        }
+    }
+}
+
+/**
+ * @brief Clusters the contexts of a block into at most `maxTables` code tables. Starting from
+ * the heaviest contexts as seeds, each round moves every context to the table that would code it
+ * in the fewest bits, estimated from the tables' current statistics, until no context moves.
+ * @param data The bytes of the block.
+ * @param size The number of bytes.
+ * @param maxTables The most tables to use, 2..kMaxContextTables.
+ * @param maxCodeLength The longest code allowed; 0 means kMaxContextCodeLength.
+ * @param model Receives the tables and the context map.
+ * @return The payload bits of the block coded with the model, or 0 if fewer than two contexts occur.
+ */
+inline uint64_t buildContextModel(const uint8_t* data, size_t size, unsigned maxTables, unsigned maxCodeLength, ContextModel& model) {
+    // 1. Gather the statistics of every context, heaviest context first
+    thread_local std::vector<uint32_t> counts;
+    countContexts(data, size, counts);
+    std::array<uint64_t, 256> contextTotals{};
+    std::array<uint8_t, 256> contextStorage;
+    size_t contextCount = 0;
+    for (unsigned context = 0; context < 256; ++context) {
+        for (unsigned symbol = 0; symbol < 256; ++symbol) {
+            contextTotals[context] += counts[context * 256 + symbol];
+        }
+        if (contextTotals[context] != 0) {
+            contextStorage[contextCount++] = static_cast<uint8_t>(context);
+        }
+    }
+    const std::span<uint8_t> contexts(contextStorage.data(), contextCount);
+    const unsigned tableCount = std::min<unsigned>(maxTables, static_cast<unsigned>(contexts.size()));
+    if (tableCount < 2) {
+        return 0;
+    }
+    // Equal totals keep context order, as a stable sort would, without its temporary buffer
+    std::sort(contexts.begin(), contexts.end(), [&](uint8_t a, uint8_t b) {
+        return contextTotals[a] != contextTotals[b] ? contextTotals[a] > contextTotals[b] : a < b;
+    });
+
+    // The symbols of every context as (symbol, count), so the rounds skip the empty cells
+    struct Cell {
+        uint8_t symbol;
+        uint32_t count;
+    };
+    thread_local std::vector<Cell> cells;
+    cells.clear();
+    std::array<size_t, 256> cellStart{};
+    std::array<size_t, 256> cellEnd{};
+    for (const uint8_t context : contexts) {
+        cellStart[context] = cells.size();
+        for (unsigned symbol = 0; symbol < 256; ++symbol) {
+            if (const uint32_t count = counts[context * 256 + symbol]) {
+                cells.push_back({static_cast<uint8_t>(symbol), count});
+            }
+        }
+        cellEnd[context] = cells.size();
+    }
+
+    // 2. Seed each table with one of the heaviest contexts, then move contexts between tables
+    std::array<uint8_t, 256> assignment{};
+    for (size_t i = 0; i < contexts.size(); ++i) {
+        assignment[contexts[i]] = static_cast<uint8_t>(i < tableCount ? i : 0);
+    }
+    std::array<ByteHistogram, kMaxContextTables> histograms;
+    const auto gatherHistograms = [&](bool seedsOnly) {
+        for (unsigned table = 0; table < tableCount; ++table) {
+            histograms[table].fill(0);
+        }
+        for (size_t i = 0; i < (seedsOnly ? tableCount : contexts.size()); ++i) {
+            const uint8_t context = contexts[i];
+            for (size_t cell = cellStart[context]; cell < cellEnd[context]; ++cell) {
+                histograms[assignment[context]][cells[cell].symbol] += cells[cell].count;
+            }
+        }
+    };
+    gatherHistograms(true);
+    std::array<std::array<float, 256>, kMaxContextTables> costs; // Estimated bits per symbol in each table
+    for (unsigned round = 0; round < kContextClusterRounds; ++round) {
+        for (unsigned table = 0; table < tableCount; ++table) {
+            uint64_t total = 0;
+            for (const uint64_t count : histograms[table]) {
+                total += count;
+            }
+            // Half a count for every symbol keeps the cost of a symbol the table lacks finite
+            const float totalBits = std::log2(static_cast<float>(total) + 128.0f);
+            for (unsigned symbol = 0; symbol < 256; ++symbol) {
+                costs[table][symbol] = totalBits - std::log2(static_cast<float>(histograms[table][symbol]) + 0.5f);
+            }
+        }
+        bool moved = false;
+        for (const uint8_t context : contexts) {
+            unsigned bestTable = assignment[context];
+            float bestCost = INFINITY;
+            for (unsigned table = 0; table < tableCount; ++table) {
+                float cost = 0;
+                for (size_t cell = cellStart[context]; cell < cellEnd[context]; ++cell) {
+                    cost += static_cast<float>(cells[cell].count) * costs[table][cells[cell].symbol];
+                }
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestTable = table;
+                }
+            }
+            moved = moved || bestTable != assignment[context];
+            assignment[context] = static_cast<uint8_t>(bestTable);
+        }
+        gatherHistograms(false);
+        if (!moved && round > 0) {
+            break;
+        }
+    }
+
+    // 3. Drop the tables left empty, then compute the code lengths of the rest
+    const unsigned lengthLimit = maxCodeLength != 0 ? std::min(maxCodeLength, kMaxContextCodeLength) : kMaxContextCodeLength;
+    std::array<uint8_t, kMaxContextTables> renumbered{};
+    uint64_t payloadBits = 0;
+    model.tableCount = 0;
+    for (unsigned table = 0; table < tableCount; ++table) {
+        const ByteHistogram& histogram = histograms[table];
+        if (std::all_of(histogram.begin(), histogram.end(), [](uint64_t count) { return count == 0; })) {
+            continue;
+        }
+        CodeLengths& lengths = model.codeLengths[model.tableCount];
+        computeCodeLengths(histogram, lengths);
+        if (*std::max_element(lengths.begin(), lengths.end()) > lengthLimit) {
+            computeLimitedCodeLengths(histogram, lengthLimit, lengths);
+        }
+        payloadBits += encodedBitCount(histogram, lengths);
+        renumbered[table] = static_cast<uint8_t>(model.tableCount++);
+    }
+    model.contextTables.fill(0); // Contexts that never occur use the first table
+    for (const uint8_t context : contexts) {
+        model.contextTables[context] = renumbered[assignment[context]];
+    }
+    return payloadBits;
+}
+
+/**
+ * @brief Appends the table count, the context map and the table headers of a context model.
+ * Every table after the first is coded against the one before it.
+ * @param model The model.
+ * @param output The buffer receiving the header.
+ */
+inline void writeContextModel(const ContextModel& model, std::vector<uint8_t>& output) {
+    output.push_back(static_cast<uint8_t>(model.tableCount));
+    for (unsigned context = 0; context < 256; context += 2) {
+        output.push_back(static_cast<uint8_t>(model.contextTables[context] << 4 | model.contextTables[context + 1]));
+    }
+    TableContext tables;
+    for (unsigned table = 0; table < model.tableCount; ++table) {
+        writeTableHeader(model.codeLengths[table], tables, output);
+        tables.remember(model.codeLengths[table]);
+    }
+}
+
+/**
+ * @brief Parses a context model written by writeContextModel.
+ * @param cursor The read position, followed by kDecodePadding readable bytes past `end`; advanced
+ *        past the model on success.
+ * @param end The end of the readable data.
+ * @param model Receives the tables and the context map.
+ * @return False if the model is truncated, refers to a missing table, or has an invalid table or
+ *         one with codes longer than kMaxContextCodeLength.
+ */
+inline bool readContextModel(const uint8_t*& cursor, const uint8_t* end, ContextModel& model) {
+    if (end - cursor < static_cast<std::ptrdiff_t>(1 + kContextMapSize)) {
+        return false;
+    }
+    model.tableCount = cursor[0];
+    if (model.tableCount == 0 || model.tableCount > kMaxContextTables) {
+        return false;
+    }
+    for (unsigned context = 0; context < 256; context += 2) {
+        model.contextTables[context] = cursor[1 + context / 2] >> 4;
+        model.contextTables[context + 1] = cursor[1 + context / 2] & 0x0F;
+    }
+    if (*std::max_element(model.contextTables.begin(), model.contextTables.end()) >= model.tableCount) {
+        return false;
+    }
+    const uint8_t* p = cursor + 1 + kContextMapSize;
+    TableContext tables;
+    for (unsigned table = 0; table < model.tableCount; ++table) {
+        CodeLengths& lengths = model.codeLengths[table];
+        if (!readTableHeader(p, end, tables, lengths) ||
+            *std::max_element(lengths.begin(), lengths.end()) > kMaxContextCodeLength) {
+            return false;
+        }
+        tables.remember(lengths);
+    }
+    cursor = p;
+    return true;
+}
+
+#endif // CONTEXT_MODEL_H
@@ -0,0 +1,82 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+// CRC-32C (Castagnoli), the checksum of SSE4.2's and ARMv8's crc32c instructions, in its
+// reflected form with the register preset to all ones and inverted at the end.
+constexpr uint32_t kCrc32cPolynomial = 0x82F63B78;
+
+// Slicing-by-8 tables: table k gives the CRC of a byte followed by k zero bytes.
+constexpr std::array<std::array<uint32_t, 256>, 8> makeCrc32cTables() {
+    std::array<std::array<uint32_t, 256>, 8> tables{};
+    for (uint32_t byte = 0; byte < 256; ++byte) {
+        uint32_t crc = byte;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (crc & 1 ? kCrc32cPolynomial : 0);
+        }
+        tables[0][byte] = crc;
+    }
+    for (size_t k = 1; k < 8; ++k) {
+        for (uint32_t byte = 0; byte < 256; ++byte) {
+            tables[k][byte] = (tables[k - 1][byte] >> 8) ^ tables[0][tables[k - 1][byte] & 0xFF];
+        }
+    }
+    return tables;
+}
+
+inline constexpr std::array<std::array<uint32_t, 256>, 8> kCrc32cTables = makeCrc32cTables();
+
+/**
+ * @brief Computes the CRC-32C of a buffer with table lookups, eight bytes per step.
+ * @param data The bytes.
+ * @param size The number of bytes.
+ * @return The checksum.
+ */
+inline uint32_t crc32cSoftware(const uint8_t* data, size_t size) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (; size >= 8; data += 8, size -= 8) {
+        const uint32_t low = crc ^ (uint32_t(data[0]) | uint32_t(data[1]) << 8 | uint32_t(data[2]) << 16 | uint32_t(data[3]) << 24);
+        crc = kCrc32cTables[7][low & 0xFF] ^ kCrc32cTables[6][(low >> 8) & 0xFF] ^ kCrc32cTables[5][(low >> 16) & 0xFF] ^
+              kCrc32cTables[4][low >> 24] ^ kCrc32cTables[3][data[4]] ^ kCrc32cTables[2][data[5]] ^
+              kCrc32cTables[1][data[6]] ^ kCrc32cTables[0][data[7]];
+    }
+    for (; size > 0; ++data, --size) {
+        crc = (crc >> 8) ^ kCrc32cTables[0][(crc ^ *data) & 0xFF];
+    }
+    return ~crc;
+}
+
+/**
+ * @brief Computes the CRC-32C of a buffer with the fastest method built in: the crc32c
+ * instructions on ARMv8 builds that have them, otherwise table lookups. x86-64 picks its
+ * SSE4.2 variant at startup instead (see kernels.h).
+ * @param data The bytes.
+ * @param size The number of bytes.
+ * @return The checksum.
+ */
+inline uint32_t crc32c(const uint8_t* data, size_t size) {
+#if defined(__ARM_FEATURE_CRC32)
+    uint32_t crc = 0xFFFFFFFF;
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, 8);
+        crc = __crc32cd(crc, word);
+    }
+    for (; size > 0; ++data, --size) {
+        crc = __crc32cb(crc, *data);
+    }
+    return ~crc;
+#else
+    return crc32cSoftware(data, size);
+#endif
+}
+
+#endif // CRC32C_H
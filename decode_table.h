@@ -0,0 +1,463 @@
+#ifndef DECODE_TABLE_H
+#define DECODE_TABLE_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+#include "compiler.h"
+#include "huffman_format.h"
+
+// Number of bits peeked for the first-level table lookup; 2^11 entries keep the table in L1.
+constexpr unsigned kPrimaryTableBits = 11;
+
+// Widths of the single-level tables used when every code of a block fits in one lookup. Each
+// width has its own instantiation of the decode loops, with the peek width a constant and no
+// subtable descent.
+constexpr unsigned kFlatTableWidths[] = {8, 10, 11, 12};
+constexpr unsigned kMaxFlatTableBits = 12;
+
+// Accumulator width limit of BitReader::peek (a 64-bit load minus up to 7 bits of misalignment).
+constexpr unsigned kMaxPeekBits = 57;
+
+// One slot of a decode table. A slot either resolves one or two whole symbols from the peeked
+// bits, or links to a subtable that resolves codes longer than the current table width.
+struct DecodeEntry {
+    uint32_t value = 0;      // Symbols (first in the low byte, second in the next) or subtable offset
+    uint8_t length = 0;      // Bits consumed by all symbols in the slot, or by this table level
+    uint8_t firstLength = 0; // Bits consumed by the first symbol alone
+    uint8_t count = 0;       // 1 or 2 resolved symbols; 0 links to a subtable
+    uint8_t subtableBits = 0;
+};
+
+// A decode table: either a single level that resolves every code, or a kPrimaryTableBits-wide
+// primary level followed by subtables for the longer codes.
+struct DecodeTable {
+    std::vector<DecodeEntry> entries;          // Primary level first, then any subtables
+    unsigned primaryBits = kPrimaryTableBits;  // Width of the primary level
+    bool flat = false;                         // Every code fits in the primary level; no subtables
+};
+
+// Blocks smaller than this decode through tables narrower than kPrimaryTableBits when their codes
+// allow: such a table is cheaper to build, but resolves two symbols per lookup less often, which
+// only pays while the build is a noticeable part of the block's decoding time.
+constexpr size_t kNarrowTableBlockSize = size_t(8) << kPrimaryTableBits;
+
+/**
+ * @brief Picks the width of a single-level table.
+ * @param maxLength The longest code length.
+ * @param minBits The narrowest width wanted.
+ * @return The narrowest width of at least minBits that holds every code, or 0 if the codes need subtables.
+ */
+constexpr unsigned flatTableBits(unsigned maxLength, unsigned minBits) {
+    for (const unsigned width : kFlatTableWidths) {
+        if (maxLength <= width && minBits <= width) {
+            return width;
+        }
+    }
+    return 0;
+}
+
+// Number of instantiations of each decode loop: one per flat width, then the multi-level loop.
+constexpr size_t kDecodeLoopCount = std::size(kFlatTableWidths) + 1;
+
+/**
+ * @brief Picks the decode loop instantiated for a table.
+ * @param table The decode table.
+ * @return The index of the table's width in kFlatTableWidths, or kDecodeLoopCount - 1 for a multi-level table.
+ */
+inline size_t decodeLoopIndex(const DecodeTable& table) {
+    if (table.flat) {
+        for (size_t i = 0; i < std::size(kFlatTableWidths); ++i) {
+            if (kFlatTableWidths[i] == table.primaryBits) {
+                return i;
+            }
+        }
+    }
+    return kDecodeLoopCount - 1;
+}
+
+// Readable bytes kept after a block's encoded data, so peeks for its last code stay inside the buffer.
+constexpr size_t kDecodePadding = 16;
+
+// Reads MSB-first bits from a buffer that stays readable for kDecodePadding bytes past its end.
+class BitReader {
+public:
+    explicit BitReader(const uint8_t* source) : data(source) {}
+
+    // Returns the next `count` bits (1..kMaxPeekBits) without consuming them.
+    HUFFMAN_ALWAYS_INLINE uint64_t peek(unsigned count) const {
+        const uint8_t* p = data + (bitPosition >> 3);
+        // Spelled out load by load so the compiler merges it into one byte-swapped 8-byte load
+        // in every loop instantiation, whatever its unrolling decisions
+        const uint64_t word = uint64_t(p[0]) << 56 | uint64_t(p[1]) << 48 | uint64_t(p[2]) << 40 | uint64_t(p[3]) << 32 |
+                              uint64_t(p[4]) << 24 | uint64_t(p[5]) << 16 | uint64_t(p[6]) << 8 | uint64_t(p[7]);
+        return (word << (bitPosition & 7)) >> (64 - count);
+    }
+
+    HUFFMAN_ALWAYS_INLINE void consume(unsigned count) { bitPosition += count; }
+    HUFFMAN_ALWAYS_INLINE uint64_t position() const { return bitPosition; }
+
+private:
+    const uint8_t* data;
+    uint64_t bitPosition = 0;
+};
+
+/**
+ * @brief Fills one table level for all codes that share the `depth` bits already consumed.
+ * @param table The table storage; subtables are appended at its end.
+ * @param offset Index of the first entry of the level being filled.
+ * @param tableBits The width of this level in bits.
+ * @param depth The number of code bits consumed by the levels above.
+ * @param symbols The symbols whose codes pass through this level; reordered in place.
+ * @param symbolCount The number of symbols.
+ * @param codes The code of every symbol.
+ */
+inline void fillDecodeTable(std::vector<DecodeEntry>& table, size_t offset, unsigned tableBits, unsigned depth,
+                     uint8_t* symbols, size_t symbolCount, const HuffmanCodeTable& codes) {
+    // The slot of this level a code passes through: its next tableBits bits
+    const auto slotOf = [&](uint8_t symbol) {
+        const HuffmanCode& code = codes[symbol];
+        const unsigned remaining = code.length - depth;
+        const uint64_t tail = code.bits & ((uint64_t(1) << remaining) - 1);
+        return static_cast<size_t>(remaining <= tableBits ? tail << (tableBits - remaining) : tail >> (remaining - tableBits));
+    };
+    size_t longCount = 0; // Codes longer than this level move to the front of `symbols`
+    for (size_t i = 0; i < symbolCount; ++i) {
+        const uint8_t symbol = symbols[i];
+        const unsigned remaining = codes[symbol].length - depth;
+        if (remaining <= tableBits) {
+            // Every slot whose leading bits match the code resolves to this symbol
+            const size_t first = slotOf(symbol);
+            const size_t span = size_t(1) << (tableBits - remaining);
+            for (size_t slot = first; slot < first + span; ++slot) {
+                DecodeEntry& entry = table[offset + slot];
+                entry.value = symbol;
+                entry.length = static_cast<uint8_t>(remaining);
+                entry.firstLength = static_cast<uint8_t>(remaining);
+                entry.count = 1;
+            }
+        } else {
+            symbols[longCount++] = symbol;
+        }
+    }
+
+    // Codes longer than this level continue in a subtable sized for the longest of them; sorting
+    // them by slot groups each subtable's codes without any storage of its own
+    std::sort(symbols, symbols + longCount, [&](uint8_t a, uint8_t b) { return slotOf(a) < slotOf(b); });
+    for (size_t groupStart = 0; groupStart < longCount;) {
+        const size_t slot = slotOf(symbols[groupStart]);
+        size_t groupEnd = groupStart;
+        unsigned longest = 0;
+        for (; groupEnd < longCount && slotOf(symbols[groupEnd]) == slot; ++groupEnd) {
+            longest = std::max<unsigned>(longest, codes[symbols[groupEnd]].length);
+        }
+        const unsigned subtableBits = std::min(longest - depth - tableBits, kPrimaryTableBits);
+        const size_t subtableOffset = table.size();
+        table.resize(subtableOffset + (size_t(1) << subtableBits));
+
+        DecodeEntry& link = table[offset + slot];
+        link.value = static_cast<uint32_t>(subtableOffset);
+        link.length = static_cast<uint8_t>(tableBits);
+        link.subtableBits = static_cast<uint8_t>(subtableBits);
+        link.count = 0;
+        fillDecodeTable(table, subtableOffset, subtableBits, depth + tableBits, symbols + groupStart, groupEnd - groupStart, codes);
+        groupStart = groupEnd;
+    }
+}
+
+/**
+ * @brief Builds the decode table for a prefix code: a single level when every code fits in
+ * kMaxFlatTableBits, otherwise a multi-level table.
+ * In the primary table, a slot whose first symbol leaves room for a complete second code
+ * resolves both, so short codes decode two symbols per lookup.
+ * @param codes The code of every symbol; symbols with length 0 are unused.
+ * @param table Receives the decode table, primary level first; its storage is reused.
+ * @param minBits The narrowest single-level width to use (see kNarrowTableBlockSize).
+ */
+inline void buildDecodeTable(const HuffmanCodeTable& codes, DecodeTable& table, unsigned minBits = kPrimaryTableBits) {
+    std::array<uint8_t, 256> symbols;
+    size_t symbolCount = 0;
+    unsigned maxLength = 0;
+    for (unsigned symbol = 0; symbol < 256; ++symbol) {
+        if (codes[symbol].length > 0) {
+            symbols[symbolCount++] = static_cast<uint8_t>(symbol);
+            maxLength = std::max<unsigned>(maxLength, codes[symbol].length);
+        }
+    }
+    const unsigned flatBits = flatTableBits(maxLength, minBits);
+    table.flat = flatBits != 0;
+    table.primaryBits = table.flat ? flatBits : kPrimaryTableBits;
+    const unsigned primaryBits = table.primaryBits;
+    table.entries.assign(size_t(1) << primaryBits, DecodeEntry{});
+    fillDecodeTable(table.entries, 0, primaryBits, 0, symbols.data(), symbolCount, codes);
+
+    std::array<DecodeEntry, size_t(1) << std::max(kPrimaryTableBits, kMaxFlatTableBits)> single;
+    std::copy(table.entries.begin(), table.entries.begin() + (size_t(1) << primaryBits), single.begin());
+    const size_t mask = (size_t(1) << primaryBits) - 1;
+    for (size_t slot = 0; slot <= mask; ++slot) {
+        DecodeEntry& entry = table.entries[slot];
+        if (entry.count != 1 || entry.length >= primaryBits) {
+            continue;
+        }
+        const DecodeEntry& next = single[(slot << entry.length) & mask];
+        if (next.count == 1 && next.length <= primaryBits - entry.length) {
+            entry.value |= next.value << 8;
+            entry.length = static_cast<uint8_t>(entry.length + next.length);
+            entry.count = 2;
+        }
+    }
+}
+
+/**
+ * @brief Looks up the entry for the next code, descending into subtables for long codes.
+ * @tparam FlatBits The width of a single-level table, or 0 for a multi-level table.
+ * @param table The entries of the decode table.
+ * @param bitReader The reader positioned at the next code; consumes the bits of the levels passed.
+ * @return The entry resolving the code, or one with count 0 if the bits do not form a code.
+ */
+template <unsigned FlatBits>
+HUFFMAN_ALWAYS_INLINE const DecodeEntry* lookupEntry(const DecodeEntry* table, BitReader& bitReader) {
+    const DecodeEntry* entry = &table[bitReader.peek(FlatBits ? FlatBits : kPrimaryTableBits)];
+    if constexpr (FlatBits == 0) {
+        while (entry->count == 0 && entry->subtableBits != 0) { // Long code: descend into the subtable
+            bitReader.consume(entry->length);
+            entry = &table[entry->value + bitReader.peek(entry->subtableBits)];
+        }
+    }
+    return entry;
+}
+
+/**
+ * @brief Decodes symbols until `maxCount` are produced or the read position reaches `bitLimit`.
+ * @tparam FlatBits The width of a single-level table, or 0 for a multi-level table.
+ * @param table The entries of the decode table built for the payload's codes.
+ * @param bitReader The reader positioned at the next code.
+ * @param bitLimit No symbol is started at or beyond this bit position.
+ * @param output Receives the decoded bytes.
+ * @param maxCount The number of bytes to decode at most.
+ * @return The number of bytes decoded; fewer than maxCount with the reader short of bitLimit
+ *         means the bits do not form a valid code.
+ */
+template <unsigned FlatBits>
+HUFFMAN_ALWAYS_INLINE size_t decodeSymbolsWith(const DecodeEntry* table, BitReader& bitReader, uint64_t bitLimit, uint8_t* output,
+                                               size_t maxCount) {
+    size_t decodedCount = 0;
+    while (decodedCount < maxCount && bitReader.position() < bitLimit) {
+        const DecodeEntry* entry = lookupEntry<FlatBits>(table, bitReader);
+        if (entry->count == 0) { // Bits that no code starts with
+            break;
+        }
+        if (entry->count == 2 && maxCount - decodedCount >= 2) {
+            output[decodedCount] = static_cast<uint8_t>(entry->value & 0xFF);
+            output[decodedCount + 1] = static_cast<uint8_t>((entry->value >> 8) & 0xFF);
+            bitReader.consume(entry->length);
+            decodedCount += 2;
+        } else {
+            output[decodedCount] = static_cast<uint8_t>(entry->value & 0xFF);
+            bitReader.consume(entry->firstLength);
+            ++decodedCount;
+        }
+    }
+    return decodedCount;
+}
+
+/**
+ * @brief Decodes the next one or two symbols, storing two bytes whatever the count.
+ * @tparam FlatBits The width of a single-level table, or 0 for a multi-level table.
+ * @param table The entries of the decode table built for the payload's codes.
+ * @param bitReader The reader positioned at the next code.
+ * @param output Receives the symbols; must have room for two bytes.
+ * @return The number of symbols decoded, 0 if the bits do not form a valid code.
+ */
+template <unsigned FlatBits>
+HUFFMAN_ALWAYS_INLINE unsigned decodeStep(const DecodeEntry* table, BitReader& bitReader, uint8_t* output) {
+    const DecodeEntry* entry = lookupEntry<FlatBits>(table, bitReader);
+    output[0] = static_cast<uint8_t>(entry->value & 0xFF);
+    output[1] = static_cast<uint8_t>((entry->value >> 8) & 0xFF);
+    bitReader.consume(entry->length);
+    return entry->count;
+}
+
+/**
+ * @brief Decodes the streams of an interleaved block.
+ * The main loop advances all streams once per iteration: the four table lookups carry no
+ * dependency on each other, so they overlap in the pipeline. Each stream finishes on its own
+ * once it nears the end of its input or output.
+ * @tparam FlatBits The width of a single-level table, or 0 for a multi-level table.
+ * @param table The entries of the decode table built for the payload's codes.
+ * @param streams The first stream; the streams follow each other and are followed by kDecodePadding readable bytes.
+ * @param streamSizes The byte size of every stream.
+ * @param output Receives rawSize decoded bytes.
+ * @param rawSize The number of bytes the block decodes to.
+ * @return False if a stream does not decode to exactly its segment.
+ */
+template <unsigned FlatBits>
+HUFFMAN_ALWAYS_INLINE bool decodeInterleavedStreamsWith(const DecodeEntry* table, const uint8_t* streams,
+                                                        const std::array<size_t, kInterleavedStreamCount>& streamSizes,
+                                                        uint8_t* output, size_t rawSize) {
+    const size_t segmentSize = interleavedSegmentSize(rawSize);
+    std::array<BitReader, kInterleavedStreamCount> readers{BitReader(nullptr), BitReader(nullptr), BitReader(nullptr), BitReader(nullptr)};
+    std::array<uint64_t, kInterleavedStreamCount> bitLimits;
+    std::array<uint8_t*, kInterleavedStreamCount> cursors;
+    std::array<uint8_t*, kInterleavedStreamCount> ends;
+    for (unsigned stream = 0; stream < kInterleavedStreamCount; ++stream) {
+        readers[stream] = BitReader(streams);
+        bitLimits[stream] = uint64_t(streamSizes[stream]) * 8;
+        cursors[stream] = output + std::min(rawSize, stream * segmentSize);
+        ends[stream] = stream + 1 == kInterleavedStreamCount ? output + rawSize : output + std::min(rawSize, (stream + 1) * segmentSize);
+        streams += streamSizes[stream];
+    }
+
+    // 1. Lock-step loop while every stream has input left and room for two symbols
+    for (;;) {
+        bool ready = true;
+        for (unsigned stream = 0; stream < kInterleavedStreamCount; ++stream) {
+            ready &= ends[stream] - cursors[stream] >= 2 && readers[stream].position() < bitLimits[stream];
+        }
+        if (!ready) {
+            break;
+        }
+        bool valid = true;
+        for (unsigned stream = 0; stream < kInterleavedStreamCount; ++stream) {
+            const unsigned count = decodeStep<FlatBits>(table, readers[stream], cursors[stream]);
+            cursors[stream] += count;
+            valid &= count != 0;
+        }
+        if (!valid) {
+            break;
+        }
+    }
+
+    // 2. Finish every stream one at a time; invalid bits stop decodeSymbols short of its count
+    for (unsigned stream = 0; stream < kInterleavedStreamCount; ++stream) {
+        const size_t remaining = static_cast<size_t>(ends[stream] - cursors[stream]);
+        if (decodeSymbolsWith<FlatBits>(table, readers[stream], bitLimits[stream], cursors[stream], remaining) != remaining ||
+            readers[stream].position() > bitLimits[stream]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Prepares the decode table of one context cluster: a slot keeps its second symbol only
+ * if the first symbol's context uses this same table, so pairs never cross a table switch.
+ * @param table A single-level table built by buildDecodeTable.
+ * @param contextTables The table of every previous byte.
+ * @param tableIndex The index of `table` among the block's tables.
+ */
+inline void keepContextPairs(DecodeTable& table, const std::array<uint8_t, 256>& contextTables, unsigned tableIndex) {
+    for (DecodeEntry& entry : table.entries) {
+        if (entry.count == 2 && contextTables[entry.value & 0xFF] != tableIndex) {
+            entry.value &= 0xFF;
+            entry.length = entry.firstLength;
+            entry.count = 1;
+        }
+    }
+}
+
+/**
+ * @brief Decodes symbols of a context Huffman stream, each through the table of the byte before it.
+ * @tparam FlatBits The width of the single-level tables, which every context shares.
+ * @param contextTables The entries of the decode table of every previous byte.
+ * @param context The previous byte; updated to the last byte decoded.
+ * @param bitReader The reader positioned at the next code.
+ * @param bitLimit No symbol is started at or beyond this bit position.
+ * @param output Receives the decoded bytes.
+ * @param maxCount The number of bytes to decode at most.
+ * @return The number of bytes decoded; see decodeSymbolsWith.
+ */
+template <unsigned FlatBits>
+HUFFMAN_ALWAYS_INLINE size_t decodeContextSymbolsWith(const DecodeEntry* const* contextTables, unsigned& context,
+                                                      BitReader& bitReader, uint64_t bitLimit, uint8_t* output, size_t maxCount) {
+    static_assert(FlatBits != 0, "context tables are single-level");
+    size_t decodedCount = 0;
+    while (decodedCount < maxCount && bitReader.position() < bitLimit) {
+        const DecodeEntry& entry = contextTables[context][bitReader.peek(FlatBits)];
+        if (entry.count == 0) { // Bits that no code starts with
+            break;
+        }
+        if (entry.count == 2 && maxCount - decodedCount >= 2) {
+            output[decodedCount++] = static_cast<uint8_t>(entry.value & 0xFF);
+            context = (entry.value >> 8) & 0xFF;
+            bitReader.consume(entry.length);
+        } else {
+            context = entry.value & 0xFF;
+            bitReader.consume(entry.firstLength);
+        }
+        output[decodedCount++] = static_cast<uint8_t>(context);
+    }
+    return decodedCount;
+}
+
+/**
+ * @brief Decodes the streams of a context Huffman block, advancing all streams once per
+ * iteration like decodeInterleavedStreamsWith. Each symbol's lookup depends on the symbol before
+ * it in the same stream, so the streams' independent chains are what keeps the pipeline busy.
+ * @tparam FlatBits The width of the single-level tables, which every context shares.
+ * @param contextTables The entries of the decode table of every previous byte.
+ * @param streams The first stream; the streams follow each other and are followed by kDecodePadding readable bytes.
+ * @param streamSizes The byte size of every stream.
+ * @param output Receives rawSize decoded bytes.
+ * @param rawSize The number of bytes the block decodes to.
+ * @return False if a stream does not decode to exactly its segment.
+ */
+template <unsigned FlatBits>
+HUFFMAN_ALWAYS_INLINE bool decodeContextStreamsWith(const DecodeEntry* const* contextTables, const uint8_t* streams,
+                                                    const std::array<size_t, kInterleavedStreamCount>& streamSizes,
+                                                    uint8_t* output, size_t rawSize) {
+    const size_t segmentSize = interleavedSegmentSize(rawSize);
+    std::array<BitReader, kInterleavedStreamCount> readers{BitReader(nullptr), BitReader(nullptr), BitReader(nullptr), BitReader(nullptr)};
+    std::array<uint64_t, kInterleavedStreamCount> bitLimits;
+    std::array<uint8_t*, kInterleavedStreamCount> cursors;
+    std::array<uint8_t*, kInterleavedStreamCount> ends;
+    std::array<unsigned, kInterleavedStreamCount> contexts{}; // Every stream starts after a zero byte
+    for (unsigned stream = 0; stream < kInterleavedStreamCount; ++stream) {
+        readers[stream] = BitReader(streams);
+        bitLimits[stream] = uint64_t(streamSizes[stream]) * 8;
+        cursors[stream] = output + std::min(rawSize, stream * segmentSize);
+        ends[stream] = stream + 1 == kInterleavedStreamCount ? output + rawSize : output + std::min(rawSize, (stream + 1) * segmentSize);
+        streams += streamSizes[stream];
+    }
+
+    // 1. Lock-step loop while every stream has input left and room for two symbols
+    for (;;) {
+        bool ready = true;
+        for (unsigned stream = 0; stream < kInterleavedStreamCount; ++stream) {
+            ready &= ends[stream] - cursors[stream] >= 2 && readers[stream].position() < bitLimits[stream];
+        }
+        if (!ready) {
+            break;
+        }
+        bool valid = true;
+        for (unsigned stream = 0; stream < kInterleavedStreamCount; ++stream) {
+            const DecodeEntry& entry = contextTables[contexts[stream]][readers[stream].peek(FlatBits)];
+            cursors[stream][0] = static_cast<uint8_t>(entry.value & 0xFF);
+            cursors[stream][1] = static_cast<uint8_t>((entry.value >> 8) & 0xFF);
+            contexts[stream] = (entry.value >> (entry.count == 2 ? 8 : 0)) & 0xFF;
+            cursors[stream] += entry.count;
+            readers[stream].consume(entry.length);
+            valid &= entry.count != 0;
+        }
+        if (!valid) { // A stream needs another symbol, but its bits start no code
+            return false;
+        }
+    }
+
+    // 2. Finish every stream one at a time
+    for (unsigned stream = 0; stream < kInterleavedStreamCount; ++stream) {
+        const size_t remaining = static_cast<size_t>(ends[stream] - cursors[stream]);
+        if (decodeContextSymbolsWith<FlatBits>(contextTables, contexts[stream], readers[stream], bitLimits[stream], cursors[stream],
+                                               remaining) != remaining ||
+            readers[stream].position() > bitLimits[stream]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif // DECODE_TABLE_H
@@ -1,110 +1,1060 @@
 #include <iostream>
-#include <fstream>
 #include <string>
 #include <vector>
-#include <bitset>
+#include <array>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 
-// Represents a node in the Huffman tree (frequency is not needed for decompression)
-struct HuffmanNode {
-    char character;
-    HuffmanNode *left, *right;
+#include "context_model.h"
+#include "decode_table.h"
+#include "file_io.h"
+#include "huffman_decoder.h"
+#include "huffman_format.h"
+#include "huffman_stats.h"
+#include "kernels.h"
+#include "run_length.h"
+#include "table_header.h"
+#include "thread_pool.h"
 
-    HuffmanNode(char c = '\0') : character(c), left(nullptr), right(nullptr) {}
+namespace {
+
+// How a container's block checksums are handled
+enum class ChecksumPolicy {
+    None,   // The blocks carry no checksums
+    Ignore, // The blocks end with checksums, which are skipped
+    Verify  // The blocks end with checksums, which the decoded bytes must match
 };
 
 /**
- * @brief Rebuilds the Huffman tree by reading the serialized tree file.
- * @param treeFileStream The input file stream of the serialized tree.
- * @return A pointer to the root of the reconstructed Huffman tree.
+ * @brief Picks the checksum policy for a container.
+ * @param fileFlags The flags of the container's file header.
+ * @param verify Whether checksums present should be verified.
  */
-HuffmanNode* deserializeHuffmanTree(std::ifstream& treeFileStream) {
-    char nodeTypeFlag;
-    treeFileStream.get(nodeTypeFlag);
+ChecksumPolicy checksumPolicy(uint8_t fileFlags, bool verify) {
+    if ((fileFlags & kChecksumFlag) == 0) {
+        return ChecksumPolicy::None;
+    }
+    return verify ? ChecksumPolicy::Verify : ChecksumPolicy::Ignore;
+}
+
+// Outcome of decoding one block
+enum class BlockStatus {
+    Decoded,
+    Corrupt,         // Invalid mode or code table, or a truncated or undecodable payload
+    ChecksumMismatch // Decoded, but the bytes differ from those the block was coded from
+};
+
+/**
+ * @brief Reads the jump table of a block split into streams.
+ * @param cursor The start of the jump table.
+ * @param end The end of the block's streams.
+ * @param streamSizes Receives the byte size of every stream; the last takes what the others leave.
+ * @return False if the jump table is truncated or its streams overrun the block.
+ */
+bool readJumpTable(const uint8_t* cursor, const uint8_t* end, std::array<size_t, kInterleavedStreamCount>& streamSizes) {
+    if (end - cursor < static_cast<std::ptrdiff_t>(kJumpTableSize)) {
+        return false;
+    }
+    size_t remaining = static_cast<size_t>(end - cursor) - kJumpTableSize;
+    for (unsigned stream = 0; stream + 1 < kInterleavedStreamCount; ++stream) {
+        streamSizes[stream] = loadLittleEndian32(cursor + 4 * stream);
+        if (streamSizes[stream] > remaining) {
+            return false;
+        }
+        remaining -= streamSizes[stream];
+    }
+    streamSizes[kInterleavedStreamCount - 1] = remaining;
+    return true;
+}
+
+} // namespace
 
-    if (nodeTypeFlag == '1') { // This is a leaf node
-        char character;
-        treeFileStream.get(character);
-        return new HuffmanNode(character);
+// The code table of a block, parsed by readBlockTable
+struct BlockTable {
+    CodeLengths codeLengths{}; // Of a Huffman block
+    size_t payloadOffset = 1;  // Where the payload starts in the encoded bytes, after the mode byte and any table header
+};
+
+namespace {
+
+/**
+ * @brief Parses the table header of a block. Since a table header may refer to the table before
+ * it, the blocks of a table group go through here one by one in block order, on the reading
+ * thread; the payloads can then be decoded in any order.
+ * @param encodedBlock The block's encoded bytes, followed by kDecodePadding readable bytes.
+ * @param encodedSize The number of encoded bytes, including any checksum.
+ * @param checksums Whether the block ends with a checksum.
+ * @param blockNumber The position of the block in the container.
+ * @param tables The previous table of the block's group; updated for the blocks after it.
+ * @param table Receives the block's code lengths and the start of its payload.
+ * @return False if the block is too short or its table header is invalid.
+ */
+bool readBlockTable(const uint8_t* encodedBlock, size_t encodedSize, ChecksumPolicy checksums, uint64_t blockNumber,
+                    TableContext& tables, BlockTable& table) {
+    tables.startBlock(blockNumber);
+    const size_t checksumSize = checksums != ChecksumPolicy::None ? kBlockChecksumSize : 0;
+    if (encodedSize <= checksumSize) {
+        return false;
+    }
+    table.payloadOffset = 1;
+    const BlockMode mode = static_cast<BlockMode>(encodedBlock[0]);
+    if (mode != BlockMode::Huffman && mode != BlockMode::InterleavedHuffman) {
+        return true;
+    }
+    const uint8_t* cursor = encodedBlock + 1;
+    if (!readTableHeader(cursor, encodedBlock + encodedSize - checksumSize, tables, table.codeLengths)) {
+        return false;
     }
-    
-    // This is an internal node
-    auto* node = new HuffmanNode();
-    node->left = deserializeHuffmanTree(treeFileStream);
-    node->right = deserializeHuffmanTree(treeFileStream);
-    return node;
+    tables.remember(table.codeLengths);
+    table.payloadOffset = static_cast<size_t>(cursor - encodedBlock);
+    return true;
 }
 
 /**
- * @brief Decompresses a file using a Huffman tree.
- * @param sourcePath The path to the compressed input file.
- * @param destinationPath The path where the decompressed output file will be saved.
+ * @brief Decodes one block according to its mode: Huffman blocks build a decode table from their
+ * code lengths and decode their payload through it, stored and run-length blocks are copied or
+ * expanded. The checksum, if verified, is computed right after decoding while the bytes are still in cache.
+ * @param encodedBlock The block's encoded bytes, followed by kDecodePadding readable bytes.
+ * @param encodedSize The number of encoded bytes, including any checksum.
+ * @param rawSize The number of bytes the block decodes to.
+ * @param table The block's table, from readBlockTable.
+ * @param output Receives rawSize decoded bytes.
+ * @param checksums Whether the block ends with a checksum, and whether to verify it.
+ * @param stats Receives the block's counters and phase times; null when stats are off.
+ * @return Whether the block decoded, and if not, why.
  */
-void huffmanDecodeFile(const std::string& sourcePath, const std::string& destinationPath) {
-    std::ifstream inputFileStream(sourcePath, std::ios::binary);
-    if (!inputFileStream) {
-        std::cerr << "Error: Cannot open input file: " << sourcePath << std::endl;
-        return;
+BlockStatus decodeBlock(const uint8_t* encodedBlock, size_t encodedSize, size_t rawSize, const BlockTable& table, uint8_t* output,
+                        ChecksumPolicy checksums, DecompressionStats* stats = nullptr) {
+    uint32_t expectedChecksum = 0;
+    if (checksums != ChecksumPolicy::None) {
+        if (encodedSize < kBlockChecksumSize) {
+            return BlockStatus::Corrupt;
+        }
+        encodedSize -= kBlockChecksumSize;
+        expectedChecksum = loadLittleEndian32(encodedBlock + encodedSize);
+    }
+    if (encodedSize == 0) {
+        return BlockStatus::Corrupt;
+    }
+    if (kStatsEnabled && stats && encodedBlock[0] < kBlockModeCount) {
+        stats->bytesOut += rawSize;
+        ++stats->blockCount;
+        ++stats->blocksByMode[encodedBlock[0]];
     }
+    DecodePhaseTimer timer(stats ? &stats->phaseNanoseconds : nullptr);
+    const uint8_t* cursor = encodedBlock + table.payloadOffset;
+    const uint8_t* const end = encodedBlock + encodedSize;
+    bool decoded = false;
+    switch (static_cast<BlockMode>(encodedBlock[0])) {
+    case BlockMode::Stored:
+        if (encodedSize - 1 != rawSize) {
+            return BlockStatus::Corrupt;
+        }
+        std::memcpy(output, cursor, rawSize);
+        decoded = true;
+        break;
+
+    case BlockMode::RunLength:
+        decoded = readRuns(cursor, encodedSize - 1, output, rawSize);
+        break;
+
+    case BlockMode::Huffman:
+    case BlockMode::InterleavedHuffman: {
+        HuffmanCodeTable codes{};
+        assignCanonicalCodes(table.codeLengths, codes);
+        thread_local DecodeTable decodeTable; // Reused by every block this thread decodes
+        buildDecodeTable(codes, decodeTable, rawSize < kNarrowTableBlockSize ? kFlatTableWidths[0] : kPrimaryTableBits);
+        timer.lap(DecodePhase::TableBuild);
 
-    std::ifstream treeFileStream(sourcePath + ".tree", std::ios::binary);
-    if (!treeFileStream) {
-        std::cerr << "Error: Cannot open tree file: " << sourcePath + ".tree" << std::endl;
-        return;
+        if (static_cast<BlockMode>(encodedBlock[0]) == BlockMode::InterleavedHuffman) {
+            std::array<size_t, kInterleavedStreamCount> streamSizes;
+            if (!readJumpTable(cursor, end, streamSizes)) {
+                return BlockStatus::Corrupt;
+            }
+            decoded = activeKernels().decodeInterleavedStreams(decodeTable, cursor + kJumpTableSize, streamSizes, output, rawSize);
+            break;
+        }
+        const uint64_t payloadBits = static_cast<uint64_t>(end - cursor) * 8;
+        BitReader bitReader(cursor);
+        decoded = activeKernels().decodeSymbols(decodeTable, bitReader, payloadBits, output, rawSize) == rawSize &&
+                  bitReader.position() <= payloadBits;
+        break;
     }
-    
-    std::ofstream outputFileStream(destinationPath, std::ios::binary);
 
-    // --- Step 1: Rebuild the Huffman Tree from the .tree file ---
-    HuffmanNode* treeRoot = deserializeHuffmanTree(treeFileStream);
-    treeFileStream.close();
+    case BlockMode::ContextHuffman: {
+        // Every context table gets the width of the longest code, so one loop serves them all
+        thread_local ContextModel model;
+        if (!readContextModel(cursor, end, model)) {
+            return BlockStatus::Corrupt;
+        }
+        unsigned maxLength = 0;
+        for (unsigned tableIndex = 0; tableIndex < model.tableCount; ++tableIndex) {
+            maxLength = std::max<unsigned>(maxLength, *std::max_element(model.codeLengths[tableIndex].begin(), model.codeLengths[tableIndex].end()));
+        }
+        const unsigned tableBits = flatTableBits(maxLength, rawSize < kNarrowTableBlockSize ? kFlatTableWidths[0] : kPrimaryTableBits);
+        thread_local std::array<DecodeTable, kMaxContextTables> decodeTables;
+        for (unsigned tableIndex = 0; tableIndex < model.tableCount; ++tableIndex) {
+            HuffmanCodeTable codes{};
+            assignCanonicalCodes(model.codeLengths[tableIndex], codes);
+            buildDecodeTable(codes, decodeTables[tableIndex], tableBits);
+            keepContextPairs(decodeTables[tableIndex], model.contextTables, tableIndex);
+        }
+        std::array<const DecodeEntry*, 256> contextTables;
+        for (unsigned context = 0; context < 256; ++context) {
+            contextTables[context] = decodeTables[model.contextTables[context]].entries.data();
+        }
+        timer.lap(DecodePhase::TableBuild);
 
-    // --- Step 2: Read the encoded file and convert it to a bit string ---
-    // The first byte tells us how many padding bits were added to the end.
-    char paddingBitsChar;
-    inputFileStream.get(paddingBitsChar);
-    const int paddingBits = static_cast<int>(paddingBitsChar);
+        std::array<size_t, kInterleavedStreamCount> streamSizes;
+        if (!readJumpTable(cursor, end, streamSizes)) {
+            return BlockStatus::Corrupt;
+        }
+        decoded = activeKernels().decodeContextStreams(decodeTables[0], contextTables.data(), cursor + kJumpTableSize, streamSizes,
+                                                       output, rawSize);
+        break;
+    }
 
-    std::string encodedBitString;
-    char byte;
-    while (inputFileStream.get(byte)) {
-        encodedBitString += std::bitset<8>(static_cast<unsigned char>(byte)).to_string();
+    default:
+        return BlockStatus::Corrupt;
     }
-    inputFileStream.close();
+    timer.lap(DecodePhase::Decode);
+    if (!decoded) {
+        return BlockStatus::Corrupt;
+    }
+    if (checksums == ChecksumPolicy::Verify && activeKernels().crc32c(output, rawSize) != expectedChecksum) {
+        return BlockStatus::ChecksumMismatch;
+    }
+    timer.lap(DecodePhase::Verify);
+    return BlockStatus::Decoded;
+}
+
+} // namespace
+
+// An encoded block as handed out by readBlock: a view into the input mapping, or into the
+// caller's storage when the block had to be read or copied
+struct EncodedBlock {
+    const uint8_t* data = nullptr;
+    uint32_t encodedSize = 0;
+    uint32_t rawSize = 0; // 0 for the terminator block
+};
 
-    // Remove the padding bits from the end of the string, if any.
-    if (paddingBits > 0) {
-        encodedBitString.resize(encodedBitString.size() - paddingBits);
+// A block decoded on the thread pool, in one of the decoder's slots. The slots keep their buffers
+// from block to block and file to file, so once they have grown, pooled blocks allocate nothing.
+struct DecodedBlock {
+    std::vector<uint8_t> storage; // Encoded bytes of the block that could not be viewed in place
+    EncodedBlock block;
+    BlockTable table;
+    uint8_t* destination = nullptr; // Where the block goes in the mapped output, if mapped
+    ChecksumPolicy checksums = ChecksumPolicy::None;
+    bool collectStats = false;
+    std::vector<uint8_t> bytes;     // The decoded bytes; unused for a block decoded into the mapped output
+    BlockStatus status = BlockStatus::Corrupt;
+    DecompressionStats stats;       // Counters of this block when stats are collected
+    std::atomic<bool> done{false};
+
+    void run() {
+        stats = {};
+        if (!destination) {
+            bytes.resize(block.rawSize);
+        }
+        status = decodeBlock(block.data, block.encodedSize, block.rawSize, table, destination ? destination : bytes.data(),
+                             checksums, collectStats ? &stats : nullptr);
     }
-    
-    if (treeRoot == nullptr) { // Handle case of empty source file
-         std::cout << "Decompression complete (input was empty).\n";
-         outputFileStream.close();
-         return;
+};
+
+namespace {
+
+/**
+ * @brief Reads the next block header and the encoded bytes that follow it.
+ * @param inputFile The input positioned at a block header.
+ * @param blockSize The block size from the file header.
+ * @param block Receives the block, followed by kDecodePadding readable bytes.
+ * @param storage Backing memory for bytes that could not be viewed in place.
+ * @return False if the header is invalid or the input ends early.
+ */
+bool readBlock(InputFile& inputFile, uint32_t blockSize, EncodedBlock& block, std::vector<uint8_t>& storage) {
+    const uint8_t* blockHeader = nullptr;
+    if (inputFile.readView(kBlockHeaderSize, 0, blockHeader, storage) != kBlockHeaderSize ||
+        !readBlockHeader(blockHeader, blockSize, block.rawSize, block.encodedSize)) {
+        return false;
     }
+    return inputFile.readView(block.encodedSize, kDecodePadding, block.data, storage) == block.encodedSize;
+}
+
+/**
+ * @brief Reads and validates the file header at the start of the input.
+ * @param inputFile The input positioned at its start.
+ * @param blockSize Receives the block size.
+ * @param flags Receives the file header flags.
+ * @param storage Backing memory for bytes that could not be viewed in place.
+ * @return False if the header is truncated or invalid.
+ */
+bool readInputHeader(InputFile& inputFile, uint32_t& blockSize, uint8_t& flags, std::vector<uint8_t>& storage) {
+    const uint8_t* header = nullptr;
+    return inputFile.readView(kFileHeaderSize, 0, header, storage) == kFileHeaderSize &&
+           readFileHeader(header, header + kFileHeaderSize, blockSize, flags);
+}
 
-    // --- Step 3: Decode the bit string using the tree ---
-    HuffmanNode* currentNode = treeRoot;
-    for (const char& bit : encodedBitString) {
-        // Move left for '0' and right for '1'
-        currentNode = (bit == '0') ? currentNode->left : currentNode->right;
+// The error reported for a container whose blocks failed to decode
+const char* blockErrorMessage(bool checksumMismatch) {
+    return checksumMismatch ? "Block checksum mismatch: compressed data is corrupt" : "Compressed data is truncated or corrupt";
+}
+
+/**
+ * @brief Reads the block index footer of a seekable file and returns to the first block.
+ * @param inputFile The input file.
+ * @param blockSize The block size from the file header.
+ * @param index Receives the block index.
+ * @param storage Backing memory for bytes that could not be viewed in place.
+ * @return False if the file is not seekable or has no valid index.
+ */
+bool readBlockIndex(InputFile& inputFile, uint32_t blockSize, BlockIndex& index, std::vector<uint8_t>& storage) {
+    const uint64_t fileSize = inputFile.size();
+    const uint8_t* trailer = nullptr;
+    const uint8_t* entries = nullptr;
+    uint64_t indexOffset = 0;
+    uint64_t blockCount = 0;
+    const bool valid = inputFile.isSeekable() && fileSize >= kFileHeaderSize + kIndexTrailerSize &&
+                       inputFile.seek(fileSize - kIndexTrailerSize) &&
+                       inputFile.readView(kIndexTrailerSize, 0, trailer, storage) == kIndexTrailerSize &&
+                       readIndexTrailer(trailer, fileSize, indexOffset, blockCount, index.rawSize) &&
+                       inputFile.seek(indexOffset) &&
+                       inputFile.readView(static_cast<size_t>(blockCount * kIndexEntrySize), 0, entries, storage) == blockCount * kIndexEntrySize &&
+                       readBlockIndexEntries(entries, blockCount, indexOffset, blockSize, index);
+    if (!valid) {
+        index.blocks.clear();
+        index.rawSize = 0;
+    }
+    return inputFile.seek(kFileHeaderSize) && valid;
+}
+
+// The block whose decoded bytes contain `offset`; the last block for the end of the archive.
+size_t blockContaining(const BlockIndex& index, uint64_t offset) {
+    return static_cast<size_t>(std::upper_bound(index.blocks.begin(), index.blocks.end(), offset,
+                                                [](uint64_t value, const BlockIndexEntry& entry) { return value < entry.rawOffset; }) -
+                               index.blocks.begin()) - 1;
+}
+
+// Bytes a record lookup decodes at a time before checking whether its records are complete
+constexpr size_t kRecordChunkSize = 4096;
+
+/**
+ * @brief Decodes a Huffman block from the byte at `blockOffset` on, a chunk at a time, until
+ * `take` has what it needs or the block ends. The checksum covers the whole block, so it is not verified.
+ * @param block The encoded block.
+ * @param table The block's table, from readBlockTable.
+ * @param checksums Whether the block ends with a checksum.
+ * @param blockOffset The first byte to decode.
+ * @param bitOffset The offset of that byte's code in the stream of its segment.
+ * @param take Receives each chunk of decoded bytes; returns true once it needs no more.
+ * @param done Set when `take` returned true.
+ * @return False if the payload is truncated or the bits do not form valid codes.
+ */
+template <typename Take>
+bool decodeHuffmanFrom(const EncodedBlock& block, const BlockTable& table, ChecksumPolicy checksums, size_t blockOffset,
+                       uint64_t bitOffset, Take& take, bool& done) {
+    // 1. Locate the streams: the only one, or one per segment of an interleaved block
+    const size_t checksumSize = checksums != ChecksumPolicy::None ? kBlockChecksumSize : 0;
+    const uint8_t* streamStart = block.data + table.payloadOffset;
+    const uint8_t* const end = block.data + block.encodedSize - checksumSize;
+    std::array<size_t, kInterleavedStreamCount> streamSizes{};
+    std::array<size_t, kInterleavedStreamCount + 1> segmentStarts{};
+    unsigned streamCount = 1;
+    if (static_cast<BlockMode>(block.data[0]) == BlockMode::InterleavedHuffman) {
+        if (!readJumpTable(streamStart, end, streamSizes)) {
+            return false;
+        }
+        streamStart += kJumpTableSize;
+        streamCount = kInterleavedStreamCount;
+        for (unsigned stream = 0; stream < kInterleavedStreamCount; ++stream) {
+            segmentStarts[stream] = std::min<size_t>(block.rawSize, stream * interleavedSegmentSize(block.rawSize));
+        }
+    } else {
+        streamSizes[0] = static_cast<size_t>(end - streamStart);
+    }
+    segmentStarts[streamCount] = block.rawSize;
+    unsigned stream = 0;
+    while (stream + 1 < streamCount && blockOffset >= segmentStarts[stream + 1]) {
+        streamStart += streamSizes[stream++];
+    }
+
+    // 2. A lookup decodes few bytes, so it takes the narrow table, which builds fastest
+    HuffmanCodeTable codes{};
+    assignCanonicalCodes(table.codeLengths, codes);
+    thread_local DecodeTable decodeTable;
+    buildDecodeTable(codes, decodeTable, kFlatTableWidths[0]);
+
+    // 3. Decode each stream from the offset on, then the streams after it from their start
+    std::array<uint8_t, kRecordChunkSize> chunk;
+    for (; stream < streamCount; ++stream) {
+        const uint64_t streamBits = uint64_t(streamSizes[stream]) * 8;
+        if (bitOffset > streamBits) {
+            return false;
+        }
+        BitReader bitReader(streamStart + bitOffset / 8);
+        bitReader.consume(static_cast<unsigned>(bitOffset % 8));
+        const uint64_t bitLimit = streamBits - bitOffset / 8 * 8;
+        for (size_t position = blockOffset; position < segmentStarts[stream + 1];) {
+            const size_t wanted = std::min(chunk.size(), segmentStarts[stream + 1] - position);
+            if (activeKernels().decodeSymbols(decodeTable, bitReader, bitLimit, chunk.data(), wanted) != wanted ||
+                bitReader.position() > bitLimit) {
+                return false;
+            }
+            position += wanted;
+            if (take(chunk.data(), wanted)) {
+                done = true;
+                return true;
+            }
+        }
+        streamStart += streamSizes[stream];
+        blockOffset = segmentStarts[stream + 1];
+        bitOffset = 0;
+    }
+    return true;
+}
+
+} // namespace
+
+HuffmanDecoder::HuffmanDecoder(const DecompressionOptions& options)
+    : options(options), threadCount(options.threadCount ? options.threadCount : std::max(1u, std::thread::hardware_concurrency())) {}
+
+HuffmanDecoder::HuffmanDecoder(const DecompressionOptions& options, ThreadPool& sharedPool)
+    : options(options), threadCount(sharedPool.size()), sharedPool(&sharedPool) {}
+
+HuffmanDecoder::~HuffmanDecoder() = default;
+
+bool HuffmanDecoder::decode(std::span<const uint8_t> input, std::vector<uint8_t>& output) {
+    output.clear();
+    InputFile inputFile;
+    inputFile.openMemory(input.data(), input.size());
+    OutputFile outputFile;
+    outputFile.openBuffer(output);
+    if (!decodeBlocks(inputFile, outputFile)) {
+        output.clear();
+        return false;
+    }
+    return true;
+}
+
+bool HuffmanDecoder::decode(InputFile& inputFile, OutputFile& outputFile) {
+    return decodeBlocks(inputFile, outputFile);
+}
+
+bool HuffmanDecoder::decodeFile(const std::string& sourcePath, const std::string& destinationPath) {
+    InputFile inputFile;
+    if (!inputFile.open(sourcePath)) {
+        lastError = "Cannot open input file: " + sourcePath;
+        return false;
+    }
+    OutputFile outputFile;
+    if (!outputFile.open(destinationPath)) {
+        lastError = "Cannot create output file: " + destinationPath;
+        return false;
+    }
+    if (!decodeBlocks(inputFile, outputFile)) {
+        lastError += ": " + sourcePath;
+        return false;
+    }
+    if (!outputFile.close()) {
+        lastError = "Cannot write output file: " + destinationPath;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Decodes a whole container, decoding its blocks on the thread pool.
+ * When the block index gives the decoded size up front, the output is mapped and every block
+ * decodes straight into its place; otherwise decoded blocks are written back in order. Blocks
+ * are read sequentially with at most two per thread in flight. A lone block, or every block
+ * when the decoder has one thread, is decoded on the calling thread instead.
+ * @param inputFile The compressed input, positioned at its start.
+ * @param outputFile The destination of the decoded bytes.
+ * @return False if the header is invalid or the data is truncated or corrupt.
+ */
+bool HuffmanDecoder::decodeBlocks(InputFile& inputFile, OutputFile& outputFile) {
+    lastStats = {};
+    DecompressionStats* const stats = kStatsEnabled && options.collectStats ? &lastStats : nullptr;
+    DecodePhaseTimer ioTimer(stats ? &stats->phaseNanoseconds : nullptr);
+
+    // --- Step 1: Read and validate the file header ---
+    uint32_t blockSize = 0;
+    uint8_t fileFlags = 0;
+    if (!readInputHeader(inputFile, blockSize, fileFlags, blockStorage)) {
+        lastError = "Invalid compressed file header";
+        return false;
+    }
+    const ChecksumPolicy checksums = checksumPolicy(fileFlags, options.verifyChecksums);
+
+    // --- Step 2: Map the output when the index tells us its final size ---
+    const bool indexed = readBlockIndex(inputFile, blockSize, blockIndex, blockStorage);
+    ioTimer.lap(DecodePhase::Read);
+    uint8_t* mappedOutput = indexed ? outputFile.map(blockIndex.rawSize) : nullptr;
+    const bool decodeHere = threadCount == 1 || (indexed && blockIndex.blocks.size() <= 1);
+    if (options.asyncIo) {
+        inputFile.startReadAhead(readIo);
+        if (!mappedOutput) {
+            outputFile.startWriteBehind(writeIo);
+        }
+    }
+
+    // --- Step 3: Read blocks in order and decode them on the pool with table lookups ---
+    // --- Step 4: Collect results in order, waiting on the oldest once the window is full ---
+    const size_t maxBlocksInFlight = 2 * size_t(threadCount);
+    while (!decodeHere && blockSlots.size() < maxBlocksInFlight) {
+        blockSlots.push_back(std::make_unique<DecodedBlock>());
+    }
+    uint64_t blocksPosted = 0;
+    uint64_t blocksFinished = 0; // Blocks from here to blocksPosted are in flight
+    ThreadPool* pool = sharedPool ? sharedPool : threadPool.get();
+    uint64_t rawOffset = 0;
+    uint64_t bytesRead = kFileHeaderSize;
+    uint64_t blockNumber = 0;
+    TableContext tables; // The previous table of the group being read
+    bool corrupt = false;
+    bool checksumMismatch = false;
+    const auto finishOldestBlock = [&] {
+        const DecodedBlock& decoded = *blockSlots[blocksFinished++ % maxBlocksInFlight];
+        pool->wait(decoded.done);
+        if (stats) {
+            stats->add(decoded.stats);
+        }
+        checksumMismatch = checksumMismatch || decoded.status == BlockStatus::ChecksumMismatch;
+        corrupt = corrupt || decoded.status != BlockStatus::Decoded;
+        if (!corrupt && !mappedOutput) {
+            ioTimer.restart();
+            outputFile.write(decoded.bytes.data(), decoded.bytes.size());
+            ioTimer.lap(DecodePhase::Write);
+        }
+    };
+
+    for (;;) {
+        // The slot of the block being read is free: its previous block was finished before this read
+        DecodedBlock* const slot = decodeHere ? nullptr : blockSlots[blocksPosted % maxBlocksInFlight].get();
+        EncodedBlock block;
+        ioTimer.restart();
+        if (!readBlock(inputFile, blockSize, block, slot ? slot->storage : blockStorage)) {
+            corrupt = true;
+            break;
+        }
+        ioTimer.lap(DecodePhase::Read);
+        bytesRead += kBlockHeaderSize + block.encodedSize;
+        if (block.rawSize == 0) { // Terminator block
+            break;
+        }
+        uint8_t* destination = nullptr;
+        if (mappedOutput) {
+            if (rawOffset + block.rawSize > blockIndex.rawSize) {
+                corrupt = true;
+                break;
+            }
+            destination = mappedOutput + rawOffset;
+        }
+        rawOffset += block.rawSize;
+        BlockTable table;
+        if (!readBlockTable(block.data, block.encodedSize, checksums, blockNumber++, tables, table)) {
+            corrupt = true;
+            break;
+        }
 
-        // If a leaf node is reached, we have found a character
-        if (!currentNode->left && !currentNode->right) {
-            outputFileStream.put(currentNode->character);
-            currentNode = treeRoot; // Reset to the root for the next character
+        if (decodeHere) {
+            if (!destination) {
+                decodedBlock.resize(block.rawSize);
+            }
+            const BlockStatus status = decodeBlock(block.data, block.encodedSize, block.rawSize, table,
+                                                   destination ? destination : decodedBlock.data(), checksums, stats);
+            if (status != BlockStatus::Decoded) {
+                checksumMismatch = status == BlockStatus::ChecksumMismatch;
+                corrupt = true;
+                break;
+            }
+            if (!destination) {
+                ioTimer.restart();
+                outputFile.write(decodedBlock.data(), decodedBlock.size());
+                ioTimer.lap(DecodePhase::Write);
+            }
+            continue;
+        }
+        if (!pool) {
+            threadPool = std::make_unique<ThreadPool>(threadCount);
+            pool = threadPool.get();
+        }
+        slot->block = block;
+        slot->table = table;
+        slot->destination = destination;
+        slot->checksums = checksums;
+        slot->collectStats = stats != nullptr;
+        pool->post(*slot);
+        if (++blocksPosted - blocksFinished >= maxBlocksInFlight) {
+            finishOldestBlock();
         }
+        if (corrupt) { // Stop reading; the blocks in flight are still collected below
+            break;
+        }
+    }
+    while (blocksFinished < blocksPosted) {
+        finishOldestBlock();
+    }
+    inputFile.stopReadAhead();
+    outputFile.stopWriteBehind(); // A failed write is reported when the file is closed
+    if (stats) {
+        // A seekable input was read to the end of its footer; a stream only up to the terminator
+        stats->bytesIn = inputFile.isSeekable() ? inputFile.size() : bytesRead;
     }
-    outputFileStream.close();
 
+    if (corrupt || (mappedOutput && rawOffset != blockIndex.rawSize)) {
+        lastError = blockErrorMessage(checksumMismatch);
+        return false;
+    }
+    return true;
+}
+
+bool huffmanDecodeFile(const std::string& sourcePath, const std::string& destinationPath, const DecompressionOptions& options) {
+    HuffmanDecoder decoder(options);
+    if (!decoder.decodeFile(sourcePath, destinationPath)) {
+        std::cerr << "Error: " << decoder.error() << std::endl;
+        return false;
+    }
     std::cout << "Decompression complete. Output saved to: " << destinationPath << std::endl;
+    if (options.collectStats) {
+        printStats(decoder.stats(), std::cout);
+    }
+    return true;
+}
+
+bool HuffmanStreamDecoder::feed(std::span<const uint8_t> chunk, std::vector<uint8_t>& output) {
+    if (state == State::Failed) {
+        return false;
+    }
+    if (state == State::Complete) {
+        if (chunk.empty()) {
+            return true;
+        }
+        state = State::Failed;
+        lastError = "Unexpected data after the end of the compressed stream";
+        return false;
+    }
+    pending.insert(pending.end(), chunk.begin(), chunk.end());
+
+    // Handle every unit (header, block, footer) whose bytes are all buffered
+    while (state != State::Complete && pending.size() - pendingStart >= needed) {
+        const size_t unitEnd = pendingStart + needed;
+        const size_t bufferedSize = pending.size();
+        if (state == State::BlockData && bufferedSize < unitEnd + kDecodePadding) {
+            pending.resize(unitEnd + kDecodePadding);
+        }
+        const bool consumed = consume(pending.data() + pendingStart, output);
+        pending.resize(bufferedSize);
+        if (!consumed) {
+            state = State::Failed;
+            return false;
+        }
+        pendingStart = unitEnd;
+    }
+    if (state == State::Complete && pendingStart != pending.size()) {
+        state = State::Failed;
+        lastError = "Unexpected data after the end of the compressed stream";
+        return false;
+    }
+
+    // Keep only the incomplete tail
+    pending.erase(pending.begin(), pending.begin() + pendingStart);
+    pendingStart = 0;
+    return true;
+}
+
+bool HuffmanStreamDecoder::finish() {
+    const bool complete = state == State::Complete;
+    if (!complete && state != State::Failed) {
+        lastError = "Compressed stream is truncated";
+    }
+    state = State::FileHeader;
+    pending.clear();
+    pendingStart = 0;
+    needed = kFileHeaderSize;
+    bytesRead = 0;
+    blockIndex.blocks.clear();
+    blockIndex.rawSize = 0;
+    tables = {};
+    return complete;
 }
 
-int main() {
-    // These file names should correspond to the output of the compression program
-    const std::string compressedFile = "compressed_output.huff";
-    const std::string decompressedFile = "decompressed_original.txt";
+/**
+ * @brief Handles one complete unit of the container and selects the unit that follows it.
+ * @param data The `needed` bytes of the unit; a block's bytes are followed by kDecodePadding readable bytes.
+ * @param output The buffer decoded bytes are appended to.
+ * @return False if the unit is invalid.
+ */
+bool HuffmanStreamDecoder::consume(const uint8_t* data, std::vector<uint8_t>& output) {
+    const uint64_t unitOffset = bytesRead;
+    bytesRead += needed;
+    switch (state) {
+    case State::FileHeader:
+        if (!readFileHeader(data, data + kFileHeaderSize, blockSize, fileFlags)) {
+            lastError = "Invalid compressed file header";
+            return false;
+        }
+        state = State::BlockHeader;
+        needed = kBlockHeaderSize;
+        return true;
+
+    case State::BlockHeader: {
+        uint32_t encodedSize = 0;
+        if (!readBlockHeader(data, blockSize, rawSize, encodedSize)) {
+            lastError = "Compressed data is truncated or corrupt";
+            return false;
+        }
+        if (rawSize == 0) { // Terminator block
+            state = State::Footer;
+            needed = blockIndex.blocks.size() * kIndexEntrySize + kIndexTrailerSize;
+            return true;
+        }
+        blockIndex.blocks.push_back({unitOffset, blockIndex.rawSize});
+        state = State::BlockData;
+        needed = encodedSize;
+        return true;
+    }
+
+    case State::BlockData: {
+        const ChecksumPolicy checksums = checksumPolicy(fileFlags, true);
+        BlockTable table;
+        if (!readBlockTable(data, needed, checksums, blockIndex.blocks.size() - 1, tables, table)) {
+            lastError = blockErrorMessage(false);
+            return false;
+        }
+        const size_t outputStart = output.size();
+        output.resize(outputStart + rawSize);
+        const BlockStatus status = decodeBlock(data, needed, rawSize, table, output.data() + outputStart, checksums);
+        if (status != BlockStatus::Decoded) {
+            output.resize(outputStart);
+            lastError = blockErrorMessage(status == BlockStatus::ChecksumMismatch);
+            return false;
+        }
+        blockIndex.rawSize += rawSize;
+        state = State::BlockHeader;
+        needed = kBlockHeaderSize;
+        return true;
+    }
+
+    case State::Footer:
+        if (!verifyFooter(data)) {
+            lastError = "Block index does not match the compressed stream";
+            return false;
+        }
+        state = State::Complete;
+        needed = 0;
+        return true;
 
-    huffmanDecodeFile(compressedFile, decompressedFile);
+    default:
+        return false;
+    }
+}
+
+// Checks that the footer describes exactly the blocks that were decoded.
+bool HuffmanStreamDecoder::verifyFooter(const uint8_t* footer) {
+    const size_t entriesSize = blockIndex.blocks.size() * kIndexEntrySize;
+    uint64_t indexOffset = 0;
+    uint64_t blockCount = 0;
+    uint64_t decodedSize = 0;
+    if (!readIndexTrailer(footer + entriesSize, bytesRead, indexOffset, blockCount, decodedSize) ||
+        indexOffset != bytesRead - entriesSize - kIndexTrailerSize || decodedSize != blockIndex.rawSize) {
+        return false;
+    }
+    for (size_t i = 0; i < blockIndex.blocks.size(); ++i) {
+        if (loadLittleEndian64(footer + i * kIndexEntrySize) != blockIndex.blocks[i].encodedOffset ||
+            loadLittleEndian64(footer + i * kIndexEntrySize + 8) != blockIndex.blocks[i].rawOffset) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool HuffmanMessageDecoder::addDictionary(const HuffmanDictionary& dictionary) {
+    if (!isValidCodeLengths(dictionary.codeLengths)) {
+        lastError = "Invalid code lengths in dictionary " + std::to_string(dictionary.id);
+        return false;
+    }
+    HuffmanCodeTable codes{};
+    assignCanonicalCodes(dictionary.codeLengths, codes);
+    buildDecodeTable(codes, tables[dictionary.id]);
+    return true;
+}
+
+bool HuffmanMessageDecoder::decode(std::span<const uint8_t> message, std::vector<uint8_t>& output) {
+    output.clear();
+    if (message.size() < kMessageHeaderSize) {
+        lastError = "Message is truncated";
+        return false;
+    }
+    const uint32_t dictionaryId = loadLittleEndian32(message.data());
+    const uint32_t rawSize = loadLittleEndian32(message.data() + 4);
+    const auto found = tables.find(dictionaryId);
+    if (found == tables.end()) {
+        lastError = "Unknown dictionary " + std::to_string(dictionaryId);
+        return false;
+    }
 
-    return 0;
-}
\ No newline at end of file
+    // Every code takes at least one bit, which bounds the size before anything is allocated
+    const std::span<const uint8_t> codes = message.subspan(kMessageHeaderSize);
+    const uint64_t payloadBits = uint64_t(codes.size()) * 8;
+    if (rawSize > payloadBits) {
+        lastError = "Message is truncated or corrupt";
+        return false;
+    }
+    payload.assign(codes.begin(), codes.end());
+    payload.resize(codes.size() + kDecodePadding);
+    output.resize(rawSize);
+    BitReader bitReader(payload.data());
+    if (activeKernels().decodeSymbols(found->second, bitReader, payloadBits, output.data(), rawSize) != rawSize ||
+        bitReader.position() > payloadBits) {
+        output.clear();
+        lastError = "Message is truncated or corrupt";
+        return false;
+    }
+    return true;
+}
+
+bool HuffmanArchive::open(const std::string& sourcePath) {
+    if (!inputFile.open(sourcePath)) {
+        index = {};
+        lastError = "Cannot open input file: " + sourcePath;
+        return false;
+    }
+    if (!loadIndex()) {
+        lastError += ": " + sourcePath;
+        return false;
+    }
+    return true;
+}
+
+bool HuffmanArchive::open(std::span<const uint8_t> data) {
+    inputFile.openMemory(data.data(), data.size());
+    return loadIndex();
+}
+
+// Reads the header and block index of the just-opened input.
+bool HuffmanArchive::loadIndex() {
+    nextTableBlock = UINT64_MAX;
+    archiveChecksumKnown = false;
+    if (!readInputHeader(inputFile, blockSize, fileFlags, blockStorage)) {
+        index = {};
+        lastError = "Invalid compressed file header";
+        return false;
+    }
+    if (!readBlockIndex(inputFile, blockSize, index, blockStorage)) {
+        lastError = "Missing or invalid block index";
+        return false;
+    }
+    return true;
+}
+
+bool HuffmanArchive::decodeRange(uint64_t offset, uint64_t length, std::vector<uint8_t>& output) {
+    output.clear();
+    if (offset > index.rawSize || length > index.rawSize - offset) {
+        lastError = "Range exceeds the decoded size of " + std::to_string(index.rawSize) + " bytes";
+        return false;
+    }
+    output.reserve(static_cast<size_t>(length));
+    const ChecksumPolicy checksums = checksumPolicy(fileFlags, true);
+    for (size_t blockNumber = blockContaining(index, offset); output.size() < length; ++blockNumber) {
+        EncodedBlock block;
+        BlockTable table;
+        if (!readIndexedBlock(blockNumber, block, table)) {
+            return false;
+        }
+        decodedBlock.resize(block.rawSize);
+        const BlockStatus status = decodeBlock(block.data, block.encodedSize, block.rawSize, table, decodedBlock.data(), checksums);
+        if (status != BlockStatus::Decoded) {
+            lastError = blockErrorMessage(status == BlockStatus::ChecksumMismatch);
+            return false;
+        }
+        const uint64_t rawOffset = index.blocks[blockNumber].rawOffset;
+        const size_t sliceStart = static_cast<size_t>(std::max(offset, rawOffset) - rawOffset);
+        const size_t sliceSize = static_cast<size_t>(std::min<uint64_t>(block.rawSize - sliceStart, length - output.size()));
+        output.insert(output.end(), decodedBlock.begin() + sliceStart, decodedBlock.begin() + sliceStart + sliceSize);
+    }
+    return true;
+}
+
+bool HuffmanArchive::buildRecordIndex(uint8_t delimiter, uint32_t interval, RecordIndex& records) {
+    records = {};
+    if (interval == 0) {
+        lastError = "Record interval must be at least 1";
+        return false;
+    }
+    records.delimiter = delimiter;
+    records.interval = interval;
+    records.rawSize = index.rawSize;
+    records.archiveSize = inputFile.size();
+    if (!computeArchiveChecksum(records.archiveChecksum)) {
+        return false;
+    }
+    const ChecksumPolicy checksums = checksumPolicy(fileFlags, true);
+    bool recordStarts = true; // Whether the next byte starts a record
+    for (size_t blockNumber = 0; blockNumber < index.blocks.size(); ++blockNumber) {
+        // 1. Decode the block whole, verifying it
+        EncodedBlock block;
+        BlockTable table;
+        if (!readIndexedBlock(blockNumber, block, table)) {
+            return false;
+        }
+        decodedBlock.resize(block.rawSize);
+        const BlockStatus status = decodeBlock(block.data, block.encodedSize, block.rawSize, table, decodedBlock.data(), checksums);
+        if (status != BlockStatus::Decoded) {
+            lastError = blockErrorMessage(status == BlockStatus::ChecksumMismatch);
+            return false;
+        }
+
+        // 2. Find the records, summing code lengths for the bit offsets, which restart with every
+        //    stream: at each segment of an interleaved block
+        const BlockMode mode = static_cast<BlockMode>(block.data[0]);
+        const bool huffman = mode == BlockMode::Huffman || mode == BlockMode::InterleavedHuffman;
+        const size_t segmentSize = mode == BlockMode::InterleavedHuffman ? interleavedSegmentSize(block.rawSize) : block.rawSize;
+        const uint64_t rawOffset = index.blocks[blockNumber].rawOffset;
+        size_t segmentEnd = segmentSize;
+        unsigned segment = 0;
+        uint64_t bitOffset = 0;
+        for (size_t i = 0; i < block.rawSize; ++i) {
+            if (i == segmentEnd) {
+                ++segment;
+                segmentEnd = segment + 1 < kInterleavedStreamCount ? segmentEnd + segmentSize : block.rawSize;
+                bitOffset = 0;
+            }
+            if (recordStarts) {
+                if (records.recordCount % interval == 0) {
+                    records.checkpoints.push_back({rawOffset + i, huffman ? bitOffset : kNoBitOffset});
+                }
+                ++records.recordCount;
+            }
+            const uint8_t byte = decodedBlock[i];
+            bitOffset += table.codeLengths[byte];
+            recordStarts = byte == delimiter;
+        }
+    }
+    return true;
+}
+
+bool HuffmanArchive::readRecords(const RecordIndex& records, uint64_t first, uint64_t count, std::vector<uint8_t>& output) {
+    output.clear();
+    uint32_t checksum = 0;
+    if (!computeArchiveChecksum(checksum)) {
+        return false;
+    }
+    if (records.rawSize != index.rawSize || records.archiveSize != inputFile.size() || records.archiveChecksum != checksum ||
+        records.interval == 0 || records.checkpoints.size() != (records.recordCount + records.interval - 1) / records.interval) {
+        lastError = "Record index does not match the archive; rebuild it";
+        return false;
+    }
+    if (first > records.recordCount || count > records.recordCount - first) {
+        lastError = "Records exceed the archive's " + std::to_string(records.recordCount) + " records";
+        return false;
+    }
+    if (count == 0) {
+        return true;
+    }
+
+    // 1. Scan from the checkpoint before the first record: drop the records before it, then take
+    //    records until the last one's delimiter
+    const RecordCheckpoint& checkpoint = records.checkpoints[static_cast<size_t>(first / records.interval)];
+    uint64_t recordsToSkip = first % records.interval;
+    uint64_t recordsToTake = count;
+    const auto take = [&](const uint8_t* bytes, size_t size) {
+        const uint8_t* const end = bytes + size;
+        while (bytes != end && recordsToSkip != 0) {
+            const void* delimiter = std::memchr(bytes, records.delimiter, static_cast<size_t>(end - bytes));
+            bytes = delimiter ? static_cast<const uint8_t*>(delimiter) + 1 : end;
+            recordsToSkip -= delimiter ? 1 : 0;
+        }
+        while (bytes != end && recordsToTake != 0) {
+            const void* delimiter = std::memchr(bytes, records.delimiter, static_cast<size_t>(end - bytes));
+            const uint8_t* recordEnd = delimiter ? static_cast<const uint8_t*>(delimiter) + 1 : end;
+            output.insert(output.end(), bytes, recordEnd);
+            bytes = recordEnd;
+            recordsToTake -= delimiter ? 1 : 0;
+        }
+        return recordsToTake == 0;
+    };
+
+    // 2. Decode from the checkpoint on: mid-stream in Huffman blocks, which stop as soon as the
+    //    records are complete, and whole in the others. The blocks after the first start at bit 0.
+    const ChecksumPolicy checksums = checksumPolicy(fileFlags, true);
+    size_t blockNumber = blockContaining(index, checkpoint.rawOffset);
+    uint64_t blockOffset = checkpoint.rawOffset - index.blocks[blockNumber].rawOffset;
+    uint64_t bitOffset = checkpoint.bitOffset;
+    for (bool done = false; !done && blockNumber < index.blocks.size(); ++blockNumber, blockOffset = 0, bitOffset = 0) {
+        EncodedBlock block;
+        BlockTable table;
+        if (!readIndexedBlock(blockNumber, block, table)) {
+            return false;
+        }
+        const BlockMode mode = static_cast<BlockMode>(block.data[0]);
+        if ((mode == BlockMode::Huffman || mode == BlockMode::InterleavedHuffman) && bitOffset != kNoBitOffset) {
+            if (!decodeHuffmanFrom(block, table, checksums, static_cast<size_t>(blockOffset), bitOffset, take, done)) {
+                lastError = "Compressed data or record index is corrupt";
+                return false;
+            }
+            continue;
+        }
+        decodedBlock.resize(block.rawSize);
+        const BlockStatus status = decodeBlock(block.data, block.encodedSize, block.rawSize, table, decodedBlock.data(), checksums);
+        if (status != BlockStatus::Decoded) {
+            lastError = blockErrorMessage(status == BlockStatus::ChecksumMismatch);
+            return false;
+        }
+        done = take(decodedBlock.data() + blockOffset, static_cast<size_t>(block.rawSize - blockOffset));
+    }
+    return true;
+}
+
+// Computes the checksum that ties a record index to the archive: a CRC-32C over the block index
+// footer and the last bytes of every block, kept until another archive is opened.
+bool HuffmanArchive::computeArchiveChecksum(uint32_t& checksum) {
+    if (!archiveChecksumKnown) {
+        const uint64_t footerSize = index.blocks.size() * kIndexEntrySize + kIndexTrailerSize;
+        const uint64_t indexOffset = inputFile.size() - footerSize;
+        const uint8_t* bytes = nullptr;
+        if (!inputFile.seek(indexOffset) ||
+            inputFile.readView(static_cast<size_t>(footerSize), 0, bytes, blockStorage) != footerSize) {
+            lastError = "Missing or invalid block index";
+            return false;
+        }
+        std::vector<uint8_t> identity(bytes, bytes + footerSize);
+        for (size_t blockNumber = 0; blockNumber < index.blocks.size(); ++blockNumber) {
+            const uint64_t blockEnd = blockNumber + 1 < index.blocks.size() ? index.blocks[blockNumber + 1].encodedOffset
+                                                                            : indexOffset - kBlockHeaderSize;
+            if (!inputFile.seek(blockEnd - kBlockChecksumSize) ||
+                inputFile.readView(kBlockChecksumSize, 0, bytes, blockStorage) != kBlockChecksumSize) {
+                lastError = "Compressed data is truncated or corrupt";
+                return false;
+            }
+            identity.insert(identity.end(), bytes, bytes + kBlockChecksumSize);
+        }
+        archiveChecksum = activeKernels().crc32c(identity.data(), identity.size());
+        archiveChecksumKnown = true;
+    }
+    checksum = archiveChecksum;
+    return true;
+}
+
+// Reads a block through the block index, along with its table. Tables may refer back to the start
+// of their group, so unless the block follows the last one read, the tables of the group's earlier
+// blocks are read first.
+bool HuffmanArchive::readIndexedBlock(uint64_t blockNumber, EncodedBlock& block, BlockTable& table) {
+    const ChecksumPolicy checksums = checksumPolicy(fileFlags, true);
+    const uint64_t firstBlock = blockNumber == nextTableBlock ? blockNumber : blockNumber - blockNumber % kTableAnchorInterval;
+    nextTableBlock = UINT64_MAX;
+    for (uint64_t number = firstBlock; number <= blockNumber; ++number) {
+        const BlockIndexEntry& entry = index.blocks[static_cast<size_t>(number)];
+        const uint64_t blockEnd = number + 1 < index.blocks.size() ? index.blocks[static_cast<size_t>(number + 1)].rawOffset : index.rawSize;
+        if (!inputFile.seek(entry.encodedOffset) || !readBlock(inputFile, blockSize, block, blockStorage) ||
+            block.rawSize != blockEnd - entry.rawOffset ||
+            !readBlockTable(block.data, block.encodedSize, checksums, number, tables, table)) {
+            lastError = "Compressed data is truncated or corrupt";
+            return false;
+        }
+    }
+    nextTableBlock = blockNumber + 1;
+    return true;
+}
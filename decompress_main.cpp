@@ -0,0 +1,17 @@
+#include <string>
+
+#include "huffman_decoder.h"
+
+int main(int argc, char** argv) {
+    // These file names should correspond to the output of the compression program
+    const std::string compressedFile = "compressed_output.huff";
+    const std::string decompressedFile = "decompressed_original.txt";
+
+    // --stats reports bytes, block modes and the time spent in each phase
+    DecompressionOptions options;
+    for (int i = 1; i < argc; ++i) {
+        options.collectStats = options.collectStats || std::string(argv[i]) == "--stats";
+    }
+
+    return huffmanDecodeFile(compressedFile, decompressedFile, options) ? 0 : 1;
+}
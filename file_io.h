@@ -0,0 +1,652 @@
+#ifndef FILE_IO_H
+#define FILE_IO_H
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "async_io.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HUFFMAN_HAVE_MMAP 1
+#else
+#define HUFFMAN_HAVE_MMAP 0
+#endif
+
+// Bytes read ahead of the caller from an unmapped input
+constexpr size_t kReadAheadSize = size_t(1) << 20;
+
+// Write-behind buffers of an output, and the size of each
+constexpr unsigned kWriteBehindBuffers = 4;
+constexpr size_t kWriteBehindBufferSize = size_t(1) << 20;
+
+// Read access to a file. Regular files are memory-mapped, so blocks can be handed out as views
+// into the mapping; pipes and other unmappable inputs fall back to buffered reads. A caller-owned
+// memory buffer can stand in for a mapped file.
+class InputFile {
+public:
+    InputFile() = default;
+    InputFile(const InputFile&) = delete;
+    InputFile& operator=(const InputFile&) = delete;
+    ~InputFile() { close(); }
+
+    /**
+     * @brief Opens a file for reading, mapping it when possible.
+     * @param path The path to the file.
+     * @return False if the file cannot be opened.
+     */
+    bool open(const std::string& path) {
+        close();
+#if HUFFMAN_HAVE_MMAP
+        descriptor = ::open(path.c_str(), O_RDONLY);
+        return descriptor >= 0 && attach();
+#else
+        stream = std::fopen(path.c_str(), "rb");
+        return stream && attach();
+#endif
+    }
+
+    /**
+     * @brief Reads from standard input, which is mapped like a file when it is redirected from one.
+     * @return False if standard input cannot be opened.
+     */
+    bool openStandardInput() {
+        close();
+#if HUFFMAN_HAVE_MMAP
+        descriptor = ::dup(STDIN_FILENO); // A private descriptor, so close() leaves standard input open
+        return descriptor >= 0 && attach();
+#else
+        stream = stdin;
+        return attach();
+#endif
+    }
+
+    /**
+     * @brief Reads from a memory buffer as if it were a mapped file; the buffer must outlive the reads.
+     * @param data The first byte of the buffer.
+     * @param size The number of bytes in the buffer.
+     */
+    void openMemory(const uint8_t* data, size_t size) {
+        static constexpr uint8_t noBytes[1] = {};
+        close();
+        mapping = size > 0 ? data : noBytes; // Never null, so reads stay on the mapped path
+        ownsMapping = false;
+        fileSize = size;
+        seekable = true;
+    }
+
+    void close() {
+        stopReadAhead();
+        aheadStart = aheadEnd = 0;
+#if HUFFMAN_HAVE_MMAP
+        if (mapping && ownsMapping) {
+            munmap(const_cast<uint8_t*>(mapping), static_cast<size_t>(fileSize));
+        }
+        if (descriptor >= 0) {
+            ::close(descriptor);
+        }
+        descriptor = -1;
+#else
+        if (stream && stream != stdin) {
+            std::fclose(stream);
+        }
+        stream = nullptr;
+#endif
+        mapping = nullptr;
+        ownsMapping = true;
+        fileSize = 0;
+        position = 0;
+        seekable = false;
+        exhausted = false;
+        readError = false;
+    }
+
+    bool isMapped() const { return mapping != nullptr; }
+
+    /**
+     * @brief Lets `io` fetch the input ahead of readView() until stopReadAhead(). An unmapped input
+     * keeps one read of up to kReadAheadSize bytes in flight, and a pipe's capacity is raised to
+     * as much when the system allows; a mapped file asks the kernel to page in the next view
+     * while the caller works on the current one.
+     * @param io The queue performing the reads, used by nothing else; must outlive the read-ahead.
+     */
+    void startReadAhead(AsyncIo& io) {
+#if HUFFMAN_HAVE_MMAP
+        stopReadAhead();
+        readAheadIo = &io;
+#ifdef F_SETPIPE_SZ
+        struct stat status;
+        if (!mapping && fstat(descriptor, &status) == 0 && S_ISFIFO(status.st_mode)) {
+            fcntl(descriptor, F_SETPIPE_SZ, static_cast<int>(kReadAheadSize)); // Lets the writer run further ahead
+        }
+#endif
+#else
+        (void)io;
+#endif
+    }
+
+    // Waits for the read in flight. Bytes already read ahead are still returned by readView().
+    void stopReadAhead() {
+#if HUFFMAN_HAVE_MMAP
+        if (readAheadIo && readPending) {
+            finishReadAhead();
+        }
+        readAheadIo = nullptr;
+#endif
+    }
+
+    // Whether the read position is known to be at the end of the input.
+    bool atEnd() const { return (seekable && position >= fileSize) || (exhausted && aheadStart == aheadEnd); }
+
+    // Whether a read of an unmapped input failed, which ended the input early.
+    bool readFailed() const { return readError; }
+
+    // Whether size() and seek() are available (true for regular files).
+    bool isSeekable() const { return seekable; }
+
+    uint64_t size() const { return fileSize; }
+
+    /**
+     * @brief Moves the read position of a seekable file.
+     * @param offset The new position from the start of the file.
+     * @return False if the file is not seekable or the offset is past its end.
+     */
+    bool seek(uint64_t offset) {
+        if (!seekable || offset > fileSize) {
+            return false;
+        }
+        position = offset;
+#if HUFFMAN_HAVE_MMAP
+        if (readAheadIo && readPending) {
+            finishReadAhead();
+        }
+        aheadStart = aheadEnd = 0; // Bytes read ahead belong to the old position
+        exhausted = false;
+        return mapping || lseek(descriptor, static_cast<off_t>(offset), SEEK_SET) >= 0;
+#else
+        return std::fseek(stream, static_cast<long>(offset), SEEK_SET) == 0;
+#endif
+    }
+
+    /**
+     * @brief Returns up to `maxSize` bytes at the read position and advances past them.
+     * The view points into the mapping when the bytes (plus `padding` readable bytes after them)
+     * lie inside it; otherwise the bytes are read into `storage`, followed by `padding` zero bytes.
+     * @param maxSize The number of bytes wanted.
+     * @param padding Bytes that must stay readable past the end of the view.
+     * @param view Receives a pointer to the bytes.
+     * @param storage Backing memory for bytes that could not be mapped.
+     * @return The number of bytes available, less than maxSize only at the end of the file.
+     */
+    size_t readView(size_t maxSize, size_t padding, const uint8_t*& view, std::vector<uint8_t>& storage) {
+        if (mapping) {
+            const size_t available = static_cast<size_t>(std::min<uint64_t>(maxSize, fileSize - position));
+            if (position + available + padding <= fileSize) {
+                view = mapping + position;
+            } else {
+                storage.assign(available + padding, 0);
+                std::memcpy(storage.data(), mapping + position, available);
+                view = storage.data();
+            }
+            position += available;
+#if HUFFMAN_HAVE_MMAP
+            if (readAheadIo && ownsMapping && position < fileSize) {
+                // Start paging in the next view; the kernel reads it while this one is worked on
+                const uintptr_t pageMask = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE)) - 1;
+                const uintptr_t start = reinterpret_cast<uintptr_t>(mapping + position) & ~pageMask;
+                const size_t length = static_cast<size_t>(std::min<uint64_t>(maxSize, fileSize - position));
+                madvise(reinterpret_cast<void*>(start), reinterpret_cast<uintptr_t>(mapping + position) - start + length,
+                        MADV_WILLNEED);
+            }
+#endif
+            return available;
+        }
+
+        // Bytes read ahead come first, then the rest from the read in flight or direct reads
+        storage.resize(maxSize + padding);
+        size_t filled = 0;
+        while (filled < maxSize) {
+            if (aheadStart != aheadEnd) {
+                const size_t taken = std::min(aheadEnd - aheadStart, maxSize - filled);
+                std::memcpy(storage.data() + filled, ahead.data() + aheadStart, taken);
+                aheadStart += taken;
+                filled += taken;
+                continue;
+            }
+#if HUFFMAN_HAVE_MMAP
+            if (readAheadIo) {
+                if (!readPending && !exhausted) {
+                    issueReadAhead();
+                }
+                if (!readPending) {
+                    break;
+                }
+                finishReadAhead();
+                continue;
+            }
+#endif
+            const size_t got = exhausted ? 0 : readSome(storage.data() + filled, maxSize - filled);
+            if (got == 0) {
+                exhausted = true;
+                break;
+            }
+            filled += got;
+        }
+        std::fill(storage.begin() + filled, storage.end(), 0);
+        storage.resize(filled + padding);
+        view = storage.data();
+        position += filled;
+#if HUFFMAN_HAVE_MMAP
+        if (readAheadIo && !readPending && !exhausted) {
+            issueReadAhead(); // The next bytes arrive while the caller works on these
+        }
+#endif
+        return filled;
+    }
+
+private:
+#if HUFFMAN_HAVE_MMAP
+    // Starts reading into the free end of the read-ahead buffer, moving unread bytes to its front.
+    void issueReadAhead() {
+        if (ahead.size() < kReadAheadSize) {
+            ahead.resize(kReadAheadSize);
+        }
+        if (aheadStart == aheadEnd) {
+            aheadStart = aheadEnd = 0;
+        } else if (aheadEnd == ahead.size()) {
+            std::memmove(ahead.data(), ahead.data() + aheadStart, aheadEnd - aheadStart);
+            aheadEnd -= aheadStart;
+            aheadStart = 0;
+        }
+        readAheadIo->read(descriptor, ahead.data() + aheadEnd, ahead.size() - aheadEnd, kCurrentPosition, 0);
+        readPending = true;
+    }
+
+    // Waits for the read in flight and adds its bytes; an empty or failed read ends the input.
+    void finishReadAhead() {
+        AsyncCompletion completion;
+        readAheadIo->wait(completion);
+        readPending = false;
+        if (completion.result == -EINTR) {
+            return;
+        }
+        if (completion.result <= 0) {
+            readError = readError || completion.result < 0;
+            exhausted = true;
+            return;
+        }
+        aheadEnd += static_cast<size_t>(completion.result);
+    }
+#endif
+
+    // Determines the size of the just-opened input and maps it when it is a regular file.
+    bool attach() {
+#if HUFFMAN_HAVE_MMAP
+        struct stat status;
+        if (fstat(descriptor, &status) == 0 && S_ISREG(status.st_mode)) {
+            seekable = true;
+            fileSize = static_cast<uint64_t>(status.st_size);
+            if (fileSize > 0) {
+                void* address = mmap(nullptr, static_cast<size_t>(fileSize), PROT_READ, MAP_PRIVATE, descriptor, 0);
+                if (address != MAP_FAILED) {
+                    mapping = static_cast<const uint8_t*>(address);
+                    madvise(address, static_cast<size_t>(fileSize), MADV_SEQUENTIAL);
+                }
+            }
+        }
+        return true;
+#else
+        seekable = std::fseek(stream, 0, SEEK_END) == 0;
+        if (seekable) {
+            fileSize = static_cast<uint64_t>(std::ftell(stream));
+            std::fseek(stream, 0, SEEK_SET);
+        }
+        return true;
+#endif
+    }
+
+    // One read() call; returns 0 at the end of the input or on error, which sets readError.
+    size_t readSome(uint8_t* destination, size_t size) {
+#if HUFFMAN_HAVE_MMAP
+        for (;;) {
+            const ssize_t got = ::read(descriptor, destination, size);
+            if (got >= 0) {
+                return static_cast<size_t>(got);
+            }
+            if (errno != EINTR) {
+                readError = true;
+                return 0;
+            }
+        }
+#else
+        const size_t got = std::fread(destination, 1, size, stream);
+        readError = readError || std::ferror(stream) != 0;
+        return got;
+#endif
+    }
+
+#if HUFFMAN_HAVE_MMAP
+    int descriptor = -1;
+#else
+    std::FILE* stream = nullptr;
+#endif
+    const uint8_t* mapping = nullptr;
+    bool ownsMapping = true;
+    uint64_t fileSize = 0;
+    uint64_t position = 0;
+    bool seekable = false;
+    bool exhausted = false;   // A read found the end of an unmapped input
+    bool readError = false;   // A read of an unmapped input failed; kept until the input is closed
+    std::vector<uint8_t> ahead; // Bytes read ahead: [aheadStart, aheadEnd) are not handed out yet
+    size_t aheadStart = 0;
+    size_t aheadEnd = 0;
+#if HUFFMAN_HAVE_MMAP
+    AsyncIo* readAheadIo = nullptr;
+    bool readPending = false;
+#endif
+};
+
+// Write access to a file: sequential write() calls, or a writable mapping of a known total size
+// for outputs that are filled out of order. A caller-owned byte vector can stand in for the file.
+class OutputFile {
+public:
+    OutputFile() = default;
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+    ~OutputFile() { close(); }
+
+    /**
+     * @brief Creates or truncates a file for writing.
+     * @param path The path to the file.
+     * @return False if the file cannot be created.
+     */
+    bool open(const std::string& path) {
+        close();
+#if HUFFMAN_HAVE_MMAP
+        descriptor = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        failed = descriptor < 0;
+#else
+        stream = std::fopen(path.c_str(), "wb");
+        failed = stream == nullptr;
+#endif
+        return !failed;
+    }
+
+    /**
+     * @brief Writes to standard output. A redirect to a regular file can still be mapped.
+     * @return False if standard output cannot be opened.
+     */
+    bool openStandardOutput() {
+        close();
+#if HUFFMAN_HAVE_MMAP
+        descriptor = ::dup(STDOUT_FILENO); // A private descriptor, so close() leaves standard output open
+        failed = descriptor < 0;
+#else
+        stream = stdout;
+        failed = false;
+#endif
+        return !failed;
+    }
+
+    /**
+     * @brief Directs all writes to the end of a byte vector, which must outlive the writes.
+     * @param destination The vector receiving the bytes; its existing contents are kept.
+     */
+    void openBuffer(std::vector<uint8_t>& destination) {
+        close();
+        failed = false;
+        buffer = &destination;
+    }
+
+    /**
+     * @brief Hands later writes to `io` until stopWriteBehind(): write() copies the bytes into one
+     * of kWriteBehindBuffers reusable buffers and returns, and each full buffer is written while
+     * the caller carries on. A regular file takes writes at explicit offsets, several at a time;
+     * a pipe or an appending file takes the queued buffers one at a time, in order, and a pipe's
+     * capacity is raised to kWriteBehindBufferSize when the system allows. Failures show up in
+     * later calls to write() and in stopWriteBehind() or close().
+     * @param io The queue performing the writes, used by nothing else; must outlive the write-behind.
+     */
+    void startWriteBehind(AsyncIo& io) {
+#if HUFFMAN_HAVE_MMAP
+        stopWriteBehind();
+        if (buffer || descriptor < 0 || failed) {
+            return;
+        }
+        struct stat status;
+        const int statusFlags = fcntl(descriptor, F_GETFL);
+        const off_t start = lseek(descriptor, 0, SEEK_CUR);
+        const bool positioned = fstat(descriptor, &status) == 0 && S_ISREG(status.st_mode) && statusFlags >= 0 &&
+                                (statusFlags & O_APPEND) == 0 && start >= 0;
+        writeOffset = positioned ? static_cast<uint64_t>(start) : kCurrentPosition;
+#ifdef F_SETPIPE_SZ
+        if (!positioned && S_ISFIFO(status.st_mode)) {
+            fcntl(descriptor, F_SETPIPE_SZ, static_cast<int>(kWriteBehindBufferSize));
+        }
+#endif
+        writeBehindIo = &io;
+        current = 0;
+        nextWrite = 0;
+#else
+        (void)io;
+#endif
+    }
+
+    /**
+     * @brief Writes out the buffered bytes, waits for every write and returns to direct writes.
+     * @return False if any write failed.
+     */
+    bool stopWriteBehind() {
+#if HUFFMAN_HAVE_MMAP
+        if (writeBehindIo) {
+            submitBuffer();
+            for (;;) {
+                issueWrites();
+                if (writeBehindIo->pending() == 0) {
+                    break;
+                }
+                finishWrite(true);
+            }
+            if (writeOffset != kCurrentPosition && !failed) {
+                failed = lseek(descriptor, static_cast<off_t>(writeOffset), SEEK_SET) < 0; // Past the bytes written
+            }
+            writeBehindIo = nullptr;
+        }
+#endif
+        return !failed;
+    }
+
+    /**
+     * @brief Appends bytes at the current end of the file.
+     * @return False if any earlier or current write failed.
+     */
+    bool write(const void* data, size_t size) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        if (buffer) {
+            buffer->insert(buffer->end(), p, p + size);
+            return true;
+        }
+#if HUFFMAN_HAVE_MMAP
+        if (writeBehindIo) {
+            while (finishWrite(false)) { // Take the finished writes, so the queued ones can start
+            }
+            issueWrites();
+        }
+        while (writeBehindIo && size > 0 && !failed) {
+            std::vector<uint8_t>& bytes = writeBehind[current].bytes;
+            const size_t taken = std::min(size, kWriteBehindBufferSize - bytes.size());
+            bytes.insert(bytes.end(), p, p + taken);
+            p += taken;
+            size -= taken;
+            if (bytes.size() == kWriteBehindBufferSize) {
+                submitBuffer();
+            }
+        }
+        while (size > 0 && !failed) {
+            const ssize_t written = ::write(descriptor, p, size);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            failed = written <= 0;
+            if (!failed) {
+                p += written;
+                size -= static_cast<size_t>(written);
+            }
+        }
+#else
+        failed = failed || std::fwrite(p, 1, size, stream) != size;
+#endif
+        return !failed;
+    }
+
+    /**
+     * @brief Sizes the file to `size` bytes and maps it for writing.
+     * @param size The final file size.
+     * @return The writable mapping, or nullptr if the output cannot be mapped (e.g. a pipe).
+     */
+    uint8_t* map(uint64_t size) {
+        stopWriteBehind();
+        if (buffer) {
+            buffer->resize(static_cast<size_t>(size));
+            return size > 0 ? buffer->data() : nullptr;
+        }
+#if HUFFMAN_HAVE_MMAP
+        struct stat status;
+        // Only a file written from its start can be mapped, not e.g. standard output appending to one
+        if (failed || size == 0 || fstat(descriptor, &status) != 0 || !S_ISREG(status.st_mode) ||
+            lseek(descriptor, 0, SEEK_CUR) != 0 || ftruncate(descriptor, static_cast<off_t>(size)) != 0) {
+            return nullptr;
+        }
+        void* address = mmap(nullptr, static_cast<size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+        if (address == MAP_FAILED) {
+            return nullptr;
+        }
+        mapping = static_cast<uint8_t*>(address);
+        mappingSize = size;
+        return mapping;
+#else
+        (void)size;
+        return nullptr;
+#endif
+    }
+
+    /**
+     * @brief Unmaps and closes the file.
+     * @return False if any write failed.
+     */
+    bool close() {
+        stopWriteBehind();
+#if HUFFMAN_HAVE_MMAP
+        if (mapping) {
+            munmap(mapping, static_cast<size_t>(mappingSize));
+        }
+        if (descriptor >= 0) {
+            failed = ::close(descriptor) != 0 || failed;
+        }
+        descriptor = -1;
+#else
+        if (stream) {
+            failed = (stream == stdout ? std::fflush(stream) : std::fclose(stream)) != 0 || failed;
+        }
+        stream = nullptr;
+#endif
+        mapping = nullptr;
+        mappingSize = 0;
+        buffer = nullptr;
+        return !failed;
+    }
+
+private:
+#if HUFFMAN_HAVE_MMAP
+    // A buffer of write-behind bytes: filled by write(), then queued, then written
+    struct WriteBehindBuffer {
+        std::vector<uint8_t> bytes;
+        uint64_t offset = 0;   // Where the bytes go, set when queued
+        bool queued = false;   // Full, until its write has completed
+        bool inFlight = false; // Handed to the queue
+    };
+
+    // Queues the current buffer, then makes the next one current, waiting for its earlier write.
+    void submitBuffer() {
+        WriteBehindBuffer& full = writeBehind[current];
+        if (full.bytes.empty()) {
+            return;
+        }
+        full.offset = writeOffset;
+        full.queued = true;
+        if (writeOffset != kCurrentPosition) {
+            writeOffset += full.bytes.size();
+        }
+        current = (current + 1) % kWriteBehindBuffers;
+        issueWrites();
+        while (writeBehind[current].queued) {
+            finishWrite(true);
+            issueWrites();
+        }
+    }
+
+    // Starts the queued writes that may go now: all of them at explicit offsets, and otherwise
+    // the oldest once the one before it has completed, so the bytes cannot land out of order.
+    void issueWrites() {
+        while (writeBehind[nextWrite].queued && !writeBehind[nextWrite].inFlight &&
+               (writeOffset != kCurrentPosition || writeBehindIo->pending() == 0)) {
+            WriteBehindBuffer& next = writeBehind[nextWrite];
+            next.inFlight = true;
+            writeBehindIo->write(descriptor, next.bytes.data(), next.bytes.size(), next.offset, nextWrite);
+            nextWrite = (nextWrite + 1) % kWriteBehindBuffers;
+        }
+    }
+
+    // Takes one write completion, blocking for it if `block` is set; the bytes a short write left
+    // are written directly. Returns false if no completion was taken.
+    bool finishWrite(bool block) {
+        AsyncCompletion completion;
+        if (!(block ? writeBehindIo->wait(completion) : writeBehindIo->poll(completion))) {
+            return false;
+        }
+        WriteBehindBuffer& done = writeBehind[completion.tag];
+        done.queued = false;
+        done.inFlight = false;
+        size_t written = completion.result > 0 ? static_cast<size_t>(completion.result) : 0;
+        failed = failed || (completion.result < 0 && completion.result != -EINTR);
+        while (written < done.bytes.size() && !failed) {
+            const ssize_t more = done.offset == kCurrentPosition
+                                     ? ::write(descriptor, done.bytes.data() + written, done.bytes.size() - written)
+                                     : ::pwrite(descriptor, done.bytes.data() + written, done.bytes.size() - written,
+                                                static_cast<off_t>(done.offset + written));
+            if (more < 0 && errno == EINTR) {
+                continue;
+            }
+            failed = more <= 0;
+            written += more > 0 ? static_cast<size_t>(more) : 0;
+        }
+        done.bytes.clear(); // Keeps its capacity for the next round
+        return true;
+    }
+
+    int descriptor = -1;
+    AsyncIo* writeBehindIo = nullptr;
+    std::array<WriteBehindBuffer, kWriteBehindBuffers> writeBehind;
+    unsigned current = 0;   // The buffer write() fills
+    unsigned nextWrite = 0; // The oldest buffer not yet handed to the queue
+    uint64_t writeOffset = 0; // Where the next buffer goes, or kCurrentPosition
+#else
+    std::FILE* stream = nullptr;
+#endif
+    uint8_t* mapping = nullptr;
+    uint64_t mappingSize = 0;
+    std::vector<uint8_t>* buffer = nullptr;
+    bool failed = false;
+};
+
+#endif // FILE_IO_H
@@ -0,0 +1,115 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "thread_pool.h"
+
+// Occurrence count of every byte value
+using ByteHistogram = std::array<uint64_t, 256>;
+
+// A histogram is split into slices of at least this many bytes.
+constexpr size_t kMinParallelHistogramBytes = size_t(4) << 20;
+
+// Bytes counted into the 32-bit tables before they are folded into the 64-bit result,
+// so no 32-bit counter can overflow.
+constexpr size_t kHistogramFlushBytes = size_t(1) << 30;
+
+/**
+ * @brief Adds the byte counts of one range to `counts` using four interleaved 32-bit tables.
+ * Consecutive bytes go to different tables, so runs of the same byte do not serialize on one
+ * counter through store-to-load forwarding.
+ * @param data The bytes to count.
+ * @param size The number of bytes.
+ * @param counts The histogram the counts are added to.
+ */
+inline void accumulateHistogram(const uint8_t* data, size_t size, ByteHistogram& counts) {
+    alignas(64) uint32_t tables[4][256];
+    while (size > 0) {
+        const size_t chunkSize = std::min(size, kHistogramFlushBytes);
+        std::memset(tables, 0, sizeof(tables));
+
+        size_t i = 0;
+        for (; i + 16 <= chunkSize; i += 16) {
+            uint64_t low;
+            uint64_t high;
+            std::memcpy(&low, data + i, 8);
+            std::memcpy(&high, data + i + 8, 8);
+            for (int shift = 0; shift < 64; shift += 16) {
+                ++tables[0][(low >> shift) & 0xFF];
+                ++tables[1][(low >> (shift + 8)) & 0xFF];
+                ++tables[2][(high >> shift) & 0xFF];
+                ++tables[3][(high >> (shift + 8)) & 0xFF];
+            }
+        }
+        for (; i < chunkSize; ++i) {
+            ++tables[0][data[i]];
+        }
+
+        // Straight-line adds over contiguous arrays; compilers turn this reduction into vector code
+        for (int symbol = 0; symbol < 256; ++symbol) {
+            counts[symbol] += uint64_t(tables[0][symbol]) + tables[1][symbol] + tables[2][symbol] + tables[3][symbol];
+        }
+        data += chunkSize;
+        size -= chunkSize;
+    }
+}
+
+// Most slices a histogram is split into; each has fixed partial counts, so a split
+// histogram allocates nothing.
+constexpr unsigned kMaxHistogramSlices = 16;
+
+// One slice of a split histogram, counted as a job on a thread pool
+struct HistogramSlice {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    ByteHistogram counts{};
+    std::atomic<bool> done{true};
+
+    void run() {
+        counts = {};
+        accumulateHistogram(data, size, counts);
+    }
+};
+
+/**
+ * @brief Counts every byte value in a buffer, splitting large inputs across a thread pool. The
+ * calling thread counts the first slice while the pool's workers count the others.
+ * @param data The bytes to count.
+ * @param size The number of bytes.
+ * @param pool The pool the other slices run on; null counts on the calling thread only.
+ * @return The 64-bit count of every byte value.
+ */
+inline ByteHistogram computeHistogram(const uint8_t* data, size_t size, ThreadPool* pool = nullptr) {
+    const size_t sliceLimit = pool ? std::min<size_t>(kMaxHistogramSlices, size_t(pool->size()) + 1) : 1;
+    const size_t sliceCount = std::min(sliceLimit, std::max<size_t>(1, size / kMinParallelHistogramBytes));
+
+    ByteHistogram counts{};
+    if (!pool || sliceCount == 1) {
+        accumulateHistogram(data, size, counts);
+        return counts;
+    }
+
+    std::array<HistogramSlice, kMaxHistogramSlices> slices;
+    const size_t sliceSize = size / sliceCount;
+    for (size_t t = 1; t < sliceCount; ++t) {
+        slices[t].data = data + t * sliceSize;
+        slices[t].size = t + 1 == sliceCount ? size - t * sliceSize : sliceSize;
+        pool->post(slices[t]);
+    }
+    accumulateHistogram(data, sliceSize, counts);
+    for (size_t t = 1; t < sliceCount; ++t) {
+        pool->wait(slices[t].done);
+        for (int symbol = 0; symbol < 256; ++symbol) {
+            counts[symbol] += slices[t].counts[symbol];
+        }
+    }
+    return counts;
+}
+
+#endif // HISTOGRAM_H
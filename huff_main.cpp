@@ -0,0 +1,600 @@
+// huff: compresses or decompresses any number of files in one process.
+//
+//   huff c [options] [file...]   compress each file to file.huff
+//   huff d [options] [file...]   decompress each file.huff to file
+//   huff c --estimate [-s N] [file...]   predict each file's compressed size, writing nothing
+//   huff d --index-records [-r K] [file.huff...]   write a record index next to each file.huff
+//   huff d --records N[:COUNT] file.huff   print records N.. of file.huff through its record index
+//
+// With no files (or "-") it filters standard input to standard output. Several files are
+// processed as one batch on a shared worker pool, each worker reusing one encoder or decoder,
+// so process startup, thread creation and buffer setup are paid once rather than per file.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if __has_include(<glob.h>)
+#include <glob.h>
+#define HUFFMAN_HAVE_GLOB 1
+#else
+#define HUFFMAN_HAVE_GLOB 0
+#endif
+
+#include "file_io.h"
+#include "huffman_decoder.h"
+#include "huffman_encoder.h"
+#include "huffman_stats.h"
+#include "record_index.h"
+#include "thread_pool.h"
+
+namespace {
+
+constexpr const char* kExtension = ".huff";
+constexpr const char* kStandardStream = "-";
+constexpr const char* kRecordIndexExtension = ".idx"; // Appended to the .huff name
+
+constexpr const char* kUsage =
+    "Usage: huff c|d [options] [file...]\n"
+    "  c            compress each file to file.huff\n"
+    "  d            decompress each file.huff to file\n"
+    "  -o PATH      output file for a single input, or existing directory for several\n"
+    "  -c           write to standard output\n"
+    "  -l LIST      also process the paths listed in LIST, one per line (\"-\" reads standard input)\n"
+    "  -T N         worker threads; 0 (default) means one per hardware thread\n"
+    "  -b BYTES     block size (compression)\n"
+    "  -L BITS      longest code allowed, 8..64 (compression)\n"
+    "  -x N         order-1 context mode with up to N code tables, 2..16 (compression)\n"
+    "  -n           no block checksums (compression), or skip verifying them (decompression)\n"
+    "  -f           overwrite existing output files\n"
+    "  -q           print nothing but errors\n"
+    "  --stats      print counters and phase times, summed over all files\n"
+    "  --estimate   print each file's predicted compressed size instead of compressing it\n"
+    "  -s N         with --estimate, size only every Nth block and scale the rest from them\n"
+    "  --index-records  write each file.huff's record index to file.huff.idx instead of decompressing it\n"
+    "  -r N         with --index-records, records between checkpoints (default 64)\n"
+    "  -D BYTE      with --index-records, the byte value that ends a record (default 10, newline)\n"
+    "  --records N[:COUNT]  write COUNT (default 1) records from record N on, through file.huff.idx,\n"
+    "               which is built in memory if missing\n"
+    "With no files, or \"-\", reads standard input and writes standard output.\n"
+    "Paths containing wildcards are expanded, so lists can hold patterns.\n";
+
+// Command-line settings
+struct Settings {
+    bool compress = true;
+    std::vector<std::string> inputs;
+    std::string outputPath;     // -o
+    bool toStandardOutput = false;
+    bool overwrite = false;
+    bool quiet = false;
+    bool stats = false;
+    bool checksums = true;      // Cleared by -n
+    unsigned threadCount = 0;
+    uint32_t blockSize = kDefaultBlockSize;
+    unsigned maxCodeLength = 0;
+    unsigned contextTables = 0; // -x
+    bool estimate = false;
+    unsigned sampleInterval = 1; // -s
+    bool indexRecords = false;   // --index-records
+    uint32_t recordInterval = kDefaultRecordInterval; // -r
+    uint8_t delimiter = '\n';   // -D
+    bool readRecords = false;    // --records
+    uint64_t firstRecord = 0;
+    uint64_t recordCount = 1;
+};
+
+// One file of the batch
+struct FileJob {
+    std::string source;      // A path, or kStandardStream
+    std::string destination; // A path, or kStandardStream
+};
+
+// The outcome of one file, reported by the thread that ran it
+struct FileResult {
+    bool succeeded = false;
+    std::string error;
+    CompressionStats compressionStats;
+    DecompressionStats decompressionStats;
+};
+
+/**
+ * @brief Parses an unsigned decimal argument.
+ * @param text The argument.
+ * @param value Receives the value.
+ * @return False if the argument is not a number.
+ */
+bool parseNumber(const char* text, uint64_t& value) {
+    char* end = nullptr;
+    value = std::strtoull(text, &end, 10);
+    return *text >= '0' && *text <= '9' && *end == '\0';
+}
+
+/**
+ * @brief Parses the record range of --records: a first record and an optional count.
+ * @param text The argument, N or N:COUNT.
+ * @param settings Receives the first record and the count.
+ * @return False if the argument is malformed.
+ */
+bool parseRecordRange(const char* text, Settings& settings) {
+    const std::string range = text;
+    const size_t colon = range.find(':');
+    if (colon == std::string::npos) {
+        settings.recordCount = 1;
+        return parseNumber(text, settings.firstRecord);
+    }
+    return parseNumber(range.substr(0, colon).c_str(), settings.firstRecord) &&
+           parseNumber(range.substr(colon + 1).c_str(), settings.recordCount);
+}
+
+/**
+ * @brief Adds a path to the inputs, expanding it when it contains wildcards.
+ * @param path The path or pattern.
+ * @param inputs The list to extend.
+ */
+void addInput(const std::string& path, std::vector<std::string>& inputs) {
+#if HUFFMAN_HAVE_GLOB
+    if (path.find_first_of("*?[") != std::string::npos) {
+        glob_t matches{};
+        if (glob(path.c_str(), 0, nullptr, &matches) == 0) {
+            inputs.insert(inputs.end(), matches.gl_pathv, matches.gl_pathv + matches.gl_pathc);
+            globfree(&matches);
+            return;
+        }
+        globfree(&matches);
+    }
+#endif
+    inputs.push_back(path);
+}
+
+/**
+ * @brief Adds the paths listed in a file, one per line, skipping empty lines.
+ * @param listPath The list file, or kStandardStream for standard input.
+ * @param inputs The list to extend.
+ * @return False if the list cannot be read.
+ */
+bool readInputList(const std::string& listPath, std::vector<std::string>& inputs) {
+    std::ifstream listFile;
+    if (listPath != kStandardStream) {
+        listFile.open(listPath);
+        if (!listFile) {
+            return false;
+        }
+    }
+    std::istream& list = listPath == kStandardStream ? std::cin : listFile;
+    for (std::string line; std::getline(list, line);) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!line.empty()) {
+            addInput(line, inputs);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Parses the command line.
+ * @param argc The argument count.
+ * @param argv The arguments.
+ * @param settings Receives the settings.
+ * @return False if the arguments are invalid; the reason has been printed.
+ */
+bool parseArguments(int argc, char** argv, Settings& settings) {
+    if (argc < 2 || (std::string(argv[1]) != "c" && std::string(argv[1]) != "d")) {
+        std::cerr << kUsage;
+        return false;
+    }
+    settings.compress = std::string(argv[1]) == "c";
+    bool readStandardInputList = false;
+    for (int i = 2; i < argc; ++i) {
+        const std::string argument = argv[i];
+        const bool hasValue = i + 1 < argc;
+        uint64_t number = 0;
+        if (argument == "-o" && hasValue) {
+            settings.outputPath = argv[++i];
+        } else if (argument == "-c") {
+            settings.toStandardOutput = true;
+        } else if (argument == "-l" && hasValue) {
+            const std::string listPath = argv[++i];
+            readStandardInputList = readStandardInputList || listPath == kStandardStream;
+            if (!readInputList(listPath, settings.inputs)) {
+                std::cerr << "Error: Cannot open file list: " << listPath << std::endl;
+                return false;
+            }
+        } else if (argument == "-T" && hasValue && parseNumber(argv[i + 1], number)) {
+            settings.threadCount = static_cast<unsigned>(std::min<uint64_t>(number, 4096));
+            ++i;
+        } else if (argument == "-b" && hasValue && parseNumber(argv[i + 1], number) && number <= kMaxBlockSize) {
+            settings.blockSize = static_cast<uint32_t>(number);
+            ++i;
+        } else if (argument == "-L" && hasValue && parseNumber(argv[i + 1], number) && number <= kMaxCodeLength) {
+            settings.maxCodeLength = static_cast<unsigned>(number);
+            ++i;
+        } else if (argument == "-x" && hasValue && parseNumber(argv[i + 1], number) && number >= 2 &&
+                   number <= kMaxContextTables) {
+            settings.contextTables = static_cast<unsigned>(number);
+            ++i;
+        } else if (argument == "-f") {
+            settings.overwrite = true;
+        } else if (argument == "-q") {
+            settings.quiet = true;
+        } else if (argument == "-n") {
+            settings.checksums = false;
+        } else if (argument == "--stats") {
+            settings.stats = true;
+        } else if (argument == "--estimate") {
+            settings.estimate = true;
+        } else if (argument == "-s" && hasValue && parseNumber(argv[i + 1], number) && number >= 1 && number <= UINT32_MAX) {
+            settings.sampleInterval = static_cast<unsigned>(number);
+            ++i;
+        } else if (argument == "--index-records") {
+            settings.indexRecords = true;
+        } else if (argument == "-r" && hasValue && parseNumber(argv[i + 1], number) && number >= 1 && number <= UINT32_MAX) {
+            settings.recordInterval = static_cast<uint32_t>(number);
+            ++i;
+        } else if (argument == "-D" && hasValue && parseNumber(argv[i + 1], number) && number <= 255) {
+            settings.delimiter = static_cast<uint8_t>(number);
+            ++i;
+        } else if (argument == "--records" && hasValue && parseRecordRange(argv[i + 1], settings)) {
+            settings.readRecords = true;
+            ++i;
+        } else if (argument == kStandardStream || argument[0] != '-') {
+            addInput(argument, settings.inputs);
+        } else {
+            std::cerr << kUsage;
+            return false;
+        }
+    }
+
+    if (settings.inputs.empty() && !readStandardInputList) {
+        settings.inputs.push_back(kStandardStream);
+    }
+    const bool readsStandardInput = std::find(settings.inputs.begin(), settings.inputs.end(), kStandardStream) != settings.inputs.end();
+    if (readsStandardInput && readStandardInputList) {
+        std::cerr << "Error: Standard input cannot hold both the file list and data" << std::endl;
+        return false;
+    }
+    if (settings.estimate && !settings.compress) {
+        std::cerr << "Error: --estimate applies to compression" << std::endl;
+        return false;
+    }
+    if ((settings.indexRecords || settings.readRecords) && settings.compress) {
+        std::cerr << "Error: --index-records and --records apply to decompression" << std::endl;
+        return false;
+    }
+    if (settings.indexRecords && settings.readRecords) {
+        std::cerr << "Error: --index-records and --records cannot be combined" << std::endl;
+        return false;
+    }
+    if ((settings.indexRecords || settings.readRecords) && readsStandardInput) {
+        std::cerr << "Error: Record indexes need a compressed file, not standard input" << std::endl;
+        return false;
+    }
+    if (settings.readRecords && settings.inputs.size() != 1) {
+        std::cerr << "Error: --records takes a single file" << std::endl;
+        return false;
+    }
+    if (settings.toStandardOutput && !settings.outputPath.empty()) {
+        std::cerr << "Error: -c and -o cannot be combined" << std::endl;
+        return false;
+    }
+    if ((settings.toStandardOutput || readsStandardInput) && settings.inputs.size() > 1) {
+        std::cerr << "Error: Standard input and output take a single file" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Derives where one input's output goes: -c, -o (a file or a directory), or next to the input.
+ * @param settings The settings.
+ * @param source The input path.
+ * @param destination Receives the output path.
+ * @return False if no output name can be derived; the reason has been printed.
+ */
+bool destinationFor(const Settings& settings, const std::string& source, std::string& destination) {
+    if (settings.toStandardOutput || (source == kStandardStream && settings.outputPath.empty())) {
+        destination = kStandardStream;
+        return true;
+    }
+    if (!settings.outputPath.empty() && settings.inputs.size() == 1 && !std::filesystem::is_directory(settings.outputPath)) {
+        destination = settings.outputPath;
+        return true;
+    }
+
+    std::string name = source;
+    if (settings.compress) {
+        name += kExtension;
+    } else if (name.size() > std::strlen(kExtension) && name.ends_with(kExtension)) {
+        name.resize(name.size() - std::strlen(kExtension));
+    } else {
+        std::cerr << "Error: " << source << ": Unknown suffix, expected " << kExtension << std::endl;
+        return false;
+    }
+    destination = settings.outputPath.empty() ? name
+                                              : (std::filesystem::path(settings.outputPath) / std::filesystem::path(name).filename()).string();
+    return true;
+}
+
+/**
+ * @brief Compresses or decompresses one file with the given encoder and decoder.
+ * @param job The file and its destination.
+ * @param compress True to compress, false to decompress.
+ * @param overwrite Whether an existing destination may be replaced.
+ * @param encoder The encoder to use when compressing.
+ * @param decoder The decoder to use when decompressing.
+ */
+FileResult processFile(const FileJob& job, bool compress, bool overwrite, HuffmanEncoder& encoder, HuffmanDecoder& decoder) {
+    FileResult result;
+    std::error_code ignored;
+    if (job.destination != kStandardStream && !overwrite && std::filesystem::exists(job.destination, ignored)) {
+        result.error = job.destination + ": Output file exists (use -f to overwrite)";
+        return result;
+    }
+
+    InputFile inputFile;
+    if (!(job.source == kStandardStream ? inputFile.openStandardInput() : inputFile.open(job.source))) {
+        result.error = "Cannot open input file: " + job.source;
+        return result;
+    }
+    OutputFile outputFile;
+    if (!(job.destination == kStandardStream ? outputFile.openStandardOutput() : outputFile.open(job.destination))) {
+        result.error = "Cannot create output file: " + job.destination;
+        return result;
+    }
+
+    const bool coded = compress ? encoder.encode(inputFile, outputFile) : decoder.decode(inputFile, outputFile);
+    const bool written = outputFile.close();
+    if (!coded) {
+        result.error = job.source + ": " + (compress ? encoder.error() : decoder.error());
+    } else if (!written) {
+        result.error = "Cannot write output file: " + job.destination;
+    }
+    result.succeeded = coded && written;
+    if (!result.succeeded && job.destination != kStandardStream) {
+        std::filesystem::remove(job.destination, ignored);
+    }
+    result.compressionStats = encoder.stats();
+    result.decompressionStats = decoder.stats();
+    return result;
+}
+
+/**
+ * @brief Prints the predicted compressed size of every input, in order, and a total for several.
+ * @param settings The settings; the inputs are read, nothing is written.
+ * @param options The compression options the prediction is for.
+ * @return False if an input could not be sized; the reason has been printed.
+ */
+bool estimateInputs(const Settings& settings, const CompressionOptions& options) {
+    HuffmanEncoder encoder(options);
+    bool succeeded = true;
+    SizeEstimate total;
+    for (const std::string& source : settings.inputs) {
+        SizeEstimate estimate;
+        bool sized = false;
+        if (source == kStandardStream) {
+            InputFile inputFile;
+            sized = inputFile.openStandardInput() && encoder.estimateSize(inputFile, estimate, settings.sampleInterval);
+        } else {
+            sized = encoder.estimateFile(source, estimate, settings.sampleInterval);
+        }
+        if (!sized) {
+            std::cerr << "Error: " << source << ": " << encoder.error() << std::endl;
+            succeeded = false;
+            continue;
+        }
+        std::cout << source << ": " << estimate.rawSize << " -> " << estimate.estimatedSize << " bytes (ratio "
+                  << estimate.ratio() << "), " << estimate.sampledBlocks << " of " << estimate.blockCount << " blocks sized"
+                  << std::endl;
+        total.rawSize += estimate.rawSize;
+        total.estimatedSize += estimate.estimatedSize;
+    }
+    if (settings.inputs.size() > 1) {
+        std::cout << "total: " << total.rawSize << " -> " << total.estimatedSize << " bytes (ratio " << total.ratio() << ")"
+                  << std::endl;
+    }
+    return succeeded;
+}
+
+/**
+ * @brief Builds the record index of every input and writes it next to the input.
+ * @param settings The settings; the inputs are .huff files.
+ * @return False if an input could not be indexed; the reason has been printed.
+ */
+bool indexInputRecords(const Settings& settings) {
+    HuffmanArchive archive;
+    RecordIndex records;
+    std::vector<uint8_t> sidecar;
+    bool succeeded = true;
+    for (const std::string& source : settings.inputs) {
+        const std::string destination = settings.outputPath.empty() || settings.inputs.size() > 1
+                                            ? source + kRecordIndexExtension
+                                            : settings.outputPath;
+        std::error_code ignored;
+        std::string error;
+        if (!settings.overwrite && std::filesystem::exists(destination, ignored)) {
+            error = destination + ": Output file exists (use -f to overwrite)";
+        } else if (!archive.open(source)) {
+            error = archive.error();
+        } else if (!archive.buildRecordIndex(settings.delimiter, settings.recordInterval, records)) {
+            error = source + ": " + archive.error();
+        } else {
+            sidecar.clear();
+            writeRecordIndex(records, sidecar);
+            OutputFile outputFile;
+            if (!outputFile.open(destination) || !outputFile.write(sidecar.data(), sidecar.size()) || !outputFile.close()) {
+                error = "Cannot write output file: " + destination;
+                std::filesystem::remove(destination, ignored);
+            }
+        }
+        if (!error.empty()) {
+            std::cerr << "Error: " << error << std::endl;
+            succeeded = false;
+        } else if (!settings.quiet) {
+            std::cout << source << ": " << records.recordCount << " records, " << records.checkpoints.size() << " checkpoints" << std::endl;
+        }
+    }
+    return succeeded;
+}
+
+/**
+ * @brief Writes the requested records of the single input, through its record index sidecar, or
+ * through an index built in memory when there is none.
+ * @param settings The settings.
+ * @return False if the records could not be read or written; the reason has been printed.
+ */
+bool printRecords(const Settings& settings) {
+    const std::string& source = settings.inputs.front();
+    const std::string destination = settings.outputPath.empty() ? kStandardStream : settings.outputPath;
+    std::error_code ignored;
+    if (destination != kStandardStream && !settings.overwrite && std::filesystem::exists(destination, ignored)) {
+        std::cerr << "Error: " << destination << ": Output file exists (use -f to overwrite)" << std::endl;
+        return false;
+    }
+    HuffmanArchive archive;
+    if (!archive.open(source)) {
+        std::cerr << "Error: " << archive.error() << std::endl;
+        return false;
+    }
+    const std::string indexPath = source + kRecordIndexExtension;
+    RecordIndex records;
+    if (std::filesystem::exists(indexPath, ignored)) {
+        InputFile indexFile;
+        std::vector<uint8_t> storage;
+        const uint8_t* sidecar = nullptr;
+        if (!indexFile.open(indexPath) || indexFile.readView(static_cast<size_t>(indexFile.size()), 0, sidecar, storage) != indexFile.size() ||
+            !readRecordIndex(sidecar, static_cast<size_t>(indexFile.size()), records)) {
+            std::cerr << "Error: " << indexPath << ": Invalid record index" << std::endl;
+            return false;
+        }
+    } else if (!archive.buildRecordIndex(settings.delimiter, settings.recordInterval, records)) {
+        std::cerr << "Error: " << source << ": " << archive.error() << std::endl;
+        return false;
+    }
+
+    std::vector<uint8_t> output;
+    if (!archive.readRecords(records, settings.firstRecord, settings.recordCount, output)) {
+        std::cerr << "Error: " << source << ": " << archive.error() << std::endl;
+        return false;
+    }
+    OutputFile outputFile;
+    if (!(destination == kStandardStream ? outputFile.openStandardOutput() : outputFile.open(destination)) ||
+        !outputFile.write(output.data(), output.size()) || !outputFile.close()) {
+        std::cerr << "Error: Cannot write output file: " << destination << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    // 1. Parse the command line and work out every input's destination; an estimate and the
+    //    record commands only read
+    Settings settings;
+    if (!parseArguments(argc, argv, settings)) {
+        return 1;
+    }
+    const unsigned threadCount = settings.threadCount ? settings.threadCount : std::max(1u, std::thread::hardware_concurrency());
+    CompressionOptions compressionOptions;
+    compressionOptions.blockSize = settings.blockSize;
+    compressionOptions.maxCodeLength = settings.maxCodeLength;
+    compressionOptions.contextTables = settings.contextTables;
+    compressionOptions.checksums = settings.checksums;
+    compressionOptions.collectStats = settings.stats;
+    DecompressionOptions decompressionOptions;
+    decompressionOptions.verifyChecksums = settings.checksums;
+    decompressionOptions.collectStats = settings.stats;
+    if (settings.estimate) {
+        return estimateInputs(settings, compressionOptions) ? 0 : 1;
+    }
+    if (settings.indexRecords) {
+        return indexInputRecords(settings) ? 0 : 1;
+    }
+    if (settings.readRecords) {
+        return printRecords(settings) ? 0 : 1;
+    }
+    std::vector<FileJob> jobs;
+    bool succeeded = true;
+    for (const std::string& source : settings.inputs) {
+        FileJob job{source, ""};
+        if (destinationFor(settings, source, job.destination)) {
+            jobs.push_back(std::move(job));
+        } else {
+            succeeded = false;
+        }
+    }
+
+    CompressionStats compressionStats;
+    DecompressionStats decompressionStats;
+    size_t processed = 0;
+    const auto collect = [&](const FileResult& result) {
+        if (!result.succeeded) {
+            std::cerr << "Error: " << result.error << std::endl;
+            succeeded = false;
+            return;
+        }
+        ++processed;
+        compressionStats.add(result.compressionStats);
+        decompressionStats.add(result.decompressionStats);
+    };
+
+    if (jobs.size() == 1 || threadCount == 1) {
+        // 2a. A single file, or a single thread: code on this thread, the file's blocks spread
+        //     over the coder's own pool
+        compressionOptions.threadCount = threadCount;
+        decompressionOptions.threadCount = threadCount;
+        HuffmanEncoder encoder(compressionOptions);
+        HuffmanDecoder decoder(decompressionOptions);
+        for (const FileJob& job : jobs) {
+            collect(processFile(job, settings.compress, settings.overwrite, encoder, decoder));
+        }
+    } else {
+        // 2b. A batch: one file per task on a shared pool; each worker keeps an encoder and a
+        //     decoder for every file it takes, so their buffers are reused. They code on the same
+        //     pool, so a file of many blocks becomes block tasks that idle workers steal, while a
+        //     small file stays a single task. Results are collected in order with at most two
+        //     files per thread in flight.
+        ThreadPool threadPool(threadCount);
+        std::deque<std::future<FileResult>> pendingFiles;
+        const size_t maxFilesInFlight = 2 * size_t(threadCount);
+        for (const FileJob& job : jobs) {
+            pendingFiles.push_back(threadPool.submit([&job, &settings, &compressionOptions, &decompressionOptions, &threadPool] {
+                thread_local HuffmanEncoder encoder(compressionOptions, threadPool);
+                thread_local HuffmanDecoder decoder(decompressionOptions, threadPool);
+                return processFile(job, settings.compress, settings.overwrite, encoder, decoder);
+            }));
+            if (pendingFiles.size() >= maxFilesInFlight) {
+                collect(pendingFiles.front().get());
+                pendingFiles.pop_front();
+            }
+        }
+        while (!pendingFiles.empty()) {
+            collect(pendingFiles.front().get());
+            pendingFiles.pop_front();
+        }
+    }
+
+    // 3. Report on standard error when standard output carries the data
+    std::ostream& report = jobs.size() == 1 && jobs.front().destination == kStandardStream ? std::cerr : std::cout;
+    if (!settings.quiet && jobs.size() > 1) {
+        report << (settings.compress ? "Compressed " : "Decompressed ") << processed << " of " << jobs.size() << " files" << std::endl;
+    }
+    if (settings.stats) {
+        if (settings.compress) {
+            printStats(compressionStats, report);
+        } else {
+            printStats(decompressionStats, report);
+        }
+    }
+    return succeeded ? 0 : 1;
+}
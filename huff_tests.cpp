@@ -0,0 +1,712 @@
+// huff_tests: self-checking tests of the coder, run as one program with no dependencies beyond the
+// library. Each test prints how many cases it ran and the first few that failed; the run fails if
+// any did.
+//
+//   huff_tests [--filter TEXT]
+//
+// The tests cover:
+//   - round trips of a generated corpus over every combination of the coding options, on one and
+//     several threads, through buffers and files
+//   - the streaming coders, fed and drained in fragments of random size
+//   - random access through HuffmanArchive::decodeRange, against slices of the input
+//   - record lookups through readRecords, against the input's records
+//   - corrupt containers, which every decoder must reject cleanly rather than crash on or, when the
+//     container has checksums, decode to the wrong bytes
+//   - package-merge against unlimited optimal codes
+//   - the in-place code length builder against the node-heap tree builder it replaced, which is
+//     kept here as the reference
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <queue>
+#include <random>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "code_lengths.h"
+#include "histogram.h"
+#include "huffman_decoder.h"
+#include "huffman_encoder.h"
+#include "huffman_format.h"
+#include "record_index.h"
+
+namespace {
+
+// Failures printed per test; the rest are only counted.
+constexpr uint64_t kMaxReportedFailures = 10;
+
+// Corrupted copies made of each container in the corruption sweep
+constexpr unsigned kMutantsPerContainer = 300;
+
+// Histograms compared by the code length tests
+constexpr unsigned kPackageMergeHistograms = 2000;
+constexpr unsigned kTreeBuilderHistograms = 200000;
+
+// The tree builder computeCodeLengths replaced: a min-heap of nodes merged into a flat-array
+// tree, whose leaf depths are the code lengths. Kept as the reference for optimal lengths.
+namespace reference {
+
+constexpr uint16_t kNoChild = 0xFFFF;
+
+struct HuffmanNode {
+    uint64_t frequency;
+    uint16_t left;
+    uint16_t right;
+    uint8_t character;
+};
+
+class HuffmanTree {
+public:
+    // Builds the tree and returns the index of its root, or kNoChild if no symbol occurs.
+    uint16_t build(const ByteHistogram& frequencies) {
+        const auto heavier = [this](uint16_t a, uint16_t b) { return nodes[a].frequency > nodes[b].frequency; };
+        nodeCount = 0;
+        size_t heapSize = 0;
+        for (unsigned symbol = 0; symbol < 256; ++symbol) {
+            if (frequencies[symbol] > 0) {
+                nodes[nodeCount] = {frequencies[symbol], kNoChild, kNoChild, static_cast<uint8_t>(symbol)};
+                heap[heapSize++] = nodeCount++;
+                std::push_heap(heap.begin(), heap.begin() + heapSize, heavier);
+            }
+        }
+        if (heapSize == 0) {
+            return kNoChild;
+        }
+        while (heapSize > 1) {
+            std::pop_heap(heap.begin(), heap.begin() + heapSize--, heavier);
+            const uint16_t leftChild = heap[heapSize];
+            std::pop_heap(heap.begin(), heap.begin() + heapSize--, heavier);
+            const uint16_t rightChild = heap[heapSize];
+            nodes[nodeCount] = {nodes[leftChild].frequency + nodes[rightChild].frequency, leftChild, rightChild, 0};
+            heap[heapSize++] = nodeCount++;
+            std::push_heap(heap.begin(), heap.begin() + heapSize, heavier);
+        }
+        return heap[0];
+    }
+
+    const HuffmanNode& operator[](uint16_t index) const { return nodes[index]; }
+
+private:
+    std::array<HuffmanNode, 511> nodes;
+    std::array<uint16_t, 256> heap;
+    uint16_t nodeCount = 0;
+};
+
+// Records the depth of every leaf; false if one is deeper than kMaxCodeLength.
+bool collectCodeLengths(const HuffmanTree& tree, uint16_t node, CodeLengths& codeLengths, unsigned depth) {
+    if (node == kNoChild) {
+        return true;
+    }
+    const HuffmanNode& current = tree[node];
+    if (current.left == kNoChild) {
+        codeLengths[current.character] = static_cast<uint8_t>(depth ? depth : 1);
+        return depth <= kMaxCodeLength;
+    }
+    return collectCodeLengths(tree, current.left, codeLengths, depth + 1) &&
+           collectCodeLengths(tree, current.right, codeLengths, depth + 1);
+}
+
+// The optimal code lengths of a histogram, through the tree; false if a code is too long.
+bool computeCodeLengths(const ByteHistogram& frequencies, CodeLengths& codeLengths) {
+    HuffmanTree tree;
+    codeLengths.fill(0);
+    return collectCodeLengths(tree, tree.build(frequencies), codeLengths, 0);
+}
+
+} // namespace reference
+
+// The cases one test ran and the ones that failed
+class TestRun {
+public:
+    explicit TestRun(std::string testName) : name(std::move(testName)) {}
+
+    // Counts a case; `describe` names it and is only called if it failed.
+    template <typename Describe>
+    void check(bool passed, const Describe& describe) {
+        ++cases;
+        if (!passed && ++failures <= kMaxReportedFailures) {
+            std::cout << "  FAIL " << name << ": " << describe() << std::endl;
+        }
+    }
+
+    uint64_t caseCount() const { return cases; }
+    uint64_t failureCount() const { return failures; }
+
+private:
+    std::string name;
+    uint64_t cases = 0;
+    uint64_t failures = 0;
+};
+
+// An input of the test corpus
+struct TestInput {
+    std::string name;
+    std::vector<uint8_t> bytes;
+    uint8_t delimiter = '\n'; // Ends the input's records
+};
+
+// Lines like a service log: a timestamp, a level, a few fields of varying width.
+std::vector<uint8_t> generateLog(size_t size, uint64_t seed) {
+    static const char* const levels[] = {"INFO", "WARN", "DEBUG", "ERROR"};
+    static const char* const paths[] = {"/api/v3/items", "/api/v3/users", "/health", "/static/app.js", "/login"};
+    std::mt19937_64 random(seed);
+    std::vector<uint8_t> data;
+    char line[160];
+    for (unsigned number = 0; data.size() < size; ++number) {
+        // Drawn one statement at a time: the order of a call's arguments is unspecified
+        const char* const level = levels[random() % 4];
+        const unsigned service = static_cast<unsigned>(random() % 8);
+        const char* const path = paths[random() % 5];
+        const unsigned latencyLimit = random() % 8 ? 400 : 40000;
+        const unsigned latency = static_cast<unsigned>(random() % latencyLimit);
+        const int length = std::snprintf(line, sizeof(line), "2026-10-14 %02u:%02u:%02u %s svc-%u request id=%u path=%s latency=%ums\n",
+                                         number / 3600 % 24, number / 60 % 60, number % 60, level, service, number, path, latency);
+        data.insert(data.end(), line, line + length);
+    }
+    data.resize(size);
+    return data;
+}
+
+// Bytes whose rank r is drawn with probability proportional to 1 / (r + 1).
+std::vector<uint8_t> generateZipf(size_t size, uint64_t seed) {
+    std::mt19937_64 random(seed);
+    std::array<double, 256> weights;
+    for (size_t rank = 0; rank < weights.size(); ++rank) {
+        weights[rank] = 1.0 / static_cast<double>(rank + 1);
+    }
+    std::discrete_distribution<int> rank(weights.begin(), weights.end());
+    std::vector<uint8_t> data(size);
+    for (uint8_t& byte : data) {
+        byte = static_cast<uint8_t>(rank(random));
+    }
+    return data;
+}
+
+std::vector<uint8_t> generateRandom(size_t size, uint64_t seed) {
+    std::mt19937_64 random(seed);
+    std::vector<uint8_t> data(size);
+    for (uint8_t& byte : data) {
+        byte = static_cast<uint8_t>(random());
+    }
+    return data;
+}
+
+/**
+ * @brief Builds the corpus: empty and one-byte inputs, a long run, random and skewed bytes, a log,
+ * and a mix of random bytes, zeros and text.
+ */
+std::vector<TestInput> generateCorpus() {
+    std::vector<TestInput> corpus;
+    corpus.push_back({"empty", {}});
+    corpus.push_back({"byte", {'a'}});
+    corpus.push_back({"run", std::vector<uint8_t>(70000, 'x')});
+    corpus.push_back({"random", generateRandom(100000, 1)});
+    corpus.push_back({"zipf", generateZipf(150000, 2), 0});
+    corpus.push_back({"log", generateLog(200000, 3)});
+    std::vector<uint8_t> mixed = generateRandom(30000, 4);
+    mixed.insert(mixed.end(), 30000, 0);
+    const std::vector<uint8_t> text = generateLog(60000, 5);
+    mixed.insert(mixed.end(), text.begin(), text.end());
+    corpus.push_back({"mixed", std::move(mixed)});
+    return corpus;
+}
+
+const TestInput& findInput(const std::vector<TestInput>& corpus, const std::string& name) {
+    return *std::find_if(corpus.begin(), corpus.end(), [&](const TestInput& input) { return input.name == name; });
+}
+
+// An input's records, each ending with the delimiter except perhaps the last.
+std::vector<std::span<const uint8_t>> splitRecords(const std::vector<uint8_t>& data, uint8_t delimiter) {
+    std::vector<std::span<const uint8_t>> records;
+    size_t start = 0;
+    for (size_t i = 0; i < data.size(); ++i) {
+        if (data[i] == delimiter) {
+            records.push_back(std::span<const uint8_t>(data).subspan(start, i + 1 - start));
+            start = i + 1;
+        }
+    }
+    if (start < data.size()) {
+        records.push_back(std::span<const uint8_t>(data).subspan(start));
+    }
+    return records;
+}
+
+// Appends to `variants` a copy of each of them with `change` applied.
+void addVariants(std::vector<CompressionOptions>& variants, const std::function<void(CompressionOptions&)>& change) {
+    const size_t count = variants.size();
+    for (size_t i = 0; i < count; ++i) {
+        variants.push_back(variants[i]);
+        change(variants.back());
+    }
+}
+
+std::string describeOptions(const std::string& input, const CompressionOptions& options) {
+    std::string description = input + " -b " + std::to_string(options.blockSize) + " -L " + std::to_string(options.maxCodeLength);
+    description += options.interleaveStreams ? "" : " no-interleave";
+    description += options.checksums ? "" : " -n";
+    description += options.contextTables ? " -x " + std::to_string(options.contextTables) : "";
+    return description;
+}
+
+void testRoundTrips(const std::vector<TestInput>& corpus, TestRun& run) {
+    // 1. Every input through every combination of the coding options, on one and three threads
+    std::vector<CompressionOptions> variants;
+    for (const uint32_t blockSize : {777u, 4096u, 65536u, kDefaultBlockSize}) {
+        for (const unsigned maxCodeLength : {0u, 9u, 12u}) {
+            variants.emplace_back();
+            variants.back().blockSize = blockSize;
+            variants.back().maxCodeLength = maxCodeLength;
+        }
+    }
+    addVariants(variants, [](CompressionOptions& options) { options.interleaveStreams = false; });
+    addVariants(variants, [](CompressionOptions& options) { options.checksums = false; });
+    addVariants(variants, [](CompressionOptions& options) { options.contextTables = 4; });
+    unsigned combination = 0;
+    for (const TestInput& input : corpus) {
+        for (CompressionOptions options : variants) {
+            options.threadCount = ++combination % 2 ? 1 : 3;
+            DecompressionOptions decompressionOptions;
+            decompressionOptions.threadCount = combination % 3 + 1;
+            HuffmanEncoder encoder(options);
+            HuffmanDecoder decoder(decompressionOptions);
+            std::vector<uint8_t> encoded;
+            std::vector<uint8_t> decoded;
+            const bool encodedOk = encoder.encode(input.bytes, encoded);
+            const bool decodedOk = encodedOk && decoder.decode(encoded, decoded);
+            run.check(decodedOk && decoded == input.bytes,
+                      [&] { return describeOptions(input.name, options) + ": " + (encodedOk ? decoder.error() : encoder.error()); });
+        }
+    }
+
+    // 2. Files, through the mapped and buffered paths
+    const std::filesystem::path directory = std::filesystem::temp_directory_path();
+    const std::string rawPath = (directory / "huff_tests.raw").string();
+    const std::string encodedPath = (directory / "huff_tests.raw.huff").string();
+    const std::string decodedPath = (directory / "huff_tests.out").string();
+    for (const char* name : {"empty", "log", "mixed"}) {
+        const TestInput& input = findInput(corpus, name);
+        std::ofstream(rawPath, std::ios::binary).write(reinterpret_cast<const char*>(input.bytes.data()), input.bytes.size());
+        CompressionOptions options;
+        options.blockSize = 16384;
+        HuffmanEncoder encoder(options);
+        HuffmanDecoder decoder;
+        const bool succeeded = encoder.encodeFile(rawPath, encodedPath) && decoder.decodeFile(encodedPath, decodedPath);
+        std::ifstream decodedFile(decodedPath, std::ios::binary);
+        const std::vector<uint8_t> decoded((std::istreambuf_iterator<char>(decodedFile)), {});
+        run.check(succeeded && decoded == input.bytes, [&] { return std::string(name) + " through files: " + encoder.error() + decoder.error(); });
+    }
+    std::error_code ignored;
+    for (const std::string& path : {rawPath, encodedPath, decodedPath}) {
+        std::filesystem::remove(path, ignored);
+    }
+
+    // 3. Invalid options are refused
+    std::vector<CompressionOptions> invalidOptions;
+    invalidOptions.emplace_back().blockSize = 0;
+    invalidOptions.emplace_back().blockSize = kMaxBlockSize + 1;
+    invalidOptions.emplace_back().maxCodeLength = 7;
+    invalidOptions.emplace_back().maxCodeLength = kMaxCodeLength + 1;
+    invalidOptions.emplace_back().contextTables = 1;
+    invalidOptions.emplace_back().contextTables = kMaxContextTables + 1;
+    for (const CompressionOptions& options : invalidOptions) {
+        HuffmanEncoder encoder(options);
+        std::vector<uint8_t> encoded;
+        run.check(!encoder.encode(findInput(corpus, "log").bytes, encoded) && !encoder.error().empty(),
+                  [&] { return "accepted invalid options " + describeOptions("log", options); });
+    }
+}
+
+void testStreaming(const std::vector<TestInput>& corpus, TestRun& run) {
+    std::mt19937_64 random(9);
+    for (const TestInput& input : corpus) {
+        for (const uint32_t blockSize : {1000u, 65536u}) {
+            CompressionOptions options;
+            options.blockSize = blockSize;
+            HuffmanStreamEncoder streamEncoder(options);
+            HuffmanStreamDecoder streamDecoder;
+            // Two containers per coder, so each is also checked after finish() resets it
+            for (int container = 0; container < 2; ++container) {
+                // 1. Feed the input in fragments of random size, flushing now and then
+                std::vector<uint8_t> encoded;
+                bool fed = true;
+                for (size_t position = 0; position < input.bytes.size();) {
+                    const size_t size = std::min<size_t>(input.bytes.size() - position, random() % 3 ? random() % 5000 : random() % 300000);
+                    fed = streamEncoder.feed(std::span<const uint8_t>(input.bytes).subspan(position, size), encoded) && fed;
+                    position += size;
+                    if (random() % 4 == 0) {
+                        fed = streamEncoder.flush(encoded) && fed;
+                    }
+                }
+                fed = streamEncoder.finish(encoded) && fed;
+                HuffmanDecoder decoder;
+                std::vector<uint8_t> decoded;
+                run.check(fed && decoder.decode(encoded, decoded) && decoded == input.bytes,
+                          [&] { return input.name + " stream-encoded, -b " + std::to_string(blockSize) + ": " + streamEncoder.error() + decoder.error(); });
+
+                // 2. Decode it in fragments of random size, down to single bytes
+                decoded.clear();
+                bool consumed = true;
+                for (size_t position = 0; consumed && position < encoded.size();) {
+                    const size_t size = std::min<size_t>(encoded.size() - position, random() % 2 ? random() % 7 : random() % 100000);
+                    consumed = streamDecoder.feed(std::span<const uint8_t>(encoded).subspan(position, size), decoded);
+                    position += size;
+                }
+                run.check(consumed && streamDecoder.finish() && decoded == input.bytes,
+                          [&] { return input.name + " stream-decoded, -b " + std::to_string(blockSize) + ": " + streamDecoder.error(); });
+
+                // 3. A truncated container, or one with trailing bytes, is rejected
+                std::vector<uint8_t> ignored;
+                streamDecoder.feed(std::span<const uint8_t>(encoded).first(encoded.size() - 1), ignored);
+                run.check(!streamDecoder.finish(), [&] { return input.name + " truncated stream accepted"; });
+                encoded.push_back(1);
+                const bool trailingAccepted = streamDecoder.feed(encoded, ignored);
+                run.check(!(streamDecoder.finish() && trailingAccepted), [&] { return input.name + " trailing bytes accepted"; });
+            }
+        }
+    }
+}
+
+void testDecodeRange(const std::vector<TestInput>& corpus, TestRun& run) {
+    std::vector<CompressionOptions> variants(2);
+    variants[0].blockSize = 4096;
+    variants[1].blockSize = 65536;
+    addVariants(variants, [](CompressionOptions& options) { options.interleaveStreams = false; });
+    std::mt19937_64 random(5);
+    for (const TestInput& input : corpus) {
+        for (const CompressionOptions& options : variants) {
+            HuffmanEncoder encoder(options);
+            std::vector<uint8_t> encoded;
+            HuffmanArchive archive;
+            const bool opened = encoder.encode(input.bytes, encoded) && archive.open(std::span<const uint8_t>(encoded));
+            run.check(opened && archive.size() == input.bytes.size(), [&] { return describeOptions(input.name, options) + ": " + archive.error(); });
+            if (!opened) {
+                continue;
+            }
+
+            // 1. Random ranges, mostly short, against slices of the input
+            std::vector<uint8_t> range;
+            const uint64_t size = input.bytes.size();
+            for (int i = 0; i < 100; ++i) {
+                const uint64_t offset = random() % (size + 1);
+                uint64_t length = random() % (size - offset + 1);
+                length = i % 3 ? std::min<uint64_t>(length, 5000) : length;
+                const bool decoded = archive.decodeRange(offset, length, range);
+                run.check(decoded && std::equal(range.begin(), range.end(), input.bytes.begin() + offset, input.bytes.begin() + offset + length) &&
+                              range.size() == length,
+                          [&] { return describeOptions(input.name, options) + " range " + std::to_string(offset) + "+" + std::to_string(length) + ": " + archive.error(); });
+            }
+
+            // 2. Ranges past the end are refused
+            run.check(!archive.decodeRange(size, 1, range) && !archive.decodeRange(0, size + 1, range),
+                      [&] { return input.name + " range past the end accepted"; });
+        }
+    }
+}
+
+void testRecords(const std::vector<TestInput>& corpus, TestRun& run) {
+    std::mt19937_64 random(1);
+    std::vector<TestInput> inputs;
+    for (const char* name : {"empty", "log", "zipf", "mixed"}) {
+        inputs.push_back(findInput(corpus, name));
+    }
+    inputs.push_back({"newlines", std::vector<uint8_t>(5000, '\n')});
+    inputs.push_back({"unterminated", findInput(corpus, "log").bytes});
+    inputs.back().bytes.resize(inputs.back().bytes.size() - 17);
+    std::vector<CompressionOptions> variants(2);
+    variants[0].blockSize = 1000;
+    variants[1].blockSize = 65536;
+    addVariants(variants, [](CompressionOptions& options) { options.contextTables = 4; });
+
+    for (const TestInput& input : inputs) {
+        const std::vector<std::span<const uint8_t>> expected = splitRecords(input.bytes, input.delimiter);
+        const uint64_t recordCount = expected.size();
+        for (const CompressionOptions& options : variants) {
+            HuffmanEncoder encoder(options);
+            std::vector<uint8_t> encoded;
+            HuffmanArchive archive;
+            if (!encoder.encode(input.bytes, encoded) || !archive.open(std::span<const uint8_t>(encoded))) {
+                run.check(false, [&] { return describeOptions(input.name, options) + ": " + encoder.error() + archive.error(); });
+                continue;
+            }
+            for (const uint32_t interval : {1u, 7u, 64u}) {
+                // 1. Build the index and take it through the sidecar layout
+                RecordIndex built;
+                RecordIndex records;
+                std::vector<uint8_t> sidecar;
+                const bool indexed = archive.buildRecordIndex(input.delimiter, interval, built);
+                writeRecordIndex(built, sidecar);
+                run.check(indexed && readRecordIndex(sidecar.data(), sidecar.size(), records) && records.recordCount == recordCount,
+                          [&] { return describeOptions(input.name, options) + " -r " + std::to_string(interval) + ": " + archive.error(); });
+
+                // 2. Random runs of records, and both ends, against the input's records
+                std::vector<std::pair<uint64_t, uint64_t>> queries = {{0, std::min<uint64_t>(1, recordCount)}, {0, recordCount}, {recordCount, 0}};
+                if (recordCount != 0) {
+                    queries.push_back({recordCount - 1, 1});
+                }
+                for (int i = 0; i < 12; ++i) {
+                    const uint64_t first = random() % (recordCount + 1);
+                    queries.push_back({first, random() % (std::min<uint64_t>(50, recordCount - first) + 1)});
+                }
+                std::vector<uint8_t> output;
+                for (const auto& [first, count] : queries) {
+                    std::vector<uint8_t> slice;
+                    for (uint64_t record = first; record < first + count; ++record) {
+                        slice.insert(slice.end(), expected[record].begin(), expected[record].end());
+                    }
+                    run.check(archive.readRecords(records, first, count, output) && output == slice, [&] {
+                        return describeOptions(input.name, options) + " -r " + std::to_string(interval) + " records " + std::to_string(first) + ":" +
+                               std::to_string(count) + ": " + archive.error();
+                    });
+                }
+                run.check(!archive.readRecords(records, recordCount, 1, output), [&] { return input.name + " record past the end accepted"; });
+            }
+        }
+    }
+
+    // 3. An index left over from an earlier version of the archive is refused, even when the
+    //    versions have the same histograms and so the same sizes: two bytes swap places
+    const std::vector<uint8_t>& log = findInput(corpus, "log").bytes;
+    std::vector<uint8_t> edited = log;
+    std::swap(edited[0], edited[1]);
+    HuffmanEncoder encoder;
+    std::vector<uint8_t> original;
+    std::vector<uint8_t> changed;
+    HuffmanArchive originalArchive;
+    HuffmanArchive changedArchive;
+    RecordIndex records;
+    std::vector<uint8_t> output;
+    const bool built = encoder.encode(log, original) && encoder.encode(edited, changed) && originalArchive.open(std::span<const uint8_t>(original)) &&
+                       changedArchive.open(std::span<const uint8_t>(changed)) && originalArchive.buildRecordIndex('\n', 64, records);
+    run.check(built && original.size() == changed.size() && !changedArchive.readRecords(records, 0, 1, output),
+              [] { return std::string("stale record index accepted"); });
+}
+
+void testCorruption(const std::vector<TestInput>& corpus, TestRun& run) {
+    // Without checksums a corrupt block may decode to wrong bytes, but should never crash a decoder;
+    // with them, wrong bytes must never be returned as a success. A corrupt file header may drop
+    // the checksum flag, so only containers with an intact header are held to that.
+    std::mt19937_64 random(11);
+    uint64_t wrongButAccepted = 0;
+    for (const bool checksums : {true, false}) {
+        unsigned containerNumber = 0;
+        for (const char* name : {"log", "random", "zipf", "mixed", "run", "log"}) {
+            const TestInput& input = findInput(corpus, name);
+            CompressionOptions options;
+            options.blockSize = 20000;
+            options.checksums = checksums;
+            options.threadCount = 1;
+            options.contextTables = ++containerNumber == 6 ? 4 : 0;
+            HuffmanEncoder encoder(options);
+            std::vector<uint8_t> encoded;
+            encoder.encode(input.bytes, encoded);
+            DecompressionOptions decompressionOptions;
+            decompressionOptions.threadCount = 1 + containerNumber % 3;
+            HuffmanDecoder decoder(decompressionOptions);
+            HuffmanStreamDecoder streamDecoder;
+            std::vector<uint8_t> decoded;
+            for (unsigned mutant = 0; mutant < kMutantsPerContainer; ++mutant) {
+                // 1. Flip a few bits, overwrite a byte, or cut the container short
+                std::vector<uint8_t> corrupt = encoded;
+                switch (mutant % 8) {
+                case 0:
+                    corrupt.resize(random() % corrupt.size());
+                    break;
+                case 1:
+                    corrupt[random() % corrupt.size()] = static_cast<uint8_t>(random());
+                    break;
+                default:
+                    for (unsigned flips = 1 + random() % 4; flips > 0; --flips) {
+                        corrupt[random() % corrupt.size()] ^= static_cast<uint8_t>(1u << (random() % 8));
+                    }
+                }
+                const bool guarded = checksums && corrupt.size() >= kFileHeaderSize && std::equal(encoded.begin(), encoded.begin() + kFileHeaderSize, corrupt.begin());
+
+                // 2. Every decoder either fails or, when guarded by checksums, returns the input
+                const char* wrongDecoder = nullptr;
+                if (decoder.decode(corrupt, decoded) && decoded != input.bytes) {
+                    wrongDecoder = "decoder";
+                }
+                decoded.clear();
+                const bool streamed = streamDecoder.feed(corrupt, decoded);
+                if (streamDecoder.finish() && streamed && decoded != input.bytes) {
+                    wrongDecoder = "stream decoder";
+                }
+                HuffmanArchive archive;
+                if (archive.open(std::span<const uint8_t>(corrupt))) {
+                    const uint64_t offset = archive.size() / 3;
+                    const uint64_t length = std::min<uint64_t>(archive.size() - offset, 30000);
+                    if (archive.decodeRange(offset, length, decoded) &&
+                        (offset + length > input.bytes.size() || !std::equal(decoded.begin(), decoded.end(), input.bytes.begin() + offset))) {
+                        wrongDecoder = "archive";
+                    }
+                    RecordIndex records;
+                    if (archive.buildRecordIndex('\n', 16, records)) {
+                        archive.readRecords(records, records.recordCount / 2, std::min<uint64_t>(records.recordCount / 2, 10), decoded);
+                    }
+                }
+                wrongButAccepted += !checksums && wrongDecoder;
+                run.check(!guarded || !wrongDecoder, [&] {
+                    return std::string(name) + " mutant " + std::to_string(mutant) + ": " + wrongDecoder + " returned wrong bytes";
+                });
+            }
+        }
+    }
+    std::cout << "  " << wrongButAccepted << " corrupt containers without checksums decoded to wrong bytes" << std::endl;
+}
+
+// The payload bits of optimal codes for a histogram, from the classic merge of the two lightest
+// weights: each merge adds one bit to every symbol below it.
+uint64_t optimalBitCount(const ByteHistogram& frequencies) {
+    std::priority_queue<uint64_t, std::vector<uint64_t>, std::greater<uint64_t>> weights;
+    for (const uint64_t frequency : frequencies) {
+        if (frequency > 0) {
+            weights.push(frequency);
+        }
+    }
+    if (weights.size() == 1) {
+        return weights.top(); // A lone symbol still gets a one-bit code
+    }
+    uint64_t bits = 0;
+    while (weights.size() > 1) {
+        const uint64_t lightest = weights.top();
+        weights.pop();
+        const uint64_t merged = lightest + weights.top();
+        weights.pop();
+        bits += merged;
+        weights.push(merged);
+    }
+    return bits;
+}
+
+// A histogram of up to 256 random symbols: small counts, or powers of two up to 2^39.
+ByteHistogram randomHistogram(std::mt19937_64& random, unsigned kind) {
+    ByteHistogram frequencies{};
+    const unsigned symbolCount = 1 + random() % 256;
+    for (unsigned i = 0; i < symbolCount; ++i) {
+        frequencies[random() % 256] = kind % 2 ? uint64_t(1) << (random() % 40) : random() % 1000;
+    }
+    return frequencies;
+}
+
+void testPackageMerge(TestRun& run) {
+    std::mt19937_64 random(3);
+    for (unsigned test = 0; test < kPackageMergeHistograms; ++test) {
+        // 1. With room for every optimal code, package-merge is optimal
+        const ByteHistogram frequencies = randomHistogram(random, test);
+        CodeLengths unlimited;
+        const bool limited = computeLimitedCodeLengths(frequencies, kMaxCodeLength, unlimited);
+        run.check(limited && encodedBitCount(frequencies, unlimited) == optimalBitCount(frequencies),
+                  [&] { return "histogram " + std::to_string(test) + ": 64-bit package-merge is not optimal"; });
+
+        // 2. Tight limits hold, and still give every used symbol a valid prefix code
+        for (const unsigned maxLength : {8u, 11u, 12u, 15u}) {
+            CodeLengths lengths;
+            const bool fits = computeLimitedCodeLengths(frequencies, maxLength, lengths);
+            bool sameSymbols = true;
+            for (unsigned symbol = 0; symbol < 256; ++symbol) {
+                sameSymbols = sameSymbols && (frequencies[symbol] > 0) == (lengths[symbol] > 0);
+            }
+            run.check(fits && sameSymbols && isValidCodeLengths(lengths) && *std::max_element(lengths.begin(), lengths.end()) <= maxLength,
+                      [&] { return "histogram " + std::to_string(test) + ": bad codes at limit " + std::to_string(maxLength); });
+        }
+    }
+}
+
+void testTreeBuilder(TestRun& run) {
+    std::mt19937_64 random(21);
+    for (unsigned test = 0; test < kTreeBuilderHistograms; ++test) {
+        // 1. Random, uniform, power-of-two and Fibonacci histograms; the longest Fibonacci ones
+        //    need codes deeper than kMaxCodeLength, which both builders must refuse
+        ByteHistogram frequencies{};
+        const unsigned symbolCount = 1 + random() % 256;
+        switch (test % 4) {
+        case 0:
+            frequencies = randomHistogram(random, static_cast<unsigned>(random()));
+            break;
+        case 1:
+            for (unsigned i = 0; i < symbolCount; ++i) {
+                frequencies[(i * 167 + test) % 256] = 1 + test % 7;
+            }
+            break;
+        case 2:
+            for (unsigned i = 0; i < symbolCount; ++i) {
+                frequencies[random() % 256] = uint64_t(1) << (random() % 48);
+            }
+            break;
+        default: {
+            uint64_t previous = 1;
+            uint64_t current = 1;
+            for (unsigned i = 0; i < std::min(symbolCount, 70u); ++i) {
+                frequencies[(i * 89 + test) % 256] = current;
+                current += std::exchange(previous, current);
+            }
+        }
+        }
+
+        // 2. Both builders agree on whether the codes fit and on the payload size
+        CodeLengths lengths;
+        CodeLengths expected;
+        const bool built = computeCodeLengths(frequencies, lengths);
+        const bool expectedBuilt = reference::computeCodeLengths(frequencies, expected);
+        run.check(built == expectedBuilt && (!built || (encodedBitCount(frequencies, lengths) == encodedBitCount(frequencies, expected) &&
+                                                        isValidCodeLengths(lengths))),
+                  [&] { return "histogram " + std::to_string(test) + " (kind " + std::to_string(test % 4) + ") differs from the tree builder"; });
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    // 1. Parse the options
+    std::string filter;
+    for (int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        if (argument == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else {
+            std::cerr << "Usage: huff_tests [--filter TEXT]" << std::endl;
+            return 1;
+        }
+    }
+
+    // 2. Run the tests whose names contain the filter
+    const std::vector<TestInput> corpus = generateCorpus();
+    struct Test {
+        const char* name;
+        void (*run)(const std::vector<TestInput>& corpus, TestRun& run);
+    };
+    const Test tests[] = {
+        {"round-trip", testRoundTrips},
+        {"streaming", testStreaming},
+        {"decode-range", testDecodeRange},
+        {"records", testRecords},
+        {"corruption", testCorruption},
+        {"package-merge", [](const std::vector<TestInput>&, TestRun& run) { testPackageMerge(run); }},
+        {"tree-builder", [](const std::vector<TestInput>&, TestRun& run) { testTreeBuilder(run); }},
+    };
+    uint64_t failedTests = 0;
+    for (const Test& test : tests) {
+        if (std::string(test.name).find(filter) == std::string::npos) {
+            continue;
+        }
+        TestRun run(test.name);
+        test.run(corpus, run);
+        std::cout << test.name << ": " << run.caseCount() << " cases, " << (run.failureCount() ? std::to_string(run.failureCount()) + " failed" : "ok")
+                  << std::endl;
+        failedTests += run.failureCount() != 0;
+    }
+    if (failedTests != 0) {
+        std::cerr << "Error: " << failedTests << " tests failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
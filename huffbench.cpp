@@ -0,0 +1,607 @@
+// huffbench: compresses and decompresses a corpus at several block sizes and thread counts and
+// reports throughput, compression ratio, peak memory and the time spent in each encoder phase.
+// It also counts the heap allocations of a warm pass: with the encoder, decoder and buffers
+// reused, coding a block must not allocate, and any allocation per block fails the run.
+//
+//   huffbench [--json] [--quick] [--repeat N] [file...]
+//
+// Without file arguments the built-in corpus is generated in memory: English-like text, binary
+// records, a skewed byte distribution, uniformly random bytes and a set of tiny messages. Every
+// timing is the best of N runs (default 3).
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <new>
+#include <random>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#define HUFFMAN_HAVE_RUSAGE 1
+#else
+#define HUFFMAN_HAVE_RUSAGE 0
+#endif
+
+#include "code_lengths.h"
+#include "compiler.h"
+#include "file_io.h"
+#include "histogram.h"
+#include "huffman_decoder.h"
+#include "huffman_encoder.h"
+#include "huffman_format.h"
+#include "kernels.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Heap allocations made by the process so far, counted by the operator new replacements below
+std::atomic<uint64_t> allocationCount{0};
+
+// Warm passes whose allocations are counted; the fewest is kept, so a buffer one worker grows for
+// the first time does not count against the steady state.
+constexpr unsigned kAllocationPasses = 2;
+
+// One corpus entry. Most entries are a single payload; the tiny entry is many separately coded messages.
+struct CorpusEntry {
+    std::string name;
+    std::vector<std::vector<uint8_t>> payloads;
+
+    uint64_t totalBytes() const {
+        uint64_t total = 0;
+        for (const std::vector<uint8_t>& payload : payloads) {
+            total += payload.size();
+        }
+        return total;
+    }
+};
+
+// Milliseconds spent in each encoder phase for one pass over an entry, on one thread
+struct PhaseTimes {
+    double histogram = 0;
+    double tree = 0;   // Tree build, code lengths and canonical codes
+    double encode = 0; // Packing the codes
+    double write = 0;  // Writing the finished container to a file
+};
+
+// Best throughput of one thread count
+struct ThreadRun {
+    unsigned threads = 0;
+    double compressMBps = 0;
+    double decompressMBps = 0;
+    double allocationsPerBlock = 0; // Heap allocations per block of a warm compress and decompress pass
+};
+
+// Everything measured for one entry at one block size
+struct BenchResult {
+    std::string corpus;
+    uint64_t rawBytes = 0;
+    uint64_t compressedBytes = 0;
+    size_t payloadCount = 0;
+    uint32_t blockSize = 0;
+    PhaseTimes phases;
+    std::vector<ThreadRun> runs;
+    long peakRssKiB = 0;
+};
+
+double elapsedMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Peak resident set size of the process so far, in KiB; 0 where unavailable.
+long peakRssKiB() {
+#if HUFFMAN_HAVE_RUSAGE
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    return static_cast<long>(usage.ru_maxrss / 1024); // Reported in bytes
+#else
+    return static_cast<long>(usage.ru_maxrss);
+#endif
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Generates text from a Zipf-distributed vocabulary of pseudo-words, with punctuation and line breaks.
+ * @param size The number of bytes to generate.
+ * @param random The generator to draw from.
+ */
+std::vector<uint8_t> generateText(size_t size, std::mt19937_64& random) {
+    // 1. Invent a vocabulary whose word lengths roughly follow English
+    static constexpr char letters[] = "etaoinshrdlcumwfgypbvkjxqz";
+    std::vector<std::string> vocabulary(2000);
+    std::geometric_distribution<int> letterRank(0.2);
+    std::uniform_int_distribution<int> wordLength(1, 9);
+    for (std::string& word : vocabulary) {
+        const int length = wordLength(random);
+        for (int i = 0; i < length; ++i) {
+            word += letters[std::min(letterRank(random), 25)];
+        }
+    }
+
+    // 2. Draw words by rank with probability 1 / (rank + 1)
+    std::vector<double> weights(vocabulary.size());
+    for (size_t rank = 0; rank < weights.size(); ++rank) {
+        weights[rank] = 1.0 / static_cast<double>(rank + 1);
+    }
+    std::discrete_distribution<size_t> wordRank(weights.begin(), weights.end());
+    std::uniform_int_distribution<int> punctuation(0, 15);
+
+    std::vector<uint8_t> text;
+    text.reserve(size + 16);
+    bool sentenceStart = true;
+    while (text.size() < size) {
+        const std::string& word = vocabulary[wordRank(random)];
+        for (size_t i = 0; i < word.size(); ++i) {
+            const char c = sentenceStart && i == 0 ? static_cast<char>(word[i] - 'a' + 'A') : word[i];
+            text.push_back(static_cast<uint8_t>(c));
+        }
+        sentenceStart = false;
+        switch (punctuation(random)) {
+        case 0:
+            text.push_back('.');
+            text.push_back('\n');
+            sentenceStart = true;
+            break;
+        case 1:
+            text.push_back('.');
+            text.push_back(' ');
+            sentenceStart = true;
+            break;
+        case 2:
+            text.push_back(',');
+            text.push_back(' ');
+            break;
+        default:
+            text.push_back(' ');
+        }
+    }
+    text.resize(size);
+    return text;
+}
+
+/**
+ * @brief Generates packed little-endian records resembling a table dump: a sequential ID, a small
+ * type code, a float measurement and a flags byte.
+ * @param size The number of bytes to generate.
+ * @param random The generator to draw from.
+ */
+std::vector<uint8_t> generateBinary(size_t size, std::mt19937_64& random) {
+    std::vector<uint8_t> records(size + 16);
+    std::geometric_distribution<int> type(0.4);
+    std::normal_distribution<float> measurement(100.0f, 15.0f);
+    std::bernoulli_distribution flag(0.1);
+    size_t offset = 0;
+    for (uint32_t id = 0; offset < size; ++id) {
+        storeLittleEndian32(id, records.data() + offset);
+        records[offset + 4] = static_cast<uint8_t>(std::min(type(random), 255));
+        records[offset + 5] = 0;
+        const float value = measurement(random);
+        std::memcpy(records.data() + offset + 6, &value, sizeof(value));
+        records[offset + 10] = static_cast<uint8_t>(flag(random) | flag(random) << 3);
+        offset += 11;
+    }
+    records.resize(size);
+    return records;
+}
+
+// Bytes drawn from a geometric distribution, so a few values dominate.
+std::vector<uint8_t> generateSkewed(size_t size, std::mt19937_64& random) {
+    std::vector<uint8_t> bytes(size);
+    std::geometric_distribution<int> value(0.3);
+    for (uint8_t& byte : bytes) {
+        byte = static_cast<uint8_t>(std::min(value(random), 255));
+    }
+    return bytes;
+}
+
+// Uniformly random bytes, which Huffman coding cannot shrink.
+std::vector<uint8_t> generateRandom(size_t size, std::mt19937_64& random) {
+    std::vector<uint8_t> bytes(size);
+    for (size_t i = 0; i + 8 <= size; i += 8) {
+        storeLittleEndian64(random(), bytes.data() + i);
+    }
+    for (size_t i = size - size % 8; i < size; ++i) {
+        bytes[i] = static_cast<uint8_t>(random());
+    }
+    return bytes;
+}
+
+/**
+ * @brief Builds the built-in corpus from a fixed seed, so runs are comparable across machines and builds.
+ * @param entrySize The size of each large entry.
+ */
+std::vector<CorpusEntry> builtInCorpus(size_t entrySize) {
+    std::mt19937_64 random(0x48554646);
+    std::vector<CorpusEntry> corpus;
+    corpus.push_back({"text", {generateText(entrySize, random)}});
+    corpus.push_back({"binary", {generateBinary(entrySize, random)}});
+    corpus.push_back({"skewed", {generateSkewed(entrySize, random)}});
+    corpus.push_back({"random", {generateRandom(entrySize, random)}});
+
+    // Short messages of 16 bytes to 1 KiB, as an RPC or logging workload would produce
+    CorpusEntry tiny{"tiny", {}};
+    std::uniform_int_distribution<size_t> messageSize(16, 1024);
+    for (size_t total = 0; total < entrySize / 8;) {
+        tiny.payloads.push_back(generateText(messageSize(random), random));
+        total += tiny.payloads.back().size();
+    }
+    corpus.push_back(std::move(tiny));
+    return corpus;
+}
+
+/**
+ * @brief Loads a file as a corpus entry.
+ * @param path The path of the file.
+ * @param entry Receives the entry, named after the file.
+ * @return False if the file cannot be read.
+ */
+bool loadCorpusFile(const std::string& path, CorpusEntry& entry) {
+    InputFile inputFile;
+    if (!inputFile.open(path)) {
+        return false;
+    }
+    const uint8_t* data = nullptr;
+    std::vector<uint8_t> storage;
+    std::vector<uint8_t> contents;
+    for (;;) {
+        const size_t size = inputFile.readView(size_t(16) << 20, 0, data, storage);
+        if (size == 0) {
+            break;
+        }
+        contents.insert(contents.end(), data, data + size);
+    }
+    entry.name = std::filesystem::path(path).filename().string();
+    entry.payloads = {std::move(contents)};
+    return true;
+}
+
+/**
+ * @brief Times the encoder phases for one pass over an entry by running the steps of block coding one by one.
+ * @param entry The entry to code.
+ * @param blockSize The block size.
+ * @param container A compressed container of the entry, written to a scratch file to time the write phase.
+ * @param scratchPath The scratch file.
+ */
+PhaseTimes measurePhases(const CorpusEntry& entry, uint32_t blockSize, const std::vector<uint8_t>& container,
+                         const std::string& scratchPath) {
+    PhaseTimes phases;
+    std::vector<uint8_t> packed(static_cast<size_t>(maxEncodedBlockSize(blockSize)));
+    const Kernels& kernels = activeKernels();
+    for (const std::vector<uint8_t>& payload : entry.payloads) {
+        for (size_t blockStart = 0; blockStart < payload.size(); blockStart += blockSize) {
+            const uint8_t* const blockData = payload.data() + blockStart;
+            const size_t size = std::min<size_t>(blockSize, payload.size() - blockStart);
+
+            Clock::time_point start = Clock::now();
+            const ByteHistogram frequencies = computeHistogram(blockData, size);
+            phases.histogram += elapsedMs(start);
+
+            start = Clock::now();
+            CodeLengths codeLengths{};
+            computeCodeLengths(frequencies, codeLengths);
+            HuffmanCodeTable codes{};
+            assignCanonicalCodes(codeLengths, codes);
+            phases.tree += elapsedMs(start);
+
+            start = Clock::now();
+            kernels.packCodes(codes, *std::max_element(codeLengths.begin(), codeLengths.end()), blockData, size, packed.data());
+            phases.encode += elapsedMs(start);
+        }
+    }
+
+    const Clock::time_point start = Clock::now();
+    OutputFile outputFile;
+    if (outputFile.open(scratchPath)) {
+        outputFile.write(container.data(), container.size());
+        outputFile.close();
+    }
+    phases.write = elapsedMs(start);
+    return phases;
+}
+
+// Keeps the smallest of each phase across repeated measurements.
+void keepFastest(PhaseTimes& best, const PhaseTimes& phases) {
+    best.histogram = std::min(best.histogram, phases.histogram);
+    best.tree = std::min(best.tree, phases.tree);
+    best.encode = std::min(best.encode, phases.encode);
+    best.write = std::min(best.write, phases.write);
+}
+
+double megabytesPerSecond(uint64_t bytes, double milliseconds) {
+    return milliseconds > 0 ? static_cast<double>(bytes) / 1e6 / (milliseconds / 1e3) : 0;
+}
+
+/**
+ * @brief Benchmarks one entry at one block size: ratio, phases, and throughput and steady-state
+ * allocations per thread count. Every container is decoded and compared with its input before its
+ * timings are trusted.
+ * @param entry The entry.
+ * @param blockSize The block size.
+ * @param threadCounts The thread counts to run.
+ * @param repeat Runs per measurement; the fastest is kept.
+ * @param scratchPath A scratch file for the write phase.
+ * @param result Receives the measurements.
+ * @return False if coding failed, a round trip did not reproduce the input, or a warm pass allocated.
+ */
+bool benchmarkEntry(const CorpusEntry& entry, uint32_t blockSize, const std::vector<unsigned>& threadCounts,
+                    unsigned repeat, const std::string& scratchPath, BenchResult& result) {
+    result.corpus = entry.name;
+    result.rawBytes = entry.totalBytes();
+    result.payloadCount = entry.payloads.size();
+    result.blockSize = blockSize;
+
+    std::vector<std::vector<uint8_t>> containers(entry.payloads.size());
+    std::vector<uint8_t> decoded;
+    uint64_t blockCount = 0;
+    for (const std::vector<uint8_t>& payload : entry.payloads) {
+        blockCount += std::max<uint64_t>(1, (payload.size() + blockSize - 1) / blockSize);
+    }
+    for (const unsigned threads : threadCounts) {
+        CompressionOptions compressionOptions;
+        compressionOptions.blockSize = blockSize;
+        compressionOptions.threadCount = threads;
+        HuffmanEncoder encoder(compressionOptions);
+        DecompressionOptions decompressionOptions;
+        decompressionOptions.threadCount = threads;
+        HuffmanDecoder decoder(decompressionOptions);
+
+        ThreadRun run{threads, 0, 0};
+        double bestCompressMs = 0;
+        double bestDecompressMs = 0;
+        for (unsigned attempt = 0; attempt < repeat; ++attempt) {
+            Clock::time_point start = Clock::now();
+            for (size_t i = 0; i < entry.payloads.size(); ++i) {
+                if (!encoder.encode(entry.payloads[i], containers[i])) {
+                    std::cerr << "Error: " << entry.name << ": " << encoder.error() << std::endl;
+                    return false;
+                }
+            }
+            const double compressMs = elapsedMs(start);
+
+            start = Clock::now();
+            for (size_t i = 0; i < entry.payloads.size(); ++i) {
+                if (!decoder.decode(containers[i], decoded)) {
+                    std::cerr << "Error: " << entry.name << ": " << decoder.error() << std::endl;
+                    return false;
+                }
+                if (attempt == 0 && decoded != entry.payloads[i]) {
+                    std::cerr << "Error: " << entry.name << ": Round trip changed the data" << std::endl;
+                    return false;
+                }
+            }
+            const double decompressMs = elapsedMs(start);
+
+            bestCompressMs = attempt == 0 ? compressMs : std::min(bestCompressMs, compressMs);
+            bestDecompressMs = attempt == 0 ? decompressMs : std::min(bestDecompressMs, decompressMs);
+        }
+        run.compressMBps = megabytesPerSecond(result.rawBytes, bestCompressMs);
+        run.decompressMBps = megabytesPerSecond(result.rawBytes, bestDecompressMs);
+
+        // Count the allocations of warm passes, which reuse the coders and every buffer
+        uint64_t fewestAllocations = UINT64_MAX;
+        for (unsigned pass = 0; pass < kAllocationPasses; ++pass) {
+            const uint64_t before = allocationCount.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < entry.payloads.size(); ++i) {
+                if (!encoder.encode(entry.payloads[i], containers[i]) || !decoder.decode(containers[i], decoded)) {
+                    std::cerr << "Error: " << entry.name << ": Coding failed on a warm pass" << std::endl;
+                    return false;
+                }
+            }
+            fewestAllocations = std::min(fewestAllocations, allocationCount.load(std::memory_order_relaxed) - before);
+        }
+        run.allocationsPerBlock = static_cast<double>(fewestAllocations) / static_cast<double>(blockCount);
+        result.runs.push_back(run);
+        if (fewestAllocations != 0) {
+            std::cerr << "Error: " << entry.name << ": " << run.allocationsPerBlock << " heap allocations per block at "
+                      << threads << " threads in the steady state" << std::endl;
+            return false;
+        }
+    }
+
+    result.compressedBytes = 0;
+    std::vector<uint8_t> concatenated;
+    for (const std::vector<uint8_t>& container : containers) {
+        result.compressedBytes += container.size();
+        concatenated.insert(concatenated.end(), container.begin(), container.end());
+    }
+    for (unsigned attempt = 0; attempt < repeat; ++attempt) {
+        const PhaseTimes phases = measurePhases(entry, blockSize, concatenated, scratchPath);
+        if (attempt == 0) {
+            result.phases = phases;
+        } else {
+            keepFastest(result.phases, phases);
+        }
+    }
+    result.peakRssKiB = peakRssKiB();
+    return true;
+}
+
+double compressionRatio(const BenchResult& result) {
+    return result.compressedBytes ? static_cast<double>(result.rawBytes) / static_cast<double>(result.compressedBytes) : 0;
+}
+
+void printTable(const std::vector<BenchResult>& results) {
+    std::printf("%-10s %10s %6s %8s %8s | %8s %8s %8s %8s | %9s %9s %9s | %9s\n", "corpus", "bytes", "block", "ratio",
+                "threads", "hist ms", "tree ms", "enc ms", "write ms", "comp MB/s", "dec MB/s", "alloc/blk", "peak KiB");
+    for (const BenchResult& result : results) {
+        for (size_t i = 0; i < result.runs.size(); ++i) {
+            const ThreadRun& run = result.runs[i];
+            if (i == 0) {
+                std::printf("%-10s %10llu %5uK %8.3f %8u | %8.2f %8.2f %8.2f %8.2f | %9.1f %9.1f %9.2f | %9ld\n",
+                            result.corpus.c_str(), static_cast<unsigned long long>(result.rawBytes),
+                            result.blockSize >> 10, compressionRatio(result), run.threads, result.phases.histogram,
+                            result.phases.tree, result.phases.encode, result.phases.write, run.compressMBps,
+                            run.decompressMBps, run.allocationsPerBlock, result.peakRssKiB);
+            } else {
+                std::printf("%-10s %10s %6s %8s %8u | %8s %8s %8s %8s | %9.1f %9.1f %9.2f |\n", "", "", "", "", run.threads, "",
+                            "", "", "", run.compressMBps, run.decompressMBps, run.allocationsPerBlock);
+            }
+        }
+    }
+}
+
+// Writes a string as a JSON string literal.
+void printJsonString(const std::string& text) {
+    std::putchar('"');
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            std::printf("\\%c", c);
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            std::printf("\\u%04x", static_cast<unsigned>(c));
+        } else {
+            std::putchar(c);
+        }
+    }
+    std::putchar('"');
+}
+
+void printJson(const std::vector<BenchResult>& results, unsigned repeat) {
+    std::printf("{\n  \"kernels\": ");
+    printJsonString(activeKernels().name);
+    std::printf(",\n  \"hardwareThreads\": %u,\n  \"repeat\": %u,\n  \"results\": [", std::thread::hardware_concurrency(),
+                repeat);
+    for (size_t r = 0; r < results.size(); ++r) {
+        const BenchResult& result = results[r];
+        std::printf("%s\n    {\"corpus\": ", r ? "," : "");
+        printJsonString(result.corpus);
+        std::printf(", \"rawBytes\": %llu, \"payloads\": %zu, \"blockSize\": %u, \"compressedBytes\": %llu, \"ratio\": %.4f,\n",
+                    static_cast<unsigned long long>(result.rawBytes), result.payloadCount, result.blockSize,
+                    static_cast<unsigned long long>(result.compressedBytes), compressionRatio(result));
+        std::printf("     \"phasesMs\": {\"histogram\": %.3f, \"tree\": %.3f, \"encode\": %.3f, \"write\": %.3f},\n",
+                    result.phases.histogram, result.phases.tree, result.phases.encode, result.phases.write);
+        std::printf("     \"runs\": [");
+        for (size_t i = 0; i < result.runs.size(); ++i) {
+            const ThreadRun& run = result.runs[i];
+            std::printf("%s{\"threads\": %u, \"compressMBps\": %.1f, \"decompressMBps\": %.1f, \"allocationsPerBlock\": %.3f}",
+                        i ? ", " : "", run.threads, run.compressMBps, run.decompressMBps, run.allocationsPerBlock);
+        }
+        std::printf("],\n     \"peakRssKiB\": %ld}", result.peakRssKiB);
+    }
+    std::printf("\n  ]\n}\n");
+}
+
+} // namespace
+
+// Counting replacements of the global allocation functions; the aligned forms are left alone, as
+// the coders never use over-aligned types.
+void* operator new(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept {
+    return operator new(size, tag);
+}
+
+HUFFMAN_NOINLINE void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+HUFFMAN_NOINLINE void operator delete[](void* memory) noexcept {
+    std::free(memory);
+}
+
+HUFFMAN_NOINLINE void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+HUFFMAN_NOINLINE void operator delete[](void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+int main(int argc, char** argv) {
+    // 1. Parse the options; remaining arguments are corpus files
+    bool json = false;
+    bool quick = false;
+    unsigned repeat = 3;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        if (argument == "--json") {
+            json = true;
+        } else if (argument == "--quick") {
+            quick = true;
+        } else if (argument == "--repeat" && i + 1 < argc) {
+            repeat = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        } else if (argument.starts_with("--")) {
+            std::cerr << "Usage: huffbench [--json] [--quick] [--repeat N] [file...]" << std::endl;
+            return 1;
+        } else {
+            paths.push_back(argument);
+        }
+    }
+
+    // 2. Build or load the corpus
+    std::vector<CorpusEntry> corpus;
+    if (paths.empty()) {
+        corpus = builtInCorpus(quick ? size_t(2) << 20 : size_t(16) << 20);
+    }
+    for (const std::string& path : paths) {
+        CorpusEntry entry;
+        if (!loadCorpusFile(path, entry)) {
+            std::cerr << "Error: Could not open input file " << path << std::endl;
+            return 1;
+        }
+        corpus.push_back(std::move(entry));
+    }
+
+    // 3. Sweep block sizes and thread counts: one thread, two, and every hardware thread
+    const std::vector<uint32_t> blockSizes = quick ? std::vector<uint32_t>{uint32_t(1) << 16, kDefaultBlockSize}
+                                                   : std::vector<uint32_t>{uint32_t(1) << 16, kDefaultBlockSize, uint32_t(4) << 20};
+    std::vector<unsigned> threadCounts = {1, 2, std::max(1u, std::thread::hardware_concurrency())};
+    std::sort(threadCounts.begin(), threadCounts.end());
+    threadCounts.erase(std::unique(threadCounts.begin(), threadCounts.end()), threadCounts.end());
+
+    const std::string scratchPath =
+        (std::filesystem::temp_directory_path() / ("huffbench-" + std::to_string(Clock::now().time_since_epoch().count()) + ".huff")).string();
+    std::vector<BenchResult> results;
+    bool succeeded = true;
+    for (const CorpusEntry& entry : corpus) {
+        for (const uint32_t blockSize : blockSizes) {
+            BenchResult result;
+            if (!benchmarkEntry(entry, blockSize, threadCounts, repeat, scratchPath, result)) {
+                succeeded = false;
+                continue;
+            }
+            results.push_back(std::move(result));
+        }
+    }
+    std::error_code ignored;
+    std::filesystem::remove(scratchPath, ignored);
+
+    // 4. Report
+    if (json) {
+        printJson(results, repeat);
+    } else {
+        std::printf("kernels: %s, best of %u\n", activeKernels().name, repeat);
+        printTable(results);
+    }
+    return succeeded ? 0 : 1;
+}
@@ -0,0 +1,255 @@
+#ifndef HUFFMAN_DECODER_H
+#define HUFFMAN_DECODER_H
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "async_io.h"
+#include "decode_table.h"
+#include "file_io.h"
+#include "huffman_dictionary.h"
+#include "huffman_format.h"
+#include "huffman_stats.h"
+#include "record_index.h"
+#include "table_header.h"
+
+class ThreadPool;
+struct BlockTable;
+struct DecodedBlock;
+struct EncodedBlock;
+
+// Tuning knobs for HuffmanDecoder and huffmanDecodeFile
+struct DecompressionOptions {
+    unsigned threadCount = 0;    // Decoder threads; 0 means one per hardware thread
+    bool verifyChecksums = true; // Check every block against its checksum, when the container has them
+    bool asyncIo = true;         // Read files ahead of the pool and write behind it (io_uring, or an I/O thread)
+    bool collectStats = false;   // Gather DecompressionStats; huffmanDecodeFile also prints them
+};
+
+// Decompresses .huff containers from files or memory buffers. A decoder keeps its thread pool
+// and scratch buffers between calls, and each thread keeps its decode table, so decoding many
+// small payloads with one instance avoids repeating that setup. One decoder must not be used by
+// two threads at once.
+class HuffmanDecoder {
+public:
+    explicit HuffmanDecoder(const DecompressionOptions& options = {});
+
+    /**
+     * @brief Creates a decoder that decodes blocks on a pool shared with other work, like the
+     * matching HuffmanEncoder constructor; options.threadCount is ignored.
+     * @param options The options.
+     * @param sharedPool The pool, which must outlive the decoder.
+     */
+    HuffmanDecoder(const DecompressionOptions& options, ThreadPool& sharedPool);
+    ~HuffmanDecoder();
+    HuffmanDecoder(const HuffmanDecoder&) = delete;
+    HuffmanDecoder& operator=(const HuffmanDecoder&) = delete;
+
+    /**
+     * @brief Decompresses a container held in memory.
+     * @param input The compressed container.
+     * @param output Receives the decoded bytes, replacing its contents; left empty on failure.
+     * @return False on failure; error() describes it.
+     */
+    bool decode(std::span<const uint8_t> input, std::vector<uint8_t>& output);
+
+    /**
+     * @brief Decompresses a file.
+     * @param sourcePath The path to the compressed input file.
+     * @param destinationPath The path where the decompressed output file will be saved.
+     * @return False on failure; error() describes it.
+     */
+    bool decodeFile(const std::string& sourcePath, const std::string& destinationPath);
+
+    /**
+     * @brief Decompresses an open input, such as standard input, to an open output.
+     * @param inputFile The compressed input, positioned at its start.
+     * @param outputFile The destination of the decoded bytes; left open.
+     * @return False on failure; error() describes it.
+     */
+    bool decode(InputFile& inputFile, OutputFile& outputFile);
+
+    // Description of the last failure.
+    const std::string& error() const { return lastError; }
+
+    // Counters and phase times of the last call; all zero unless options.collectStats is set.
+    const DecompressionStats& stats() const { return lastStats; }
+
+private:
+    bool decodeBlocks(InputFile& inputFile, OutputFile& outputFile);
+
+    DecompressionOptions options;
+    unsigned threadCount;
+    std::unique_ptr<ThreadPool> threadPool; // Started on the first input with more than one block
+    ThreadPool* sharedPool = nullptr;       // Used instead of threadPool when given
+    AsyncIo readIo;                         // Read-ahead of unmapped inputs
+    AsyncIo writeIo;                        // Write-behind of unmapped outputs
+    std::vector<uint8_t> blockStorage;      // Encoded bytes that could not be viewed in place
+    std::vector<uint8_t> decodedBlock;      // Blocks decoded on the calling thread
+    std::vector<std::unique_ptr<DecodedBlock>> blockSlots; // Reused for the blocks in flight on the pool
+    BlockIndex blockIndex;
+    std::string lastError;
+    DecompressionStats lastStats;
+};
+
+// Decompresses a container that arrives in arbitrarily fragmented pieces, such as network reads.
+// Each block is decoded as soon as its last byte arrives, so at most one block of compressed
+// input is buffered.
+class HuffmanStreamDecoder {
+public:
+    /**
+     * @brief Consumes the next piece of the container and appends the bytes of every block it completes.
+     * @param chunk The next compressed bytes, of any length.
+     * @param output The buffer the decoded bytes are appended to.
+     * @return False if the data is invalid; error() describes it and later calls fail until finish().
+     */
+    bool feed(std::span<const uint8_t> chunk, std::vector<uint8_t>& output);
+
+    /**
+     * @brief Ends the container and resets the decoder for the next one.
+     * @return False if the container was incomplete or invalid; error() describes it.
+     */
+    bool finish();
+
+    // Whether the block index footer of the container has been read and verified.
+    bool isComplete() const { return state == State::Complete; }
+
+    // Description of the last failure.
+    const std::string& error() const { return lastError; }
+
+private:
+    enum class State { FileHeader, BlockHeader, BlockData, Footer, Complete, Failed };
+
+    bool consume(const uint8_t* data, std::vector<uint8_t>& output);
+    bool verifyFooter(const uint8_t* footer);
+
+    State state = State::FileHeader;
+    std::vector<uint8_t> pending;    // Bytes of the next unit, followed by kDecodePadding bytes when decoding
+    size_t pendingStart = 0;
+    size_t needed = kFileHeaderSize; // Bytes the current state needs
+    uint32_t blockSize = 0;
+    uint8_t fileFlags = 0;           // From the file header; checksums are always verified
+    uint32_t rawSize = 0;            // Of the block being read
+    uint64_t bytesRead = 0;          // Container bytes consumed so far
+    BlockIndex blockIndex;           // Where each decoded block was found, checked against the footer
+    TableContext tables;             // The previous table of the current table group
+    std::string lastError;
+};
+
+// Random access to the decoded contents of a .huff container through its block index footer
+class HuffmanArchive {
+public:
+    /**
+     * @brief Opens a compressed file and loads its block index.
+     * @param sourcePath The path to the compressed file.
+     * @return False if the file cannot be read or has no valid index; error() describes it.
+     */
+    bool open(const std::string& sourcePath);
+
+    /**
+     * @brief Opens a compressed container held in memory, which must outlive the archive's use of it.
+     * @param data The compressed container.
+     * @return False if the container has no valid header or index; error() describes it.
+     */
+    bool open(std::span<const uint8_t> data);
+
+    // Total number of decoded bytes in the archive.
+    uint64_t size() const { return index.rawSize; }
+
+    /**
+     * @brief Decodes `length` bytes starting at decoded `offset`, touching only the blocks that overlap the range.
+     * @param offset The first decoded byte to return.
+     * @param length The number of bytes to return.
+     * @param output Receives the decoded bytes.
+     * @return False if the range lies outside the archive or a block is corrupt; error() describes it.
+     */
+    bool decodeRange(uint64_t offset, uint64_t length, std::vector<uint8_t>& output);
+
+    /**
+     * @brief Decodes the whole archive, verifying its checksums, and builds its record index.
+     * @param delimiter The byte that ends every record.
+     * @param interval Records between checkpoints, at least 1.
+     * @param records Receives the record index.
+     * @return False if a block is corrupt; error() describes it.
+     */
+    bool buildRecordIndex(uint8_t delimiter, uint32_t interval, RecordIndex& records);
+
+    /**
+     * @brief Decodes `count` records starting at record `first`, from the checkpoint before it.
+     * In a Huffman block decoding starts at the checkpoint's bit offset and stops once the
+     * records are complete, so a lookup costs about `interval` records rather than a block; other
+     * blocks are decoded whole. Block checksums cover whole blocks, so only blocks decoded whole
+     * are verified.
+     * @param records The archive's record index.
+     * @param first The first record to return.
+     * @param count The number of records to return.
+     * @param output Receives the records' bytes, delimiters included.
+     * @return False if the index was built for another archive, or another version of this one,
+     *         the records lie outside it or a block is corrupt; error() describes it.
+     */
+    bool readRecords(const RecordIndex& records, uint64_t first, uint64_t count, std::vector<uint8_t>& output);
+
+    // Description of the last failure.
+    const std::string& error() const { return lastError; }
+
+private:
+    bool loadIndex();
+    bool readIndexedBlock(uint64_t blockNumber, EncodedBlock& block, BlockTable& table);
+    bool computeArchiveChecksum(uint32_t& checksum);
+
+    InputFile inputFile;
+    uint32_t blockSize = 0;
+    uint8_t fileFlags = 0; // From the file header; checksums are always verified
+    BlockIndex index;
+    TableContext tables;                   // Of the group of the last block read by readIndexedBlock
+    uint64_t nextTableBlock = UINT64_MAX;  // The block whose table `tables` is ready for
+    bool archiveChecksumKnown = false;     // Whether archiveChecksum holds the open archive's
+    uint32_t archiveChecksum = 0;          // Identifies the archive to its record index
+    std::vector<uint8_t> blockStorage;
+    std::vector<uint8_t> decodedBlock;
+    std::string lastError;
+};
+
+// Decodes messages written by HuffmanMessageEncoder. Decode tables are built once, when a
+// dictionary is registered, and reused by every message that references it.
+class HuffmanMessageDecoder {
+public:
+    /**
+     * @brief Registers a dictionary and builds its decode table, replacing any earlier one with the same ID.
+     * @param dictionary The dictionary.
+     * @return False if its code lengths are invalid; error() describes it.
+     */
+    bool addDictionary(const HuffmanDictionary& dictionary);
+
+    /**
+     * @brief Decodes one message.
+     * @param message The coded message.
+     * @param output Receives the decoded bytes, replacing its contents; left empty on failure.
+     * @return False if the dictionary is unknown or the message is corrupt; error() describes it.
+     */
+    bool decode(std::span<const uint8_t> message, std::vector<uint8_t>& output);
+
+    // Description of the last failure.
+    const std::string& error() const { return lastError; }
+
+private:
+    std::unordered_map<uint32_t, DecodeTable> tables;
+    std::vector<uint8_t> payload; // The message's codes followed by kDecodePadding zero bytes
+    std::string lastError;
+};
+
+/**
+ * @brief Decompresses a file and reports the result on the console.
+ * @param sourcePath The path to the compressed input file.
+ * @param destinationPath The path where the decompressed output file will be saved.
+ * @param options Thread count and whether to print stats.
+ * @return False if decompression failed.
+ */
+bool huffmanDecodeFile(const std::string& sourcePath, const std::string& destinationPath,
+                       const DecompressionOptions& options = {});
+
+#endif // HUFFMAN_DECODER_H
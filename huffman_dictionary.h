@@ -0,0 +1,111 @@
+#ifndef HUFFMAN_DICTIONARY_H
+#define HUFFMAN_DICTIONARY_H
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "code_lengths.h"
+#include "file_io.h"
+#include "histogram.h"
+#include "huffman_format.h"
+
+// Longest code a trained dictionary uses by default: every code then resolves in one lookup of the
+// decoder's 11-bit primary table.
+constexpr unsigned kDefaultDictionaryCodeLength = 11;
+
+// A code table trained offline and shared by both sides, referenced from messages by its ID
+struct HuffmanDictionary {
+    uint32_t id = 0;
+    CodeLengths codeLengths{};
+};
+
+/**
+ * @brief Trains a dictionary from sample messages.
+ * Every byte value gets a code, so messages may contain bytes the samples never did.
+ * @param samples Representative messages.
+ * @param id The ID messages will use to reference the dictionary.
+ * @param maxCodeLength The longest code allowed, 8..kMaxCodeLength.
+ * @param dictionary Receives the trained dictionary.
+ * @return False if maxCodeLength is out of range.
+ */
+inline bool trainDictionary(const std::vector<std::span<const uint8_t>>& samples, uint32_t id, unsigned maxCodeLength,
+                            HuffmanDictionary& dictionary) {
+    // Start every count at one so that unseen bytes remain codable
+    ByteHistogram frequencies;
+    frequencies.fill(1);
+    for (const std::span<const uint8_t> sample : samples) {
+        accumulateHistogram(sample.data(), sample.size(), frequencies);
+    }
+    dictionary.id = id;
+    return maxCodeLength >= 8 && maxCodeLength <= kMaxCodeLength &&
+           computeLimitedCodeLengths(frequencies, maxCodeLength, dictionary.codeLengths);
+}
+
+/**
+ * @brief Appends the serialized form of a dictionary.
+ * @param dictionary The dictionary.
+ * @param output The buffer receiving the dictionary.
+ */
+inline void writeDictionary(const HuffmanDictionary& dictionary, std::vector<uint8_t>& output) {
+    output.insert(output.end(), kDictionaryMagic, kDictionaryMagic + 4);
+    output.resize(output.size() + 4);
+    storeLittleEndian32(dictionary.id, output.data() + output.size() - 4);
+    writeCodeLengths(dictionary.codeLengths, output);
+}
+
+/**
+ * @brief Parses a dictionary written by writeDictionary.
+ * @param input The serialized dictionary.
+ * @param dictionary Receives the dictionary.
+ * @return False if the magic is missing, the code lengths are invalid or bytes are left over.
+ */
+inline bool readDictionary(std::span<const uint8_t> input, HuffmanDictionary& dictionary) {
+    if (input.size() < kDictionaryHeaderSize) {
+        return false;
+    }
+    for (int i = 0; i < 4; ++i) {
+        if (input[i] != kDictionaryMagic[i]) {
+            return false;
+        }
+    }
+    dictionary.id = loadLittleEndian32(input.data() + 4);
+    const uint8_t* cursor = input.data() + kDictionaryHeaderSize;
+    const uint8_t* const end = input.data() + input.size();
+    return readCodeLengths(cursor, end, dictionary.codeLengths) && cursor == end &&
+           isValidCodeLengths(dictionary.codeLengths);
+}
+
+/**
+ * @brief Saves a dictionary to a file.
+ * @param dictionary The dictionary.
+ * @param path The path of the file to create.
+ * @return False if the file cannot be written.
+ */
+inline bool saveDictionary(const HuffmanDictionary& dictionary, const std::string& path) {
+    std::vector<uint8_t> serialized;
+    writeDictionary(dictionary, serialized);
+    OutputFile outputFile;
+    return outputFile.open(path) && outputFile.write(serialized.data(), serialized.size()) && outputFile.close();
+}
+
+/**
+ * @brief Loads a dictionary saved by saveDictionary.
+ * @param path The path of the dictionary file.
+ * @param dictionary Receives the dictionary.
+ * @return False if the file cannot be read or is not a valid dictionary.
+ */
+inline bool loadDictionary(const std::string& path, HuffmanDictionary& dictionary) {
+    InputFile inputFile;
+    if (!inputFile.open(path)) {
+        return false;
+    }
+    // A dictionary is at most the header plus 256 (length, run) pairs
+    const uint8_t* data = nullptr;
+    std::vector<uint8_t> storage;
+    const size_t size = inputFile.readView(kDictionaryHeaderSize + 512 + 1, 0, data, storage);
+    return readDictionary(std::span<const uint8_t>(data, size), dictionary);
+}
+
+#endif // HUFFMAN_DICTIONARY_H
@@ -0,0 +1,245 @@
+#ifndef HUFFMAN_ENCODER_H
+#define HUFFMAN_ENCODER_H
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "async_io.h"
+#include "huffman_dictionary.h"
+#include "huffman_format.h"
+#include "huffman_stats.h"
+#include "table_header.h"
+
+class InputFile;
+class OutputFile;
+class ThreadPool;
+struct CompressedBlock;
+
+// Tuning knobs for HuffmanEncoder and huffmanEncodeFile
+struct CompressionOptions {
+    uint32_t blockSize = kDefaultBlockSize; // Input bytes per independently coded block
+    unsigned threadCount = 0;               // Encoder threads; 0 means one per hardware thread
+    unsigned maxCodeLength = 0;             // Longest code allowed (8..kMaxCodeLength); 0 means unlimited
+    bool interleaveStreams = true;          // Code Huffman blocks as four streams for faster decoding
+    unsigned contextTables = 0;             // Order-1 mode: code tables picked by the previous byte (2..kMaxContextTables); 0 is off
+    bool checksums = true;                  // End every block with a CRC-32C of its raw bytes
+    bool asyncIo = true;                    // Read files ahead of the pool and write behind it (io_uring, or an I/O thread)
+    bool collectStats = false;              // Gather CompressionStats; huffmanEncodeFile also prints them
+};
+
+// The compressed size HuffmanEncoder::estimateSize predicts for an input
+struct SizeEstimate {
+    uint64_t rawSize = 0;       // Input bytes
+    uint64_t blockCount = 0;    // Blocks of the input
+    uint64_t sampledBlocks = 0; // Blocks that were sized
+    uint64_t sampledBytes = 0;  // Input bytes of the sampled blocks
+    uint64_t sampledSize = 0;   // Coded bytes of the sampled blocks, with their block headers
+    uint64_t estimatedSize = 0; // Predicted container size, the other blocks coding like the sampled ones
+    std::array<uint64_t, kBlockModeCount> blocksByMode{}; // Modes the sampled blocks would be coded in
+
+    // Input bytes per predicted compressed byte; 0 for an empty input.
+    double ratio() const { return estimatedSize && rawSize ? static_cast<double>(rawSize) / static_cast<double>(estimatedSize) : 0; }
+};
+
+// Compresses files or memory buffers into the .huff container format. An encoder keeps its
+// thread pool and scratch buffers between calls, so coding many small payloads with one
+// instance avoids repeating that setup. One encoder must not be used by two threads at once.
+class HuffmanEncoder {
+public:
+    explicit HuffmanEncoder(const CompressionOptions& options = {});
+
+    /**
+     * @brief Creates an encoder that codes blocks on a pool shared with other work, such as the
+     * other encoders of a batch; options.threadCount is ignored. Coding a file from one of the
+     * pool's workers then splits it into block tasks that idle workers steal.
+     * @param options The options.
+     * @param sharedPool The pool, which must outlive the encoder.
+     */
+    HuffmanEncoder(const CompressionOptions& options, ThreadPool& sharedPool);
+    ~HuffmanEncoder();
+    HuffmanEncoder(const HuffmanEncoder&) = delete;
+    HuffmanEncoder& operator=(const HuffmanEncoder&) = delete;
+
+    /**
+     * @brief Compresses a memory buffer.
+     * @param input The bytes to compress.
+     * @param output Receives the complete compressed container, replacing its contents.
+     * @return False on failure; error() describes it.
+     */
+    bool encode(std::span<const uint8_t> input, std::vector<uint8_t>& output);
+
+    /**
+     * @brief Compresses a file.
+     * @param sourcePath The path to the input file to be compressed.
+     * @param destinationPath The path where the compressed output file will be saved.
+     * @return False on failure; error() describes it.
+     */
+    bool encodeFile(const std::string& sourcePath, const std::string& destinationPath);
+
+    /**
+     * @brief Compresses an open input, such as standard input, to an open output.
+     * @param inputFile The input, positioned at its start.
+     * @param outputFile The destination of the container; left open.
+     * @return False on failure; error() describes it.
+     */
+    bool encode(InputFile& inputFile, OutputFile& outputFile);
+
+    /**
+     * @brief Predicts the compressed size of a memory buffer without coding it. Each sampled block
+     * gets its histogram and code lengths, from which the size of every block mode follows, and
+     * the smallest is taken as encode() would; the payload is never packed. Blocks are sized on
+     * the calling thread.
+     * @param input The bytes to size.
+     * @param estimate Receives the prediction.
+     * @param sampleInterval Size every Nth block, starting with the first; 0 and 1 size every block.
+     * @return False if the options are invalid or a code would exceed kMaxCodeLength bits.
+     */
+    bool estimateSize(std::span<const uint8_t> input, SizeEstimate& estimate, unsigned sampleInterval = 1);
+
+    /**
+     * @brief Predicts the compressed size of a file, as estimateSize does for a buffer. Blocks
+     * left out by the sampling are skipped without being read when the input is seekable.
+     * @param sourcePath The path to the input file.
+     * @param estimate Receives the prediction.
+     * @param sampleInterval Size every Nth block; 0 and 1 size every block.
+     * @return False on failure; error() describes it.
+     */
+    bool estimateFile(const std::string& sourcePath, SizeEstimate& estimate, unsigned sampleInterval = 1);
+
+    /**
+     * @brief Predicts the compressed size of an open input, such as standard input.
+     * @param inputFile The input, positioned at its start.
+     * @param estimate Receives the prediction.
+     * @param sampleInterval Size every Nth block; 0 and 1 size every block.
+     * @return False on failure; error() describes it.
+     */
+    bool estimateSize(InputFile& inputFile, SizeEstimate& estimate, unsigned sampleInterval = 1);
+
+    // Description of the last failure.
+    const std::string& error() const { return lastError; }
+
+    // Size in bytes of the last compressed output.
+    uint64_t encodedSize() const { return lastEncodedSize; }
+
+    // Payload bits the code length limit added to the last compressed output.
+    uint64_t lengthLimitCostBits() const { return lastLengthLimitCostBits; }
+
+    // Counters and phase times of the last call; all zero unless options.collectStats is set.
+    const CompressionStats& stats() const { return lastStats; }
+
+private:
+    bool encodeBlocks(InputFile& inputFile, OutputFile& outputFile);
+
+    CompressionOptions options;
+    unsigned threadCount;
+    std::unique_ptr<ThreadPool> threadPool; // Started on the first input with more than one block
+    ThreadPool* sharedPool = nullptr;       // Used instead of threadPool when given
+    AsyncIo readIo;                         // Read-ahead of file inputs
+    AsyncIo writeIo;                        // Write-behind of file outputs
+    std::vector<uint8_t> inputBuffer;       // Input bytes that could not be viewed in place
+    std::vector<uint8_t> blockBuffer;       // Blocks coded on the calling thread
+    std::vector<uint8_t> linkedTable;       // Replacement table header of a pooled block
+    std::vector<std::unique_ptr<CompressedBlock>> blockSlots; // Reused for the blocks in flight on the pool
+    BlockIndex blockIndex;
+    std::string lastError;
+    uint64_t lastEncodedSize = 0;
+    uint64_t lastLengthLimitCostBits = 0;
+    CompressionStats lastStats;
+};
+
+// Compresses a stream that arrives in pieces, such as a response being produced. feed() codes
+// each complete block as soon as its bytes are in; flush() also codes the partial block, so
+// everything fed so far can be decoded from the output; finish() closes the container. Output is
+// appended to the caller's vector, which may be drained between calls. Blocks are coded on the
+// calling thread.
+class HuffmanStreamEncoder {
+public:
+    explicit HuffmanStreamEncoder(const CompressionOptions& options = {});
+
+    /**
+     * @brief Adds input and appends every block it completes to `output`.
+     * @param chunk The next input bytes.
+     * @param output The buffer the compressed bytes are appended to.
+     * @return False on failure; error() describes it.
+     */
+    bool feed(std::span<const uint8_t> chunk, std::vector<uint8_t>& output);
+
+    /**
+     * @brief Codes the buffered partial block, if any, as a short block.
+     * @param output The buffer the compressed bytes are appended to.
+     * @return False on failure; error() describes it.
+     */
+    bool flush(std::vector<uint8_t>& output);
+
+    /**
+     * @brief Flushes and appends the terminator and block index; the next feed() starts a new container.
+     * @param output The buffer the compressed bytes are appended to.
+     * @return False on failure; error() describes it.
+     */
+    bool finish(std::vector<uint8_t>& output);
+
+    // Description of the last failure.
+    const std::string& error() const { return lastError; }
+
+private:
+    bool begin(std::vector<uint8_t>& output);
+    bool writeBlock(const uint8_t* blockData, size_t blockSize, std::vector<uint8_t>& output);
+
+    CompressionOptions options;
+    std::vector<uint8_t> pending; // Input of the current partial block
+    BlockIndex blockIndex;
+    uint64_t bytesWritten = 0;    // Container bytes emitted so far
+    TableContext tables;          // The previous table of the current table group
+    bool started = false;
+    std::string lastError;
+};
+
+// Codes small messages with pre-trained dictionaries, so a message costs no frequency pass, no
+// tree build and no stored code table: just an 8-byte header and the packed codes.
+class HuffmanMessageEncoder {
+public:
+    /**
+     * @brief Registers a dictionary, replacing any earlier one with the same ID.
+     * @param dictionary The dictionary.
+     * @return False if its code lengths are invalid; error() describes it.
+     */
+    bool addDictionary(const HuffmanDictionary& dictionary);
+
+    /**
+     * @brief Codes one message with a registered dictionary.
+     * @param dictionaryId The ID of the dictionary to use.
+     * @param message The bytes to compress.
+     * @param output Receives the coded message, replacing its contents.
+     * @return False if the dictionary is unknown or lacks a code for a byte of the message; error() describes it.
+     */
+    bool encode(uint32_t dictionaryId, std::span<const uint8_t> message, std::vector<uint8_t>& output);
+
+    // Description of the last failure.
+    const std::string& error() const { return lastError; }
+
+private:
+    struct CodeTable {
+        HuffmanCodeTable codes;
+        unsigned maxLength = 0;
+    };
+
+    std::unordered_map<uint32_t, CodeTable> tables;
+    std::string lastError;
+};
+
+/**
+ * @brief Compresses a file using the Huffman coding algorithm and reports the result on the console.
+ * @param sourcePath The path to the input file to be compressed.
+ * @param destinationPath The path where the compressed output file will be saved.
+ * @param options Block size, thread count, code length limit and whether to print stats.
+ * @return False if compression failed.
+ */
+bool huffmanEncodeFile(const std::string& sourcePath, const std::string& destinationPath,
+                       const CompressionOptions& options = {});
+
+#endif // HUFFMAN_ENCODER_H
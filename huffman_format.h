@@ -0,0 +1,384 @@
+#ifndef HUFFMAN_FORMAT_H
+#define HUFFMAN_FORMAT_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Layout of a .huff file (all integers little-endian):
+//   file header:  magic "HUFF" | version (1 byte) | flags (1 byte) | block size (4 bytes)
+//   blocks:       raw size (4 bytes) | encoded size (4 bytes) | encoded bytes | checksum (4 bytes, with kChecksumFlag)
+//   terminator:   a block header with raw size 0 and encoded size 0
+//   block index:  per block, file offset of its header (8 bytes) | offset of its first raw byte (8 bytes)
+//   trailer:      index offset (8 bytes) | block count (8 bytes) | raw size (8 bytes) | magic "HIDX"
+// The encoded bytes of a block start with its BlockMode. A Huffman block continues with a table
+// header holding its code lengths (see table_header.h), followed by its canonical codes packed
+// MSB-first and zero-padded to a whole byte; a stored block with its raw bytes; a run-length
+// block with (byte, varint run - 1) pairs (see run_length.h). An interleaved Huffman block splits
+// the raw bytes into four equal segments (the last takes the remainder), each coded as its own
+// padded stream: table header | jump table of the byte sizes of streams 1-3 (4 bytes each) | streams.
+// A table header may code its lengths against the previous Huffman block's within a group of
+// kTableAnchorInterval blocks, so decoding can start at any group; the payloads of all blocks
+// decode independently once their tables are read in order.
+// A context Huffman block codes each byte with one of several tables, picked by the byte before
+// it (see context_model.h); it is split into streams like an interleaved block:
+//   table count (1 byte) | table of every previous byte (4 bits each, the even byte in the high
+//   nibble) | table headers | jump table | streams
+// Each stream starts as if preceded by a zero byte.
+// With kChecksumFlag set, each block ends with the CRC-32C of its raw bytes (crc32c.h), counted in
+// its encoded size; the terminator has none.
+// A block holds at most the block size; a shorter block may end the input or a stream flush.
+constexpr uint8_t kFileMagic[4] = {'H', 'U', 'F', 'F'};
+constexpr uint8_t kFormatVersion = 7;
+constexpr size_t kFileHeaderSize = 10;
+constexpr size_t kBlockHeaderSize = 8;
+
+// File header flags
+constexpr uint8_t kChecksumFlag = 0x01; // Every block ends with a checksum of its raw bytes
+constexpr uint8_t kKnownFileFlags = kChecksumFlag;
+constexpr size_t kBlockChecksumSize = 4;
+
+constexpr uint8_t kIndexMagic[4] = {'H', 'I', 'D', 'X'};
+constexpr size_t kIndexEntrySize = 16;
+constexpr size_t kIndexTrailerSize = 28;
+
+constexpr uint32_t kDefaultBlockSize = uint32_t(1) << 20;
+constexpr uint32_t kMaxBlockSize = uint32_t(64) << 20;
+
+// Small messages coded with a pre-trained dictionary skip the container and the per-block table:
+//   message:      dictionary ID (4 bytes) | raw size (4 bytes) | canonical codes packed MSB-first
+// A dictionary is saved as:
+//   dictionary:   magic "HDIC" | dictionary ID (4 bytes) | code lengths as (length, run - 1) byte pairs
+constexpr size_t kMessageHeaderSize = 8;
+constexpr uint8_t kDictionaryMagic[4] = {'H', 'D', 'I', 'C'};
+constexpr size_t kDictionaryHeaderSize = 8;
+
+// Codes are held in 64-bit integers. Within a block of at most kMaxBlockSize bytes no code can
+// exceed 38 bits, since a code of depth d needs at least Fibonacci(d + 2) symbols.
+constexpr unsigned kMaxCodeLength = 64;
+
+// How a block's bytes are represented; the encoder picks the smallest for each block.
+enum class BlockMode : uint8_t {
+    Huffman = 0,
+    Stored = 1,   // Incompressible data, copied as is
+    RunLength = 2, // Long runs of equal bytes, such as a single repeated byte
+    InterleavedHuffman = 3, // Four independent streams that decode in parallel
+    ContextHuffman = 4      // Interleaved streams, each byte coded with a table chosen by the byte before it
+};
+constexpr size_t kBlockModeCount = 5;
+
+constexpr unsigned kInterleavedStreamCount = 4;
+constexpr size_t kJumpTableSize = 4 * (kInterleavedStreamCount - 1);
+
+// Smaller Huffman blocks keep a single stream; the jump table would cost more than it gains.
+constexpr size_t kMinInterleavedBlockSize = 4096;
+
+// Order-1 context modeling: the 256 previous-byte contexts share at most kMaxContextTables code
+// tables, whose codes are limited to 12 bits so each decodes with a single-level table.
+constexpr unsigned kMaxContextTables = 16;
+constexpr unsigned kMaxContextCodeLength = 12;
+constexpr size_t kContextMapSize = 128;
+
+// Smaller blocks rarely repay the extra tables, and the context statistics cost more to gather.
+constexpr size_t kMinContextBlockSize = 16384;
+
+// Raw bytes in each of the first three segments of an interleaved block.
+constexpr size_t interleavedSegmentSize(size_t rawSize) {
+    return (rawSize + kInterleavedStreamCount - 1) / kInterleavedStreamCount;
+}
+
+// Upper bound on a block's encoded size: the mode byte, the table header (at most
+// kMaxTableHeaderSize, under 512 bytes), the jump table and the payload, with a padding byte per
+// stream, and the checksum.
+constexpr uint64_t maxEncodedBlockSize(uint32_t rawSize) {
+    return 1 + 512 + kJumpTableSize + kInterleavedStreamCount + (uint64_t(rawSize) * 38 + 7) / 8 + kBlockChecksumSize;
+}
+
+inline void storeLittleEndian32(uint32_t value, uint8_t* destination) {
+    for (int i = 0; i < 4; ++i) {
+        destination[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+inline uint32_t loadLittleEndian32(const uint8_t* source) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= uint32_t(source[i]) << (8 * i);
+    }
+    return value;
+}
+
+inline void storeLittleEndian64(uint64_t value, uint8_t* destination) {
+    storeLittleEndian32(static_cast<uint32_t>(value), destination);
+    storeLittleEndian32(static_cast<uint32_t>(value >> 32), destination + 4);
+}
+
+inline uint64_t loadLittleEndian64(const uint8_t* source) {
+    return loadLittleEndian32(source) | (uint64_t(loadLittleEndian32(source + 4)) << 32);
+}
+
+// Locates one block in the file and in the decoded output
+struct BlockIndexEntry {
+    uint64_t encodedOffset = 0; // File offset of the block header
+    uint64_t rawOffset = 0;     // Offset of the block's first byte in the decoded output
+};
+
+// The block index footer, as read from the end of a .huff file
+struct BlockIndex {
+    std::vector<BlockIndexEntry> blocks;
+    uint64_t rawSize = 0;
+};
+
+// A Huffman code stored as an integer: the low `length` bits of `bits`, most significant bit first.
+struct HuffmanCode {
+    uint64_t bits = 0;
+    uint8_t length = 0;
+};
+
+using HuffmanCodeTable = std::array<HuffmanCode, 256>;
+
+// Code length of every byte value; 0 marks a symbol that does not occur.
+using CodeLengths = std::array<uint8_t, 256>;
+
+/**
+ * @brief Assigns canonical codes: shorter codes first, and symbols of equal length in byte order.
+ * Only the code lengths need to be stored, since the decoder can rebuild the same codes from them.
+ * @param lengths The code length of every symbol.
+ * @param codes The table receiving the canonical code of every symbol.
+ */
+inline void assignCanonicalCodes(const CodeLengths& lengths, HuffmanCodeTable& codes) {
+    std::array<uint64_t, kMaxCodeLength + 1> lengthCounts{};
+    for (const uint8_t length : lengths) {
+        ++lengthCounts[length];
+    }
+    lengthCounts[0] = 0;
+
+    std::array<uint64_t, kMaxCodeLength + 1> nextCode{};
+    uint64_t code = 0;
+    for (unsigned length = 1; length <= kMaxCodeLength; ++length) {
+        code = (code + lengthCounts[length - 1]) << 1;
+        nextCode[length] = code;
+    }
+    for (unsigned symbol = 0; symbol < 256; ++symbol) {
+        const uint8_t length = lengths[symbol];
+        codes[symbol] = {length ? nextCode[length]++ : 0, length};
+    }
+}
+
+/**
+ * @brief Checks that the code lengths describe a usable prefix code (Kraft sum of at most one).
+ * @param lengths The code length of every symbol.
+ * @return True if every length is in range and the codes do not overlap.
+ */
+inline bool isValidCodeLengths(const CodeLengths& lengths) {
+    // Kraft sum scaled by 2^kMaxCodeLength, accumulated from the longest codes up to avoid overflow
+    std::array<uint64_t, kMaxCodeLength + 1> lengthCounts{};
+    for (const uint8_t length : lengths) {
+        if (length > kMaxCodeLength) {
+            return false;
+        }
+        ++lengthCounts[length];
+    }
+    uint64_t carry = 0;
+    for (unsigned length = kMaxCodeLength; length >= 1; --length) {
+        carry += lengthCounts[length];
+        if (length > 1) {
+            carry = (carry + 1) / 2; // Pairs of codes combine into one slot a level up
+        }
+    }
+    return carry <= 2;
+}
+
+/**
+ * @brief Appends the code lengths as (length, run - 1) pairs, so unused and equal-length runs stay short.
+ * @param lengths The code length of every symbol.
+ * @param output The buffer receiving the encoded table.
+ */
+inline void writeCodeLengths(const CodeLengths& lengths, std::vector<uint8_t>& output) {
+    for (size_t symbol = 0; symbol < lengths.size();) {
+        size_t run = 1;
+        while (symbol + run < lengths.size() && lengths[symbol + run] == lengths[symbol]) {
+            ++run;
+        }
+        output.push_back(lengths[symbol]);
+        output.push_back(static_cast<uint8_t>(run - 1));
+        symbol += run;
+    }
+}
+
+/**
+ * @brief Parses a code-length table written by writeCodeLengths.
+ * @param cursor The read position; advanced past the table on success.
+ * @param end The end of the readable data.
+ * @param lengths Receives the code length of every symbol.
+ * @return False if the table is truncated or overruns 256 symbols.
+ */
+inline bool readCodeLengths(const uint8_t*& cursor, const uint8_t* end, CodeLengths& lengths) {
+    const uint8_t* p = cursor;
+    size_t symbol = 0;
+    while (symbol < lengths.size()) {
+        if (end - p < 2) {
+            return false;
+        }
+        const uint8_t length = p[0];
+        const size_t run = size_t(p[1]) + 1;
+        p += 2;
+        if (symbol + run > lengths.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < run; ++i) {
+            lengths[symbol++] = length;
+        }
+    }
+    cursor = p;
+    return true;
+}
+
+/**
+ * @brief Appends the file magic, format version, flags and block size.
+ * @param blockSize The number of input bytes per block (the last block may be shorter).
+ * @param flags The file header flags, such as kChecksumFlag.
+ * @param output The buffer receiving the header.
+ */
+inline void writeFileHeader(uint32_t blockSize, uint8_t flags, std::vector<uint8_t>& output) {
+    output.insert(output.end(), kFileMagic, kFileMagic + 4);
+    output.push_back(kFormatVersion);
+    output.push_back(flags);
+    output.resize(output.size() + 4);
+    storeLittleEndian32(blockSize, output.data() + output.size() - 4);
+}
+
+/**
+ * @brief Parses the header written by writeFileHeader.
+ * @param cursor The read position; advanced past the header on success.
+ * @param end The end of the readable data.
+ * @param blockSize Receives the number of input bytes per block.
+ * @param flags Receives the file header flags.
+ * @return False if the magic, version, flags or block size is invalid or the header is truncated.
+ */
+inline bool readFileHeader(const uint8_t*& cursor, const uint8_t* end, uint32_t& blockSize, uint8_t& flags) {
+    if (end - cursor < static_cast<std::ptrdiff_t>(kFileHeaderSize)) {
+        return false;
+    }
+    for (int i = 0; i < 4; ++i) {
+        if (cursor[i] != kFileMagic[i]) {
+            return false;
+        }
+    }
+    if (cursor[4] != kFormatVersion || (cursor[5] & ~kKnownFileFlags) != 0) {
+        return false;
+    }
+    flags = cursor[5];
+    blockSize = loadLittleEndian32(cursor + 6);
+    if (blockSize == 0 || blockSize > kMaxBlockSize) {
+        return false;
+    }
+    cursor += kFileHeaderSize;
+    return true;
+}
+
+/**
+ * @brief Writes a block header; raw size 0 marks the end of the blocks.
+ * @param rawSize The number of input bytes in the block.
+ * @param encodedSize The number of encoded bytes that follow the header.
+ * @param destination Receives kBlockHeaderSize bytes.
+ */
+inline void writeBlockHeader(uint32_t rawSize, uint32_t encodedSize, uint8_t* destination) {
+    storeLittleEndian32(rawSize, destination);
+    storeLittleEndian32(encodedSize, destination + 4);
+}
+
+/**
+ * @brief Parses a block header and checks its sizes against the file's block size.
+ * @param source kBlockHeaderSize bytes of header.
+ * @param blockSize The block size from the file header.
+ * @param rawSize Receives the number of input bytes in the block.
+ * @param encodedSize Receives the number of encoded bytes that follow the header.
+ * @return False if the sizes cannot belong to a valid block.
+ */
+inline bool readBlockHeader(const uint8_t* source, uint32_t blockSize, uint32_t& rawSize, uint32_t& encodedSize) {
+    rawSize = loadLittleEndian32(source);
+    encodedSize = loadLittleEndian32(source + 4);
+    if (rawSize == 0) {
+        return encodedSize == 0;
+    }
+    return rawSize <= blockSize && encodedSize <= maxEncodedBlockSize(rawSize);
+}
+
+/**
+ * @brief Appends the block index and the trailer that locates it.
+ * @param index The blocks in file order and the total decoded size.
+ * @param indexOffset The file offset at which the index starts.
+ * @param output The buffer receiving the footer.
+ */
+inline void writeBlockIndex(const BlockIndex& index, uint64_t indexOffset, std::vector<uint8_t>& output) {
+    const size_t start = output.size();
+    output.resize(start + index.blocks.size() * kIndexEntrySize + kIndexTrailerSize);
+    uint8_t* p = output.data() + start;
+    for (const BlockIndexEntry& entry : index.blocks) {
+        storeLittleEndian64(entry.encodedOffset, p);
+        storeLittleEndian64(entry.rawOffset, p + 8);
+        p += kIndexEntrySize;
+    }
+    storeLittleEndian64(indexOffset, p);
+    storeLittleEndian64(index.blocks.size(), p + 8);
+    storeLittleEndian64(index.rawSize, p + 16);
+    for (int i = 0; i < 4; ++i) {
+        p[24 + i] = kIndexMagic[i];
+    }
+}
+
+/**
+ * @brief Parses the trailer at the very end of a .huff file.
+ * @param trailer kIndexTrailerSize bytes read from the end of the file.
+ * @param fileSize The total file size.
+ * @param indexOffset Receives the file offset of the index entries.
+ * @param blockCount Receives the number of index entries.
+ * @param rawSize Receives the total decoded size.
+ * @return False if the magic is missing or the index does not fit before the trailer.
+ */
+inline bool readIndexTrailer(const uint8_t* trailer, uint64_t fileSize, uint64_t& indexOffset,
+                             uint64_t& blockCount, uint64_t& rawSize) {
+    for (int i = 0; i < 4; ++i) {
+        if (trailer[24 + i] != kIndexMagic[i]) {
+            return false;
+        }
+    }
+    indexOffset = loadLittleEndian64(trailer);
+    blockCount = loadLittleEndian64(trailer + 8);
+    rawSize = loadLittleEndian64(trailer + 16);
+    return fileSize >= kIndexTrailerSize && indexOffset <= fileSize - kIndexTrailerSize &&
+           blockCount == (fileSize - kIndexTrailerSize - indexOffset) / kIndexEntrySize &&
+           (fileSize - kIndexTrailerSize - indexOffset) % kIndexEntrySize == 0;
+}
+
+/**
+ * @brief Parses the index entries and checks that they are in increasing order.
+ * @param source The entries as located by readIndexTrailer.
+ * @param blockCount The number of entries.
+ * @param indexOffset The file offset of the entries; every block must start before it.
+ * @param blockSize The block size from the file header; no block may decode to more.
+ * @param index Receives the entries; its rawSize must already be set.
+ * @return False if the entries are out of order or out of range, so that a corrupt index cannot
+ *         make the decoder size its output beyond what the blocks can hold.
+ */
+inline bool readBlockIndexEntries(const uint8_t* source, uint64_t blockCount, uint64_t indexOffset, uint32_t blockSize,
+                                  BlockIndex& index) {
+    index.blocks.resize(static_cast<size_t>(blockCount));
+    for (size_t i = 0; i < index.blocks.size(); ++i) {
+        BlockIndexEntry& entry = index.blocks[i];
+        entry.encodedOffset = loadLittleEndian64(source + i * kIndexEntrySize);
+        entry.rawOffset = loadLittleEndian64(source + i * kIndexEntrySize + 8);
+        const bool ordered = i == 0 ? entry.rawOffset == 0 && entry.encodedOffset >= kFileHeaderSize
+                                    : entry.rawOffset > index.blocks[i - 1].rawOffset &&
+                                          entry.rawOffset - index.blocks[i - 1].rawOffset <= blockSize &&
+                                          entry.encodedOffset > index.blocks[i - 1].encodedOffset + kBlockHeaderSize;
+        if (!ordered || entry.encodedOffset >= indexOffset || entry.rawOffset >= index.rawSize) {
+            return false;
+        }
+    }
+    return index.blocks.empty() ? index.rawSize == 0 : index.rawSize - index.blocks.back().rawOffset <= blockSize;
+}
+
+#endif // HUFFMAN_FORMAT_H
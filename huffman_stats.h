@@ -0,0 +1,182 @@
+#ifndef HUFFMAN_STATS_H
+#define HUFFMAN_STATS_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+#include "huffman_format.h"
+
+// Build with -DHUFFMAN_ENABLE_STATS=0 to compile the counters and timers out entirely; the stats
+// structs remain, so callers build unchanged, but stay zero.
+#ifndef HUFFMAN_ENABLE_STATS
+#define HUFFMAN_ENABLE_STATS 1
+#endif
+
+constexpr bool kStatsEnabled = HUFFMAN_ENABLE_STATS != 0;
+
+// The phases of compression, matching the numbered steps of the encoder
+enum class EncodePhase : unsigned {
+    Read,           // Taking blocks from the input
+    Frequency,      // Counting byte frequencies
+    TreeBuild,      // Computing code lengths from the sorted frequencies
+    CodeGeneration, // Code lengths, the length limit and canonical codes
+    Encode,         // Sizing each representation and choosing the block mode
+    Pack,           // Packing codes, runs or stored bytes into the block
+    Checksum,       // Checksumming the block's raw bytes
+    Write           // Writing blocks and the footer to the output
+};
+constexpr size_t kEncodePhaseCount = 8;
+constexpr const char* kEncodePhaseNames[kEncodePhaseCount] = {"read", "frequency", "tree build", "code generation",
+                                                              "encode", "pack", "checksum", "write"};
+
+// The phases of decompression
+enum class DecodePhase : unsigned {
+    Read,       // Taking encoded blocks from the input
+    TableBuild, // Parsing code lengths and building the decode table
+    Decode,     // Decoding, copying or expanding the payload
+    Verify,     // Checking the decoded bytes against the block checksum
+    Write       // Writing decoded blocks to the output
+};
+constexpr size_t kDecodePhaseCount = 5;
+constexpr const char* kDecodePhaseNames[kDecodePhaseCount] = {"read", "table build", "decode", "verify", "write"};
+
+constexpr const char* kBlockModeNames[kBlockModeCount] = {"huffman", "stored", "run-length", "interleaved", "context"};
+
+// Counters gathered by HuffmanEncoder when CompressionOptions::collectStats is set. Phase times
+// are summed over all threads, so with a thread pool they can exceed the wall-clock time.
+struct CompressionStats {
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+    uint64_t blockCount = 0;
+    std::array<uint64_t, kBlockModeCount> blocksByMode{};
+    std::array<uint64_t, kMaxCodeLength + 1> codeLengthCounts{}; // Byte values given each code length, over all Huffman blocks
+    std::array<uint64_t, kEncodePhaseCount> phaseNanoseconds{};
+
+    // Adds the counters of another set, such as those of one block.
+    void add(const CompressionStats& other) {
+        bytesIn += other.bytesIn;
+        bytesOut += other.bytesOut;
+        blockCount += other.blockCount;
+        for (size_t i = 0; i < blocksByMode.size(); ++i) {
+            blocksByMode[i] += other.blocksByMode[i];
+        }
+        for (size_t i = 0; i < codeLengthCounts.size(); ++i) {
+            codeLengthCounts[i] += other.codeLengthCounts[i];
+        }
+        for (size_t i = 0; i < phaseNanoseconds.size(); ++i) {
+            phaseNanoseconds[i] += other.phaseNanoseconds[i];
+        }
+    }
+};
+
+// Counters gathered by HuffmanDecoder when DecompressionOptions::collectStats is set, with phase
+// times summed over all threads.
+struct DecompressionStats {
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+    uint64_t blockCount = 0;
+    std::array<uint64_t, kBlockModeCount> blocksByMode{};
+    std::array<uint64_t, kDecodePhaseCount> phaseNanoseconds{};
+
+    // Adds the counters of another set, such as those of one block.
+    void add(const DecompressionStats& other) {
+        bytesIn += other.bytesIn;
+        bytesOut += other.bytesOut;
+        blockCount += other.blockCount;
+        for (size_t i = 0; i < blocksByMode.size(); ++i) {
+            blocksByMode[i] += other.blocksByMode[i];
+        }
+        for (size_t i = 0; i < phaseNanoseconds.size(); ++i) {
+            phaseNanoseconds[i] += other.phaseNanoseconds[i];
+        }
+    }
+};
+
+// Charges the time between laps to phase counters. A timer built with no counters, or with
+// stats compiled out, does nothing.
+template <typename Phase, size_t PhaseCount>
+class PhaseTimer {
+public:
+    explicit PhaseTimer(std::array<uint64_t, PhaseCount>* phaseNanoseconds)
+        : phases(kStatsEnabled ? phaseNanoseconds : nullptr) {
+        restart();
+    }
+
+    // Starts timing the next phase without charging the time since the last lap.
+    void restart() {
+        if (kStatsEnabled && phases) {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+
+    // Charges the time since the last lap to `phase` and starts timing the next one.
+    void lap(Phase phase) {
+        if (kStatsEnabled && phases) {
+            const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            (*phases)[static_cast<size_t>(phase)] += static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count());
+            start = now;
+        }
+    }
+
+private:
+    std::array<uint64_t, PhaseCount>* phases;
+    std::chrono::steady_clock::time_point start{};
+};
+
+using EncodePhaseTimer = PhaseTimer<EncodePhase, kEncodePhaseCount>;
+using DecodePhaseTimer = PhaseTimer<DecodePhase, kDecodePhaseCount>;
+
+/**
+ * @brief Prints the phase times and block counts shared by both stats structs.
+ * @param phaseNanoseconds The time spent in each phase.
+ * @param phaseNames The name of each phase.
+ * @param blocksByMode The number of blocks of each mode.
+ * @param out The stream to print to.
+ */
+template <size_t PhaseCount>
+void printPhasesAndModes(const std::array<uint64_t, PhaseCount>& phaseNanoseconds, const char* const (&phaseNames)[PhaseCount],
+                         const std::array<uint64_t, kBlockModeCount>& blocksByMode, std::ostream& out) {
+    out << "  Block modes:";
+    for (size_t mode = 0; mode < kBlockModeCount; ++mode) {
+        out << ' ' << kBlockModeNames[mode] << '=' << blocksByMode[mode];
+    }
+    out << "\n  Phase times (ms, summed over threads):";
+    for (size_t phase = 0; phase < PhaseCount; ++phase) {
+        out << ' ' << phaseNames[phase] << '=' << static_cast<double>(phaseNanoseconds[phase]) / 1e6;
+    }
+    out << '\n';
+}
+
+/**
+ * @brief Prints compression stats as a short human-readable report.
+ * @param stats The stats.
+ * @param out The stream to print to.
+ */
+inline void printStats(const CompressionStats& stats, std::ostream& out) {
+    out << "Stats:\n  Bytes in: " << stats.bytesIn << ", bytes out: " << stats.bytesOut << ", blocks: " << stats.blockCount << '\n';
+    printPhasesAndModes(stats.phaseNanoseconds, kEncodePhaseNames, stats.blocksByMode, out);
+    out << "  Code lengths (bits:symbols):";
+    for (size_t length = 1; length < stats.codeLengthCounts.size(); ++length) {
+        if (stats.codeLengthCounts[length] != 0) {
+            out << ' ' << length << ':' << stats.codeLengthCounts[length];
+        }
+    }
+    out << std::endl;
+}
+
+/**
+ * @brief Prints decompression stats as a short human-readable report.
+ * @param stats The stats.
+ * @param out The stream to print to.
+ */
+inline void printStats(const DecompressionStats& stats, std::ostream& out) {
+    out << "Stats:\n  Bytes in: " << stats.bytesIn << ", bytes out: " << stats.bytesOut << ", blocks: " << stats.blockCount << '\n';
+    printPhasesAndModes(stats.phaseNanoseconds, kDecodePhaseNames, stats.blocksByMode, out);
+    out << std::flush;
+}
+
+#endif // HUFFMAN_STATS_H
@@ -0,0 +1,597 @@
+// huffmicro: microbenchmarks of the coder's kernels, each timed on its own over synthetic inputs:
+// the frequency count, code-length construction, canonical codes, decode table build, code
+// packing and table decoding, plus the whole engine against the original string-based coder,
+// which is kept here as a baseline so the speedup of every engine is measured rather than assumed.
+//
+//   huffmicro [--json] [--quick] [--filter TEXT] [--min-time SECONDS] [--compare BASELINE.json] [--tolerance PERCENT]
+//
+// Benchmarks are named kernel/distribution/size, such as decode/zipf/4M; the table kernels work on
+// the 256 symbol counts alone and have no size. Inputs are uniformly random bytes, Zipf-distributed
+// bytes and a single repeated byte, from 64 B to 64 MiB (256 KiB with --quick). Each benchmark is
+// run in batches that grow until one lasts a quarter of the minimum time, and the fastest of three
+// such batches is kept. --compare reads the --json output of an earlier run and fails the run if a
+// benchmark became slower by more than the tolerance (default 10%).
+
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <queue>
+#include <random>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bit_writer.h"
+#include "code_lengths.h"
+#include "decode_table.h"
+#include "histogram.h"
+#include "huffman_decoder.h"
+#include "huffman_encoder.h"
+#include "huffman_format.h"
+#include "kernels.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Inputs above this size skip the string-based baseline, whose bit string takes 8 bytes per input bit.
+constexpr size_t kMaxBaselineSize = size_t(4) << 20;
+
+// The code length limit of the package-merge benchmark, tight enough to bind on every distribution but one
+constexpr unsigned kLimitedCodeLength = 11;
+
+// Batches timed per benchmark; the fastest counts.
+constexpr unsigned kBatchCount = 3;
+
+// Keeps the compiler from discarding a result the benchmark never reads.
+inline void keepResult(const void* result) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r"(result) : "memory");
+#else
+    static const void* volatile sink;
+    sink = result;
+#endif
+}
+
+// The original coder, kept as the baseline: a pointer tree built with a priority queue, codes
+// held as strings of '0' and '1', the payload built as one bit string and packed through
+// std::bitset, and decoding by walking the tree a bit at a time. It works on memory instead of
+// files, and two fixes keep it correct: it counts the frequencies, which the original skipped,
+// and a lone distinct byte gets a one-bit code rather than an empty one.
+namespace baseline {
+
+struct HuffmanNode {
+    char character;
+    int frequency;
+    HuffmanNode *left, *right;
+
+    HuffmanNode(char c, int freq) : character(c), frequency(freq), left(nullptr), right(nullptr) {}
+};
+
+struct NodeComparator {
+    bool operator()(const HuffmanNode* a, const HuffmanNode* b) const { return a->frequency > b->frequency; }
+};
+
+// The tree of one input; owns its nodes, which the original leaked
+struct HuffmanTree {
+    std::vector<std::unique_ptr<HuffmanNode>> nodes;
+    HuffmanNode* root = nullptr;
+};
+
+void generateHuffmanCodes(HuffmanNode* root, std::unordered_map<char, std::string>& huffmanCodeTable, const std::string& codeInProgress) {
+    if (!root) {
+        return;
+    }
+    if (!root->left && !root->right) {
+        huffmanCodeTable[root->character] = codeInProgress.empty() ? "0" : codeInProgress;
+    }
+    generateHuffmanCodes(root->left, huffmanCodeTable, codeInProgress + "0");
+    generateHuffmanCodes(root->right, huffmanCodeTable, codeInProgress + "1");
+}
+
+/**
+ * @brief Compresses a buffer the way the original huffmanEncodeFile compressed a file.
+ * @param fileData The input.
+ * @param tree Receives the tree, which the original wrote to a .tree file.
+ * @return The padding byte followed by the packed codes.
+ */
+std::string huffmanEncode(const std::string& fileData, HuffmanTree& tree) {
+    std::unordered_map<char, int> frequencyMap;
+    for (const char c : fileData) {
+        ++frequencyMap[c];
+    }
+    std::priority_queue<HuffmanNode*, std::vector<HuffmanNode*>, NodeComparator> minHeap;
+    for (const auto& pair : frequencyMap) {
+        tree.nodes.push_back(std::make_unique<HuffmanNode>(pair.first, pair.second));
+        minHeap.push(tree.nodes.back().get());
+    }
+    while (minHeap.size() > 1) {
+        HuffmanNode* leftChild = minHeap.top();
+        minHeap.pop();
+        HuffmanNode* rightChild = minHeap.top();
+        minHeap.pop();
+        tree.nodes.push_back(std::make_unique<HuffmanNode>('\0', leftChild->frequency + rightChild->frequency));
+        HuffmanNode* parentNode = tree.nodes.back().get();
+        parentNode->left = leftChild;
+        parentNode->right = rightChild;
+        minHeap.push(parentNode);
+    }
+    tree.root = minHeap.empty() ? nullptr : minHeap.top();
+
+    std::unordered_map<char, std::string> huffmanCodeTable;
+    generateHuffmanCodes(tree.root, huffmanCodeTable, "");
+    std::string bitString = "";
+    for (const char& c : fileData) {
+        bitString += huffmanCodeTable[c];
+    }
+    const int paddingBits = (8 - bitString.length() % 8) % 8;
+    std::string output(1, static_cast<char>(paddingBits));
+    for (int i = 0; i < paddingBits; ++i) {
+        bitString += '0';
+    }
+    for (size_t i = 0; i < bitString.length(); i += 8) {
+        std::bitset<8> byte(bitString.substr(i, 8));
+        output.push_back(static_cast<char>(byte.to_ulong()));
+    }
+    return output;
+}
+
+/**
+ * @brief Decompresses the output of huffmanEncode the way the original huffmanDecodeFile did.
+ * @param encoded The padding byte followed by the packed codes.
+ * @param tree The tree the input was coded with.
+ * @return The decoded bytes.
+ */
+std::string huffmanDecode(const std::string& encoded, const HuffmanTree& tree) {
+    std::string output;
+    if (encoded.empty() || !tree.root) {
+        return output;
+    }
+    const int paddingBits = static_cast<int>(encoded[0]);
+    std::string encodedBitString;
+    for (size_t i = 1; i < encoded.size(); ++i) {
+        encodedBitString += std::bitset<8>(static_cast<unsigned char>(encoded[i])).to_string();
+    }
+    encodedBitString.resize(encodedBitString.size() - paddingBits);
+
+    const bool loneSymbol = !tree.root->left && !tree.root->right;
+    const HuffmanNode* currentNode = tree.root;
+    for (const char& bit : encodedBitString) {
+        if (!loneSymbol) {
+            currentNode = (bit == '0') ? currentNode->left : currentNode->right;
+        }
+        if (!currentNode->left && !currentNode->right) {
+            output.push_back(currentNode->character);
+            currentNode = tree.root;
+        }
+    }
+    return output;
+}
+
+} // namespace baseline
+
+// The byte distributions every data kernel runs over
+enum class Distribution { Uniform, Zipf, Single };
+constexpr Distribution kDistributions[] = {Distribution::Uniform, Distribution::Zipf, Distribution::Single};
+
+const char* distributionName(Distribution distribution) {
+    switch (distribution) {
+    case Distribution::Uniform:
+        return "uniform";
+    case Distribution::Zipf:
+        return "zipf";
+    case Distribution::Single:
+        return "single";
+    }
+    return "";
+}
+
+/**
+ * @brief Generates an input: uniformly random bytes, bytes whose rank r is drawn with probability
+ * proportional to 1 / (r + 1), or one byte repeated.
+ * @param distribution The distribution of the bytes.
+ * @param size The number of bytes.
+ */
+std::vector<uint8_t> generateInput(Distribution distribution, size_t size) {
+    std::mt19937_64 random(0x5eed + static_cast<unsigned>(distribution));
+    std::vector<uint8_t> data(size);
+    if (distribution == Distribution::Single) {
+        std::fill(data.begin(), data.end(), 'a');
+    } else if (distribution == Distribution::Uniform) {
+        for (uint8_t& byte : data) {
+            byte = static_cast<uint8_t>(random());
+        }
+    } else {
+        std::array<double, 256> weights;
+        for (size_t rank = 0; rank < weights.size(); ++rank) {
+            weights[rank] = 1.0 / static_cast<double>(rank + 1);
+        }
+        std::discrete_distribution<int> rank(weights.begin(), weights.end());
+        for (uint8_t& byte : data) {
+            byte = static_cast<uint8_t>(rank(random));
+        }
+    }
+    return data;
+}
+
+// A size as a benchmark name shows it: 64, 4K, 16M
+std::string sizeName(size_t size) {
+    if (size >= (size_t(1) << 20) && size % (size_t(1) << 20) == 0) {
+        return std::to_string(size >> 20) + "M";
+    }
+    if (size >= 1024 && size % 1024 == 0) {
+        return std::to_string(size >> 10) + "K";
+    }
+    return std::to_string(size);
+}
+
+// What one benchmark measured
+struct MicroResult {
+    std::string name;
+    uint64_t bytesPerCall = 0; // Input bytes each call processes; 0 for the table kernels
+    double nsPerCall = 0;
+    double baselineNs = 0;     // From --compare; 0 if the baseline run lacks the benchmark
+};
+
+double megabytesPerSecond(const MicroResult& result) {
+    return result.nsPerCall > 0 ? static_cast<double>(result.bytesPerCall) * 1e3 / result.nsPerCall : 0;
+}
+
+// Runs the benchmarks whose names pass the filter and collects their results
+class MicroRunner {
+public:
+    MicroRunner(std::string filter, double minSeconds) : filter(std::move(filter)), minSeconds(minSeconds) {}
+
+    bool wants(const std::string& name) const { return name.find(filter) != std::string::npos; }
+
+    /**
+     * @brief Times a benchmark, unless the filter excludes it.
+     * @param name The benchmark's name.
+     * @param bytesPerCall The input bytes each call processes, for the throughput.
+     * @param call One run of the code under test.
+     */
+    void run(const std::string& name, uint64_t bytesPerCall, const std::function<void()>& call) {
+        if (!wants(name)) {
+            return;
+        }
+        // 1. Grow the batch until it lasts a quarter of the minimum time
+        call();
+        uint64_t iterations = 1;
+        for (;;) {
+            const double seconds = timeBatch(call, iterations);
+            if (seconds >= minSeconds / 4 || iterations >= (uint64_t(1) << 40)) {
+                break;
+            }
+            const double factor = seconds > 0 ? minSeconds / 4 / seconds * 1.2 : 10;
+            iterations = std::max(iterations + 1, static_cast<uint64_t>(static_cast<double>(iterations) * std::min(factor, 10.0)));
+        }
+
+        // 2. Keep the fastest batch
+        double best = timeBatch(call, iterations);
+        for (unsigned batch = 1; batch < kBatchCount; ++batch) {
+            best = std::min(best, timeBatch(call, iterations));
+        }
+        results.push_back({name, bytesPerCall, best * 1e9 / static_cast<double>(iterations), 0});
+    }
+
+    std::vector<MicroResult> results;
+
+private:
+    static double timeBatch(const std::function<void()>& call, uint64_t iterations) {
+        const Clock::time_point start = Clock::now();
+        for (uint64_t i = 0; i < iterations; ++i) {
+            call();
+        }
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    std::string filter;
+    double minSeconds;
+};
+
+/**
+ * @brief Benchmarks the table kernels of one distribution on the symbol counts of a 1 MiB input.
+ * @param distribution The distribution.
+ * @param runner The runner collecting the results.
+ */
+void benchmarkTables(Distribution distribution, MicroRunner& runner) {
+    const std::string suffix = std::string("/") + distributionName(distribution);
+    const std::vector<uint8_t> data = generateInput(distribution, size_t(1) << 20);
+    const ByteHistogram frequencies = computeHistogram(data.data(), data.size());
+    CodeLengths codeLengths{};
+    computeCodeLengths(frequencies, codeLengths);
+    HuffmanCodeTable codes{};
+    assignCanonicalCodes(codeLengths, codes);
+
+    CodeLengths lengths{};
+    runner.run("codelengths" + suffix, 0, [&] {
+        computeCodeLengths(frequencies, lengths);
+        keepResult(lengths.data());
+    });
+    runner.run("codelengths-limited" + suffix, 0, [&] {
+        computeLimitedCodeLengths(frequencies, kLimitedCodeLength, lengths);
+        keepResult(lengths.data());
+    });
+    HuffmanCodeTable canonical{};
+    runner.run("canonical" + suffix, 0, [&] {
+        assignCanonicalCodes(codeLengths, canonical);
+        keepResult(canonical.data());
+    });
+    DecodeTable narrowTable;
+    runner.run("decodetable-narrow" + suffix, 0, [&] {
+        buildDecodeTable(codes, narrowTable, kFlatTableWidths[0]);
+        keepResult(narrowTable.entries.data());
+    });
+    DecodeTable table;
+    runner.run("decodetable" + suffix, 0, [&] {
+        buildDecodeTable(codes, table);
+        keepResult(table.entries.data());
+    });
+}
+
+/**
+ * @brief Benchmarks the data kernels, the engine and the string-based baseline on one input.
+ * @param distribution The distribution of the input.
+ * @param size The input size.
+ * @param runner The runner collecting the results.
+ * @return False if a round trip did not restore the input.
+ */
+bool benchmarkData(Distribution distribution, size_t size, MicroRunner& runner) {
+    const std::string suffix = std::string("/") + distributionName(distribution) + "/" + sizeName(size);
+    const std::vector<uint8_t> data = generateInput(distribution, size);
+    const Kernels& kernels = activeKernels();
+
+    // 1. The frequency count, then the codes every later kernel uses
+    ByteHistogram frequencies{};
+    runner.run("histogram" + suffix, size, [&] {
+        frequencies = computeHistogram(data.data(), data.size());
+        keepResult(frequencies.data());
+    });
+    frequencies = computeHistogram(data.data(), data.size());
+    CodeLengths codeLengths{};
+    computeCodeLengths(frequencies, codeLengths);
+    HuffmanCodeTable codes{};
+    assignCanonicalCodes(codeLengths, codes);
+    const unsigned maxLength = *std::max_element(codeLengths.begin(), codeLengths.end());
+    DecodeTable decodeTable;
+    buildDecodeTable(codes, decodeTable);
+    const uint64_t payloadBits = encodedBitCount(frequencies, codeLengths);
+
+    // 2. Packing the codes into one stream, and into four for the interleaved decoder
+    std::vector<uint8_t> packed((payloadBits + 7) / 8 + kInterleavedStreamCount + kPackSlack + kDecodePadding);
+    runner.run("pack" + suffix, size, [&] {
+        keepResult(kernels.packCodes(codes, maxLength, data.data(), data.size(), packed.data()));
+    });
+    const size_t streamBytes = static_cast<size_t>(kernels.packCodes(codes, maxLength, data.data(), data.size(), packed.data()) - packed.data());
+    std::vector<uint8_t> interleaved(packed.size());
+    std::array<size_t, kInterleavedStreamCount> streamSizes{};
+    uint8_t* streamStart = interleaved.data();
+    for (unsigned stream = 0; stream < kInterleavedStreamCount; ++stream) {
+        const size_t segmentStart = std::min(size, stream * interleavedSegmentSize(size));
+        const size_t segmentEnd = stream + 1 == kInterleavedStreamCount ? size : std::min(size, segmentStart + interleavedSegmentSize(size));
+        uint8_t* const streamEnd = kernels.packCodes(codes, maxLength, data.data() + segmentStart, segmentEnd - segmentStart, streamStart);
+        streamSizes[stream] = static_cast<size_t>(streamEnd - streamStart);
+        streamStart = streamEnd;
+    }
+
+    // 3. Decoding one stream, and four interleaved; both must restore the input
+    bool restored = true;
+    std::vector<uint8_t> decoded(size);
+    runner.run("decode" + suffix, size, [&] {
+        BitReader bitReader(packed.data());
+        keepResult(decoded.data() + kernels.decodeSymbols(decodeTable, bitReader, uint64_t(streamBytes) * 8, decoded.data(), size));
+    });
+    if (runner.wants("decode" + suffix)) {
+        restored = restored && decoded == data;
+    }
+    if (size >= kMinInterleavedBlockSize) {
+        std::fill(decoded.begin(), decoded.end(), 0);
+        runner.run("decode4" + suffix, size, [&] {
+            keepResult(decoded.data() + kernels.decodeInterleavedStreams(decodeTable, interleaved.data(), streamSizes, decoded.data(), size));
+        });
+        if (runner.wants("decode4" + suffix)) {
+            restored = restored && decoded == data;
+        }
+    }
+
+    // 4. The whole engine on one thread, to compare with the single-threaded baseline
+    CompressionOptions compressionOptions;
+    compressionOptions.threadCount = 1;
+    HuffmanEncoder encoder(compressionOptions);
+    DecompressionOptions decompressionOptions;
+    decompressionOptions.threadCount = 1;
+    HuffmanDecoder decoder(decompressionOptions);
+    std::vector<uint8_t> compressed;
+    std::vector<uint8_t> engineOutput;
+    runner.run("engine-encode" + suffix, size, [&] { restored = encoder.encode(std::span<const uint8_t>(data), compressed) && restored; });
+    encoder.encode(std::span<const uint8_t>(data), compressed);
+    runner.run("engine-decode" + suffix, size, [&] { restored = decoder.decode(compressed, engineOutput) && restored; });
+    if (runner.wants("engine-decode" + suffix)) {
+        restored = restored && engineOutput == data;
+    }
+
+    // 5. The string-based baseline
+    if (size <= kMaxBaselineSize) {
+        const std::string text(data.begin(), data.end());
+        std::string encoded;
+        runner.run("string-encode" + suffix, size, [&] {
+            baseline::HuffmanTree tree;
+            encoded = baseline::huffmanEncode(text, tree);
+        });
+        baseline::HuffmanTree tree;
+        encoded = baseline::huffmanEncode(text, tree);
+        std::string text2;
+        runner.run("string-decode" + suffix, size, [&] { text2 = baseline::huffmanDecode(encoded, tree); });
+        if (runner.wants("string-decode" + suffix)) {
+            restored = restored && text2 == text;
+        }
+    }
+    if (!restored) {
+        std::cerr << "Error: A round trip of " << distributionName(distribution) << "/" << sizeName(size) << " did not restore the input"
+                  << std::endl;
+    }
+    return restored;
+}
+
+/**
+ * @brief Reads the benchmark times of an earlier --json run into the results of this one.
+ * @param path The earlier run's output.
+ * @param results The results to annotate with baseline times.
+ * @return False if the file cannot be read.
+ */
+bool readBaseline(const std::string& path, std::vector<MicroResult>& results) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    const std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::unordered_map<std::string, double> times;
+    for (size_t position = text.find("\"name\": \""); position != std::string::npos; position = text.find("\"name\": \"", position)) {
+        position += std::strlen("\"name\": \"");
+        const size_t nameEnd = text.find('"', position);
+        const size_t timeField = text.find("\"nsPerCall\": ", nameEnd);
+        if (nameEnd == std::string::npos || timeField == std::string::npos) {
+            break;
+        }
+        times[text.substr(position, nameEnd - position)] = std::strtod(text.c_str() + timeField + std::strlen("\"nsPerCall\": "), nullptr);
+        position = timeField;
+    }
+    for (MicroResult& result : results) {
+        const auto found = times.find(result.name);
+        result.baselineNs = found != times.end() ? found->second : 0;
+    }
+    return true;
+}
+
+// Whether a result is slower than its baseline by more than the tolerance
+bool isRegression(const MicroResult& result, double tolerancePercent) {
+    return result.baselineNs > 0 && result.nsPerCall > result.baselineNs * (1 + tolerancePercent / 100);
+}
+
+void printTable(const std::vector<MicroResult>& results, bool compared, double tolerancePercent) {
+    std::printf("%-36s %14s %10s%s\n", "benchmark", "ns/call", "MB/s", compared ? "  vs base" : "");
+    for (const MicroResult& result : results) {
+        std::printf("%-36s %14.1f ", result.name.c_str(), result.nsPerCall);
+        if (result.bytesPerCall != 0) {
+            std::printf("%10.1f", megabytesPerSecond(result));
+        } else {
+            std::printf("%10s", "-");
+        }
+        if (compared && result.baselineNs > 0) {
+            std::printf("  %+6.1f%%%s", (result.nsPerCall / result.baselineNs - 1) * 100,
+                        isRegression(result, tolerancePercent) ? "  REGRESSED" : "");
+        }
+        std::printf("\n");
+    }
+
+    // The engine's speedup over the baseline, wherever both ran
+    bool header = false;
+    for (const MicroResult& result : results) {
+        if (!result.name.starts_with("string-")) {
+            continue;
+        }
+        const std::string engineName = "engine-" + result.name.substr(std::strlen("string-"));
+        const auto engine = std::find_if(results.begin(), results.end(), [&](const MicroResult& r) { return r.name == engineName; });
+        if (engine == results.end()) {
+            continue;
+        }
+        if (!header) {
+            std::printf("\nspeedup of the engine over the string-based coder, one thread:\n");
+            header = true;
+        }
+        std::printf("%-36s %9.1fx\n", engineName.c_str(), result.nsPerCall / engine->nsPerCall);
+    }
+}
+
+void printJson(const std::vector<MicroResult>& results, double minSeconds) {
+    std::printf("{\n  \"kernels\": \"%s\",\n  \"minTime\": %.3f,\n  \"results\": [", activeKernels().name, minSeconds);
+    for (size_t r = 0; r < results.size(); ++r) {
+        const MicroResult& result = results[r];
+        std::printf("%s\n    {\"name\": \"%s\", \"bytesPerCall\": %llu, \"nsPerCall\": %.3f, \"MBps\": %.1f}", r ? "," : "",
+                    result.name.c_str(), static_cast<unsigned long long>(result.bytesPerCall), result.nsPerCall,
+                    megabytesPerSecond(result));
+    }
+    std::printf("\n  ]\n}\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    // 1. Parse the options
+    constexpr const char* usage =
+        "Usage: huffmicro [--json] [--quick] [--filter TEXT] [--min-time SECONDS] [--compare BASELINE.json] [--tolerance PERCENT]";
+    bool json = false;
+    bool quick = false;
+    std::string filter;
+    double minSeconds = 0.2;
+    std::string baselinePath;
+    double tolerancePercent = 10;
+    for (int i = 1; i < argc; ++i) {
+        const std::string argument = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (argument == "--json") {
+            json = true;
+        } else if (argument == "--quick") {
+            quick = true;
+        } else if (argument == "--filter" && hasValue) {
+            filter = argv[++i];
+        } else if (argument == "--min-time" && hasValue) {
+            minSeconds = std::max(0.001, std::atof(argv[++i]));
+        } else if (argument == "--compare" && hasValue) {
+            baselinePath = argv[++i];
+        } else if (argument == "--tolerance" && hasValue) {
+            tolerancePercent = std::max(0.0, std::atof(argv[++i]));
+        } else {
+            std::cerr << usage << std::endl;
+            return 1;
+        }
+    }
+    if (quick) {
+        minSeconds = std::min(minSeconds, 0.05);
+    }
+
+    // 2. Run the table kernels per distribution, then the data kernels per distribution and size
+    const std::vector<size_t> sizes = quick ? std::vector<size_t>{64, size_t(4) << 10, size_t(256) << 10}
+                                            : std::vector<size_t>{64, size_t(4) << 10, size_t(256) << 10, size_t(4) << 20, size_t(64) << 20};
+    MicroRunner runner(filter, minSeconds);
+    bool succeeded = true;
+    for (const Distribution distribution : kDistributions) {
+        benchmarkTables(distribution, runner);
+    }
+    for (const size_t size : sizes) {
+        for (const Distribution distribution : kDistributions) {
+            succeeded = benchmarkData(distribution, size, runner) && succeeded;
+        }
+    }
+
+    // 3. Compare with an earlier run and report
+    const bool compared = !baselinePath.empty();
+    if (compared && !readBaseline(baselinePath, runner.results)) {
+        std::cerr << "Error: Cannot open baseline file: " << baselinePath << std::endl;
+        return 1;
+    }
+    if (json) {
+        printJson(runner.results, minSeconds);
+    } else {
+        std::printf("kernels: %s, min time %.3f s per benchmark\n", activeKernels().name, minSeconds);
+        printTable(runner.results, compared, tolerancePercent);
+    }
+    for (const MicroResult& result : runner.results) {
+        if (isRegression(result, tolerancePercent)) {
+            std::fprintf(stderr, "Error: %s is %.1f%% slower than the baseline\n", result.name.c_str(),
+                         (result.nsPerCall / result.baselineNs - 1) * 100);
+            succeeded = false;
+        }
+    }
+    return succeeded ? 0 : 1;
+}
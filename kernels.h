@@ -0,0 +1,220 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include "bit_writer.h"
+#include "compiler.h"
+#include "crc32c.h"
+#include "decode_table.h"
+#include "huffman_format.h"
+#include "run_length.h"
+
+#if HUFFMAN_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+// The hot loops of the encoder and decoder, compiled once per instruction set. The portable
+// variants build everywhere; there is no NEON variant, so AArch64 runs the portable kernels.
+struct Kernels {
+    using DecodeSymbolsLoop = size_t (*)(const DecodeEntry* table, BitReader& bitReader, uint64_t bitLimit, uint8_t* output,
+                                         size_t maxCount);
+    using DecodeInterleavedLoop = bool (*)(const DecodeEntry* table, const uint8_t* streams,
+                                           const std::array<size_t, kInterleavedStreamCount>& streamSizes, uint8_t* output,
+                                           size_t rawSize);
+    using DecodeContextLoop = bool (*)(const DecodeEntry* const* contextTables, const uint8_t* streams,
+                                       const std::array<size_t, kInterleavedStreamCount>& streamSizes, uint8_t* output,
+                                       size_t rawSize);
+
+    const char* name;
+    uint8_t* (*packCodes)(const HuffmanCodeTable& codes, unsigned maxLength, const uint8_t* data, size_t size, uint8_t* destination);
+    // One loop per table width, indexed by decodeLoopIndex. Each is a function of its own: inlined
+    // into one body behind a switch, the loops share registers and slow each other down.
+    std::array<DecodeSymbolsLoop, kDecodeLoopCount> decodeSymbolsLoops;
+    std::array<DecodeInterleavedLoop, kDecodeLoopCount> decodeInterleavedLoops;
+    std::array<DecodeContextLoop, std::size(kFlatTableWidths)> decodeContextLoops; // Single-level widths only
+    size_t (*countRuns)(const uint8_t* data, size_t size, size_t limit);
+    uint32_t (*crc32c)(const uint8_t* data, size_t size);
+
+    // Decodes symbols with the loop for the table's width; see decodeSymbolsWith.
+    size_t decodeSymbols(const DecodeTable& table, BitReader& bitReader, uint64_t bitLimit, uint8_t* output, size_t maxCount) const {
+        return decodeSymbolsLoops[decodeLoopIndex(table)](table.entries.data(), bitReader, bitLimit, output, maxCount);
+    }
+
+    // Decodes an interleaved block with the loop for the table's width; see decodeInterleavedStreamsWith.
+    bool decodeInterleavedStreams(const DecodeTable& table, const uint8_t* streams,
+                                  const std::array<size_t, kInterleavedStreamCount>& streamSizes, uint8_t* output,
+                                  size_t rawSize) const {
+        return decodeInterleavedLoops[decodeLoopIndex(table)](table.entries.data(), streams, streamSizes, output, rawSize);
+    }
+
+    // Decodes a context Huffman block with the loop for the width of `table`, which every context
+    // table shares and which must be single-level; see decodeContextStreamsWith.
+    bool decodeContextStreams(const DecodeTable& table, const DecodeEntry* const* contextTables, const uint8_t* streams,
+                              const std::array<size_t, kInterleavedStreamCount>& streamSizes, uint8_t* output, size_t rawSize) const {
+        return decodeContextLoops[decodeLoopIndex(table)](contextTables, streams, streamSizes, output, rawSize);
+    }
+};
+
+inline uint8_t* packCodesPortable(const HuffmanCodeTable& codes, unsigned maxLength, const uint8_t* data, size_t size,
+                                  uint8_t* destination) {
+    return packCodes(codes, maxLength, data, size, destination);
+}
+
+template <unsigned FlatBits>
+size_t decodeSymbolsPortable(const DecodeEntry* table, BitReader& bitReader, uint64_t bitLimit, uint8_t* output, size_t maxCount) {
+    return decodeSymbolsWith<FlatBits>(table, bitReader, bitLimit, output, maxCount);
+}
+
+template <unsigned FlatBits>
+bool decodeInterleavedStreamsPortable(const DecodeEntry* table, const uint8_t* streams,
+                                      const std::array<size_t, kInterleavedStreamCount>& streamSizes, uint8_t* output,
+                                      size_t rawSize) {
+    return decodeInterleavedStreamsWith<FlatBits>(table, streams, streamSizes, output, rawSize);
+}
+
+template <unsigned FlatBits>
+bool decodeContextStreamsPortable(const DecodeEntry* const* contextTables, const uint8_t* streams,
+                                  const std::array<size_t, kInterleavedStreamCount>& streamSizes, uint8_t* output,
+                                  size_t rawSize) {
+    return decodeContextStreamsWith<FlatBits>(contextTables, streams, streamSizes, output, rawSize);
+}
+
+inline size_t countRunsPortable(const uint8_t* data, size_t size, size_t limit) {
+    return countRuns(data, size, limit);
+}
+
+inline uint32_t crc32cPortable(const uint8_t* data, size_t size) {
+    return crc32c(data, size);
+}
+
+#if HUFFMAN_X86_DISPATCH
+// BMI2 turns the variable shifts of the bit reader and writer into flag-free shlx/shrx and the
+// code masks into bzhi, shortening the dependency chain through the accumulator.
+HUFFMAN_TARGET("bmi,bmi2") inline uint8_t* packCodesBmi2(const HuffmanCodeTable& codes, unsigned maxLength, const uint8_t* data,
+                                                        size_t size, uint8_t* destination) {
+    return packCodes(codes, maxLength, data, size, destination);
+}
+
+template <unsigned FlatBits>
+HUFFMAN_TARGET("bmi,bmi2") size_t decodeSymbolsBmi2(const DecodeEntry* table, BitReader& bitReader, uint64_t bitLimit,
+                                                    uint8_t* output, size_t maxCount) {
+    return decodeSymbolsWith<FlatBits>(table, bitReader, bitLimit, output, maxCount);
+}
+
+template <unsigned FlatBits>
+HUFFMAN_TARGET("bmi,bmi2") bool decodeInterleavedStreamsBmi2(const DecodeEntry* table, const uint8_t* streams,
+                                                             const std::array<size_t, kInterleavedStreamCount>& streamSizes,
+                                                             uint8_t* output, size_t rawSize) {
+    return decodeInterleavedStreamsWith<FlatBits>(table, streams, streamSizes, output, rawSize);
+}
+
+template <unsigned FlatBits>
+HUFFMAN_TARGET("bmi,bmi2") bool decodeContextStreamsBmi2(const DecodeEntry* const* contextTables, const uint8_t* streams,
+                                                         const std::array<size_t, kInterleavedStreamCount>& streamSizes,
+                                                         uint8_t* output, size_t rawSize) {
+    return decodeContextStreamsWith<FlatBits>(contextTables, streams, streamSizes, output, rawSize);
+}
+
+// Compares 32 neighbouring byte pairs per step and counts the mismatches with popcnt.
+HUFFMAN_TARGET("avx2,popcnt") inline size_t countRunsAvx2(const uint8_t* data, size_t size, size_t limit) {
+    if (size == 0) {
+        return 0;
+    }
+    size_t runs = 1;
+    size_t i = 1;
+    while (i + 32 <= size && runs <= limit) {
+        const size_t chunkEnd = std::min(size - 31, i + kRunCountChunkSize);
+        for (; i < chunkEnd; i += 32) {
+            const __m256i current = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            const __m256i previous = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i - 1));
+            const uint32_t equal = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(current, previous)));
+            runs += static_cast<size_t>(_mm_popcnt_u32(~equal));
+        }
+    }
+    for (; i < size && runs <= limit; ++i) {
+        runs += data[i] != data[i - 1];
+    }
+    return runs;
+}
+
+// One crc32 instruction per 8 bytes, several times the speed of the lookup tables.
+HUFFMAN_TARGET("sse4.2") inline uint32_t crc32cSse42(const uint8_t* data, size_t size) {
+    uint64_t crc = 0xFFFFFFFF;
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t word;
+        std::memcpy(&word, data, 8);
+        crc = _mm_crc32_u64(crc, word);
+    }
+    for (; size > 0; ++data, --size) {
+        crc = _mm_crc32_u8(static_cast<uint32_t>(crc), *data);
+    }
+    return ~static_cast<uint32_t>(crc);
+}
+
+// Kernel set names, indexed by BMI2 | AVX2 << 1 | SSE4.2 << 2
+constexpr const char* kKernelNames[8] = {"portable", "bmi2", "avx2", "bmi2+avx2",
+                                         "sse4.2", "bmi2+sse4.2", "avx2+sse4.2", "bmi2+avx2+sse4.2"};
+#endif
+
+static_assert(kDecodeLoopCount == 5 && kFlatTableWidths[0] == 8 && kFlatTableWidths[3] == 12 && kMaxContextCodeLength <= 12,
+              "selectKernels lists one decode loop per flat width");
+
+/**
+ * @brief Picks the fastest kernels the CPU supports. Setting the environment variable
+ * HUFFMAN_KERNELS=portable forces the portable variants, e.g. to compare them.
+ */
+inline Kernels selectKernels() {
+    Kernels kernels{"portable",
+                    packCodesPortable,
+                    {decodeSymbolsPortable<8>, decodeSymbolsPortable<10>, decodeSymbolsPortable<11>, decodeSymbolsPortable<12>,
+                     decodeSymbolsPortable<0>},
+                    {decodeInterleavedStreamsPortable<8>, decodeInterleavedStreamsPortable<10>,
+                     decodeInterleavedStreamsPortable<11>, decodeInterleavedStreamsPortable<12>,
+                     decodeInterleavedStreamsPortable<0>},
+                    {decodeContextStreamsPortable<8>, decodeContextStreamsPortable<10>, decodeContextStreamsPortable<11>,
+                     decodeContextStreamsPortable<12>},
+                    countRunsPortable,
+                    crc32cPortable};
+#if HUFFMAN_X86_DISPATCH
+    const char* forced = std::getenv("HUFFMAN_KERNELS");
+    if (forced && std::strcmp(forced, "portable") == 0) {
+        return kernels;
+    }
+    __builtin_cpu_init();
+    const bool bmi2 = __builtin_cpu_supports("bmi") && __builtin_cpu_supports("bmi2");
+    const bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+    const bool sse42 = __builtin_cpu_supports("sse4.2");
+    if (bmi2) {
+        kernels.packCodes = packCodesBmi2;
+        kernels.decodeSymbolsLoops = {decodeSymbolsBmi2<8>, decodeSymbolsBmi2<10>, decodeSymbolsBmi2<11>, decodeSymbolsBmi2<12>,
+                                      decodeSymbolsBmi2<0>};
+        kernels.decodeInterleavedLoops = {decodeInterleavedStreamsBmi2<8>, decodeInterleavedStreamsBmi2<10>,
+                                          decodeInterleavedStreamsBmi2<11>, decodeInterleavedStreamsBmi2<12>,
+                                          decodeInterleavedStreamsBmi2<0>};
+        kernels.decodeContextLoops = {decodeContextStreamsBmi2<8>, decodeContextStreamsBmi2<10>, decodeContextStreamsBmi2<11>,
+                                      decodeContextStreamsBmi2<12>};
+    }
+    if (avx2) {
+        kernels.countRuns = countRunsAvx2;
+    }
+    if (sse42) {
+        kernels.crc32c = crc32cSse42;
+    }
+    kernels.name = kKernelNames[unsigned(bmi2) | unsigned(avx2) << 1 | unsigned(sse42) << 2];
+#endif
+    return kernels;
+}
+
+// The kernels chosen for this CPU, selected on first use.
+inline const Kernels& activeKernels() {
+    static const Kernels kernels = selectKernels();
+    return kernels;
+}
+
+#endif // KERNELS_H
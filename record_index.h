@@ -0,0 +1,127 @@
+#ifndef RECORD_INDEX_H
+#define RECORD_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "huffman_format.h"
+
+// A record index is a sidecar to a .huff file that splits its decoded contents into records, each
+// ending with a delimiter byte (the last may lack one), and keeps a checkpoint every `interval`
+// records so one record can be read by decoding from the checkpoint before it rather than from
+// the start of its block (see HuffmanArchive::readRecords). Layout (all integers little-endian):
+//   header:       magic "HREC" | version (1 byte) | delimiter (1 byte) | interval (4 bytes) |
+//                 record count (8 bytes) | raw size of the archive (8 bytes) |
+//                 encoded size of the archive (8 bytes) | archive checksum (4 bytes)
+//   checkpoints:  per checkpoint, offset of its record's first raw byte (8 bytes) | bit offset of
+//                 that byte's code in its Huffman stream, or kNoBitOffset (8 bytes)
+// Checkpoint i starts record i * interval. Its bit offset is counted from the start of the stream
+// of the block holding the byte: the only stream of a Huffman block, or the stream of its segment
+// in an interleaved block. Other blocks have no bit offsets; their records are read by decoding
+// the block from its start. The archive checksum is a CRC-32C over the archive's block index
+// footer and the last four bytes of each block (its checksum, when blocks carry one), so an index
+// left over from an earlier version of the archive is rejected rather than read at wrong offsets.
+constexpr uint8_t kRecordIndexMagic[4] = {'H', 'R', 'E', 'C'};
+constexpr uint8_t kRecordIndexVersion = 2;
+constexpr size_t kRecordIndexHeaderSize = 38;
+constexpr size_t kRecordCheckpointSize = 16;
+
+// Records between checkpoints, unless chosen otherwise: a lookup decodes at most this many
+// records before the one it wants.
+constexpr uint32_t kDefaultRecordInterval = 64;
+
+// The bit offset of a checkpoint in a block that is not Huffman coded.
+constexpr uint64_t kNoBitOffset = UINT64_MAX;
+
+// Where decoding starts for the records from one checkpoint on
+struct RecordCheckpoint {
+    uint64_t rawOffset = 0; // Offset of the record's first byte in the decoded output
+    uint64_t bitOffset = kNoBitOffset;
+};
+
+// The record index of one archive, as built by HuffmanArchive::buildRecordIndex
+struct RecordIndex {
+    uint8_t delimiter = '\n';
+    uint32_t interval = kDefaultRecordInterval;
+    uint64_t recordCount = 0;
+    uint64_t rawSize = 0;          // Of the archive the index was built for
+    uint64_t archiveSize = 0;      // Encoded size of that archive
+    uint32_t archiveChecksum = 0;  // Of that archive's footer and block ends
+    std::vector<RecordCheckpoint> checkpoints;
+};
+
+/**
+ * @brief Appends a record index in the sidecar layout.
+ * @param records The record index.
+ * @param output The buffer receiving the sidecar.
+ */
+inline void writeRecordIndex(const RecordIndex& records, std::vector<uint8_t>& output) {
+    const size_t start = output.size();
+    output.resize(start + kRecordIndexHeaderSize + records.checkpoints.size() * kRecordCheckpointSize);
+    uint8_t* p = output.data() + start;
+    for (int i = 0; i < 4; ++i) {
+        p[i] = kRecordIndexMagic[i];
+    }
+    p[4] = kRecordIndexVersion;
+    p[5] = records.delimiter;
+    storeLittleEndian32(records.interval, p + 6);
+    storeLittleEndian64(records.recordCount, p + 10);
+    storeLittleEndian64(records.rawSize, p + 18);
+    storeLittleEndian64(records.archiveSize, p + 26);
+    storeLittleEndian32(records.archiveChecksum, p + 34);
+    p += kRecordIndexHeaderSize;
+    for (const RecordCheckpoint& checkpoint : records.checkpoints) {
+        storeLittleEndian64(checkpoint.rawOffset, p);
+        storeLittleEndian64(checkpoint.bitOffset, p + 8);
+        p += kRecordCheckpointSize;
+    }
+}
+
+/**
+ * @brief Parses a sidecar written by writeRecordIndex.
+ * @param data The sidecar's bytes.
+ * @param size The number of bytes.
+ * @param records Receives the record index.
+ * @return False if the magic or version is wrong, the size does not match the record count, or
+ *         the checkpoints are out of order or beyond the raw size.
+ */
+inline bool readRecordIndex(const uint8_t* data, size_t size, RecordIndex& records) {
+    if (size < kRecordIndexHeaderSize) {
+        return false;
+    }
+    for (int i = 0; i < 4; ++i) {
+        if (data[i] != kRecordIndexMagic[i]) {
+            return false;
+        }
+    }
+    records.delimiter = data[5];
+    records.interval = loadLittleEndian32(data + 6);
+    records.recordCount = loadLittleEndian64(data + 10);
+    records.rawSize = loadLittleEndian64(data + 18);
+    records.archiveSize = loadLittleEndian64(data + 26);
+    records.archiveChecksum = loadLittleEndian32(data + 34);
+    if (data[4] != kRecordIndexVersion || records.interval == 0 || records.recordCount > records.rawSize) {
+        return false;
+    }
+    const uint64_t checkpointCount = (records.recordCount + records.interval - 1) / records.interval;
+    if ((size - kRecordIndexHeaderSize) / kRecordCheckpointSize != checkpointCount ||
+        (size - kRecordIndexHeaderSize) % kRecordCheckpointSize != 0) {
+        return false;
+    }
+    records.checkpoints.resize(static_cast<size_t>(checkpointCount));
+    const uint8_t* p = data + kRecordIndexHeaderSize;
+    uint64_t previousOffset = 0;
+    for (RecordCheckpoint& checkpoint : records.checkpoints) {
+        checkpoint.rawOffset = loadLittleEndian64(p);
+        checkpoint.bitOffset = loadLittleEndian64(p + 8);
+        if (checkpoint.rawOffset < previousOffset || checkpoint.rawOffset >= records.rawSize) {
+            return false;
+        }
+        previousOffset = checkpoint.rawOffset;
+        p += kRecordCheckpointSize;
+    }
+    return true;
+}
+
+#endif // RECORD_INDEX_H
@@ -0,0 +1,97 @@
+#ifndef RUN_LENGTH_H
+#define RUN_LENGTH_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Bytes compared per step of countRuns before the run limit is checked
+constexpr size_t kRunCountChunkSize = 4096;
+
+// Longest encoding of one run: the byte value and a 32-bit varint.
+constexpr size_t kMaxRunEncodingSize = 6;
+
+/**
+ * @brief Counts the runs of equal bytes in a buffer, giving up once the count passes `limit`.
+ * @param data The bytes to scan.
+ * @param size The number of bytes.
+ * @param limit The count beyond which the exact number is not needed.
+ * @return The number of runs, or a value above limit.
+ */
+inline size_t countRuns(const uint8_t* data, size_t size, size_t limit) {
+    if (size == 0) {
+        return 0;
+    }
+    size_t runs = 1;
+    for (size_t chunkStart = 1; chunkStart < size && runs <= limit; chunkStart += kRunCountChunkSize) {
+        const size_t chunkEnd = std::min(size, chunkStart + kRunCountChunkSize);
+        // Branch-free comparison of neighbours, which compilers turn into vector code
+        size_t changes = 0;
+        for (size_t i = chunkStart; i < chunkEnd; ++i) {
+            changes += data[i] != data[i - 1];
+        }
+        runs += changes;
+    }
+    return runs;
+}
+
+/**
+ * @brief Appends the runs of a buffer as (byte, varint run - 1) pairs, the varint in 7-bit groups, low group first.
+ * @param data The bytes to encode.
+ * @param size The number of bytes, below 2^32.
+ * @param output The buffer receiving the runs.
+ */
+inline void writeRuns(const uint8_t* data, size_t size, std::vector<uint8_t>& output) {
+    for (size_t i = 0; i < size;) {
+        const uint8_t value = data[i];
+        size_t runEnd = i + 1;
+        while (runEnd < size && data[runEnd] == value) {
+            ++runEnd;
+        }
+        output.push_back(value);
+        for (uint32_t extra = static_cast<uint32_t>(runEnd - i - 1);; extra >>= 7) {
+            if (extra < 0x80) {
+                output.push_back(static_cast<uint8_t>(extra));
+                break;
+            }
+            output.push_back(static_cast<uint8_t>(extra | 0x80));
+        }
+        i = runEnd;
+    }
+}
+
+/**
+ * @brief Expands runs written by writeRuns.
+ * @param source The encoded runs.
+ * @param sourceSize The number of encoded bytes.
+ * @param output Receives rawSize bytes.
+ * @param rawSize The number of bytes the runs expand to.
+ * @return False if the runs do not expand to exactly rawSize bytes using every encoded byte.
+ */
+inline bool readRuns(const uint8_t* source, size_t sourceSize, uint8_t* output, size_t rawSize) {
+    const uint8_t* const end = source + sourceSize;
+    size_t written = 0;
+    while (source < end) {
+        const uint8_t value = *source++;
+        uint64_t extra = 0;
+        for (unsigned shift = 0;; shift += 7) {
+            if (source == end || shift > 28) {
+                return false;
+            }
+            const uint8_t group = *source++;
+            extra |= uint64_t(group & 0x7F) << shift;
+            if (group < 0x80) {
+                break;
+            }
+        }
+        if (extra >= rawSize - written) {
+            return false;
+        }
+        std::fill_n(output + written, extra + 1, value);
+        written += extra + 1;
+    }
+    return written == rawSize;
+}
+
+#endif // RUN_LENGTH_H
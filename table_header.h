@@ -0,0 +1,333 @@
+#ifndef TABLE_HEADER_H
+#define TABLE_HEADER_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bit_writer.h"
+#include "code_lengths.h"
+#include "decode_table.h"
+#include "histogram.h"
+#include "huffman_format.h"
+
+// The code-length table of a Huffman block is stored as a table header, packed MSB-first and
+// zero-padded to a whole byte:
+//   kind (2 bits, a TableKind), then for Full and Delta tables:
+//   table code: symbol count n (5 bits) | n code lengths (3 bits each) in kTableSymbolOrder
+//   values:     the 256 table values coded with the table code, each symbol followed by its extra bits
+// A Full table's values are the code lengths; a Delta table's are the zigzag-coded differences
+// from the previous table. The table code is a small Huffman code over kTableSymbolCount symbols
+// that code literal values, repeats and zero runs, after DEFLATE's code-length code.
+
+// Every kTableAnchorInterval-th block of a container (block numbers 0, 16, 32, ...) starts a
+// table group, in which decoding can start: The previous table of a Huffman block is that of the
+// last Huffman block before it in its group, and the first one of a group has none.
+constexpr uint64_t kTableAnchorInterval = 16;
+
+// How a table header codes its code lengths
+enum class TableKind : uint8_t {
+    Full = 0,  // The code lengths themselves
+    Delta = 1, // Differences from the previous table
+    Reuse = 2  // The previous table, unchanged; the header stores nothing else
+};
+
+// Symbols of the table code: 0..15 are literal values, the others take extra bits
+constexpr unsigned kTableLiteralCount = 16;
+constexpr unsigned kTableEscape = 16;     // Literal value 16..143
+constexpr unsigned kTableRepeat = 17;     // The last literal value again, 3..6 times
+constexpr unsigned kTableShortZeros = 18; // 3..10 zero values
+constexpr unsigned kTableLongZeros = 19;  // 11..138 zero values
+constexpr unsigned kTableSymbolCount = 20;
+constexpr unsigned kTableExtraBits[kTableSymbolCount] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 7, 2, 3, 7};
+constexpr unsigned kMaxTableCodeLength = 7;
+
+// Order in which the table code's lengths are stored, so the rarely used symbols come last and
+// their zero lengths can be left out.
+constexpr uint8_t kTableSymbolOrder[kTableSymbolCount] = {0, 18, 19, 17, 1, 2, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 14, 15, 16};
+
+// Code length of every table code symbol; 0 marks a symbol that does not occur.
+using TableCodeLengths = std::array<uint8_t, kTableSymbolCount>;
+
+// Upper bound on a table header: the fixed fields, then 256 values at 14 bits each.
+constexpr size_t kMaxTableHeaderSize = (2 + 5 + 3 * kTableSymbolCount + 256 * 14 + 7) / 8;
+
+// The previous table of the current table group, tracked in block order by encoder and decoder
+struct TableContext {
+    CodeLengths previous{};
+    bool hasPrevious = false;
+
+    // Prepares for the block with the given number; an anchor block starts a new group.
+    void startBlock(uint64_t blockNumber) {
+        if (blockNumber % kTableAnchorInterval == 0) {
+            hasPrevious = false;
+        }
+    }
+
+    // Records the table of a Huffman block as the previous table of the blocks after it.
+    void remember(const CodeLengths& lengths) {
+        previous = lengths;
+        hasPrevious = true;
+    }
+};
+
+// One symbol of the table code and the value of its extra bits
+struct TableToken {
+    uint8_t symbol;
+    uint8_t extra;
+};
+
+// The table values of one candidate table header in coded form
+struct TableCandidate {
+    std::array<TableToken, 256> tokens;
+    size_t tokenCount = 0;
+    TableCodeLengths codeLengths{};
+    uint64_t bitCount = 0; // Of the whole header
+};
+
+/**
+ * @brief Assigns the canonical codes of the table code, as assignCanonicalCodes does for blocks.
+ * @param lengths The code length of every table code symbol, each at most kMaxTableCodeLength.
+ * @param codes Receives the code of every symbol, in the low bits.
+ * @return False if the lengths overflow the code space.
+ */
+inline bool assignTableCodes(const TableCodeLengths& lengths, std::array<uint8_t, kTableSymbolCount>& codes) {
+    std::array<unsigned, kMaxTableCodeLength + 1> lengthCounts{};
+    unsigned kraftSum = 0; // In units of the longest code
+    for (const uint8_t length : lengths) {
+        ++lengthCounts[length];
+        kraftSum += length ? 1u << (kMaxTableCodeLength - length) : 0;
+    }
+    std::array<unsigned, kMaxTableCodeLength + 1> nextCode{};
+    for (unsigned length = 2; length <= kMaxTableCodeLength; ++length) {
+        nextCode[length] = (nextCode[length - 1] + lengthCounts[length - 1]) << 1;
+    }
+    for (unsigned symbol = 0; symbol < kTableSymbolCount; ++symbol) {
+        codes[symbol] = static_cast<uint8_t>(lengths[symbol] ? nextCode[lengths[symbol]]++ : 0);
+    }
+    return kraftSum <= 1u << kMaxTableCodeLength;
+}
+
+/**
+ * @brief Codes 256 table values as table code symbols, builds the table code and sizes the header.
+ * @param values The table values, each at most 143.
+ * @param candidate Receives the tokens, the table code and the header size.
+ */
+inline void prepareTableCandidate(const std::array<uint8_t, 256>& values, TableCandidate& candidate) {
+    candidate.tokenCount = 0;
+    const auto emit = [&](unsigned symbol, unsigned extra) {
+        candidate.tokens[candidate.tokenCount++] = {static_cast<uint8_t>(symbol), static_cast<uint8_t>(extra)};
+    };
+    for (size_t i = 0; i < values.size();) {
+        const uint8_t value = values[i];
+        size_t run = 1;
+        while (i + run < values.size() && values[i + run] == value) {
+            ++run;
+        }
+        if (value == 0 && run >= 3) {
+            const size_t count = std::min<size_t>(run, 138);
+            emit(count >= 11 ? kTableLongZeros : kTableShortZeros, static_cast<unsigned>(count >= 11 ? count - 11 : count - 3));
+            i += count;
+            continue;
+        }
+        // A literal, then repeats of it while at least three more follow
+        emit(value < kTableLiteralCount ? value : kTableEscape, value < kTableLiteralCount ? 0 : value - kTableLiteralCount);
+        ++i;
+        --run;
+        while (run >= 3) {
+            const size_t count = std::min<size_t>(run, 6);
+            emit(kTableRepeat, static_cast<unsigned>(count - 3));
+            i += count;
+            run -= count;
+        }
+    }
+
+    std::array<uint64_t, kTableSymbolCount> frequencies{};
+    for (size_t i = 0; i < candidate.tokenCount; ++i) {
+        ++frequencies[candidate.tokens[i].symbol];
+    }
+    computeCodeLengths(frequencies, candidate.codeLengths);
+    if (*std::max_element(candidate.codeLengths.begin(), candidate.codeLengths.end()) > kMaxTableCodeLength) {
+        computeLimitedCodeLengths(frequencies, kMaxTableCodeLength, candidate.codeLengths);
+    }
+    size_t storedLengths = kTableSymbolCount;
+    while (storedLengths > 1 && candidate.codeLengths[kTableSymbolOrder[storedLengths - 1]] == 0) {
+        --storedLengths;
+    }
+    candidate.bitCount = 2 + 5 + 3 * storedLengths;
+    for (unsigned symbol = 0; symbol < kTableSymbolCount; ++symbol) {
+        candidate.bitCount += frequencies[symbol] * (candidate.codeLengths[symbol] + kTableExtraBits[symbol]);
+    }
+}
+
+/**
+ * @brief Appends the table header of a Huffman block in its smallest form: a reuse of the
+ * previous table when it is the same, otherwise the smaller of a full and a delta table.
+ * @param lengths The code lengths of the block.
+ * @param context The previous table of the block's group, if any.
+ * @param output The buffer receiving the header.
+ * @param linkedOnly Skip the full table, whose size the caller already knows; requires a previous table.
+ */
+inline void writeTableHeader(const CodeLengths& lengths, const TableContext& context, std::vector<uint8_t>& output,
+                             bool linkedOnly = false) {
+    const size_t start = output.size();
+    output.resize(start + kMaxTableHeaderSize + 4); // BitWriter writes up to 4 bytes of slack
+    BitWriter bitWriter(output.data() + start);
+    if (context.hasPrevious && lengths == context.previous) {
+        bitWriter.write(static_cast<uint64_t>(TableKind::Reuse), 2);
+        output.resize(static_cast<size_t>(bitWriter.finish() - output.data()));
+        return;
+    }
+
+    // 1. Size both candidates; the values of a delta table are zigzag-coded differences
+    std::array<uint8_t, 256> values;
+    thread_local TableCandidate full;
+    thread_local TableCandidate delta;
+    const TableCandidate* best = &full;
+    TableKind kind = TableKind::Full;
+    if (!linkedOnly) {
+        std::copy(lengths.begin(), lengths.end(), values.begin());
+        prepareTableCandidate(values, full);
+    }
+    if (context.hasPrevious) {
+        for (size_t symbol = 0; symbol < values.size(); ++symbol) {
+            const int difference = int(lengths[symbol]) - int(context.previous[symbol]);
+            values[symbol] = static_cast<uint8_t>(difference >= 0 ? 2 * difference : -2 * difference - 1);
+        }
+        prepareTableCandidate(values, delta);
+        if (linkedOnly || delta.bitCount < full.bitCount) {
+            best = &delta;
+            kind = TableKind::Delta;
+        }
+    }
+
+    // 2. Write the kind, the table code and the tokens
+    size_t storedLengths = kTableSymbolCount;
+    while (storedLengths > 1 && best->codeLengths[kTableSymbolOrder[storedLengths - 1]] == 0) {
+        --storedLengths;
+    }
+    bitWriter.write(static_cast<uint64_t>(kind), 2);
+    bitWriter.write(storedLengths, 5);
+    for (size_t i = 0; i < storedLengths; ++i) {
+        bitWriter.write(best->codeLengths[kTableSymbolOrder[i]], 3);
+    }
+    std::array<uint8_t, kTableSymbolCount> codes;
+    assignTableCodes(best->codeLengths, codes);
+    for (size_t i = 0; i < best->tokenCount; ++i) {
+        const TableToken& token = best->tokens[i];
+        bitWriter.write(codes[token.symbol], best->codeLengths[token.symbol]);
+        if (kTableExtraBits[token.symbol] != 0) {
+            bitWriter.write(token.extra, kTableExtraBits[token.symbol]);
+        }
+    }
+    output.resize(static_cast<size_t>(bitWriter.finish() - output.data()));
+}
+
+/**
+ * @brief Parses a table header written by writeTableHeader.
+ * @param cursor The read position, followed by kDecodePadding readable bytes past `end`; advanced
+ *        past the header on success.
+ * @param end The end of the readable data.
+ * @param context The previous table of the block's group, if any.
+ * @param lengths Receives the code lengths.
+ * @return False if the header is truncated or malformed, refers to a missing previous table, or
+ *         does not describe a usable prefix code.
+ */
+inline bool readTableHeader(const uint8_t*& cursor, const uint8_t* end, const TableContext& context, CodeLengths& lengths) {
+    if (cursor >= end) {
+        return false;
+    }
+    const uint64_t bitLimit = static_cast<uint64_t>(end - cursor) * 8;
+    BitReader bitReader(cursor);
+    const auto readBits = [&](unsigned count) {
+        const uint64_t bits = bitReader.peek(count);
+        bitReader.consume(count);
+        return static_cast<unsigned>(bits);
+    };
+    const TableKind kind = static_cast<TableKind>(readBits(2));
+    if (kind != TableKind::Full && !context.hasPrevious) {
+        return false;
+    }
+    if (kind == TableKind::Reuse) {
+        lengths = context.previous;
+    } else if (kind == TableKind::Full || kind == TableKind::Delta) {
+        // 1. Rebuild the table code as a lookup on its longest code length, one slot per bit pattern
+        const unsigned storedLengths = readBits(5);
+        if (storedLengths == 0 || storedLengths > kTableSymbolCount) {
+            return false;
+        }
+        TableCodeLengths tableCodeLengths{};
+        for (unsigned i = 0; i < storedLengths; ++i) {
+            tableCodeLengths[kTableSymbolOrder[i]] = static_cast<uint8_t>(readBits(3));
+        }
+        std::array<uint8_t, kTableSymbolCount> codes;
+        if (!assignTableCodes(tableCodeLengths, codes)) {
+            return false;
+        }
+        std::array<uint8_t, 1u << kMaxTableCodeLength> lookupSymbols{};
+        std::array<uint8_t, 1u << kMaxTableCodeLength> lookupLengths{}; // 0 for bit patterns that are no code
+        for (unsigned symbol = 0; symbol < kTableSymbolCount; ++symbol) {
+            if (const unsigned length = tableCodeLengths[symbol]) {
+                const unsigned first = unsigned(codes[symbol]) << (kMaxTableCodeLength - length);
+                std::fill_n(lookupSymbols.begin() + first, 1u << (kMaxTableCodeLength - length), static_cast<uint8_t>(symbol));
+                std::fill_n(lookupLengths.begin() + first, 1u << (kMaxTableCodeLength - length), static_cast<uint8_t>(length));
+            }
+        }
+
+        // 2. Decode the 256 values
+        std::array<uint8_t, 256> values;
+        size_t filled = 0;
+        int lastLiteral = -1;
+        while (filled < values.size()) {
+            if (bitReader.position() >= bitLimit) {
+                return false;
+            }
+            const unsigned slot = static_cast<unsigned>(bitReader.peek(kMaxTableCodeLength));
+            if (lookupLengths[slot] == 0) {
+                return false;
+            }
+            const unsigned symbol = lookupSymbols[slot];
+            bitReader.consume(lookupLengths[slot]);
+            const unsigned extra = kTableExtraBits[symbol] ? readBits(kTableExtraBits[symbol]) : 0;
+            if (symbol <= kTableEscape) {
+                const unsigned value = symbol < kTableLiteralCount ? symbol : kTableLiteralCount + extra;
+                values[filled++] = static_cast<uint8_t>(value);
+                lastLiteral = static_cast<int>(value);
+                continue;
+            }
+            const size_t count = symbol == kTableRepeat ? 3 + extra : symbol == kTableShortZeros ? 3 + extra : 11 + extra;
+            if ((symbol == kTableRepeat && lastLiteral < 0) || count > values.size() - filled) {
+                return false;
+            }
+            std::fill_n(values.begin() + filled, count, symbol == kTableRepeat ? static_cast<uint8_t>(lastLiteral) : 0);
+            filled += count;
+        }
+        if (bitReader.position() > bitLimit) {
+            return false;
+        }
+
+        // 3. Undo the delta against the previous table
+        for (size_t symbol = 0; symbol < values.size(); ++symbol) {
+            int length = values[symbol];
+            if (kind == TableKind::Delta) {
+                const int difference = values[symbol] & 1 ? -(values[symbol] + 1) / 2 : values[symbol] / 2;
+                length = int(context.previous[symbol]) + difference;
+            }
+            if (length < 0 || length > static_cast<int>(kMaxCodeLength)) {
+                return false;
+            }
+            lengths[symbol] = static_cast<uint8_t>(length);
+        }
+    } else {
+        return false;
+    }
+    if (!isValidCodeLengths(lengths)) {
+        return false;
+    }
+    cursor += (bitReader.position() + 7) / 8;
+    return true;
+}
+
+#endif // TABLE_HEADER_H
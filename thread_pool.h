@@ -0,0 +1,254 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// How long a worker waiting on a task sleeps when it finds nothing else to run
+constexpr std::chrono::microseconds kHelpPollInterval{100};
+
+// A queue of tasks in a ring that keeps its storage: once it has grown to the most tasks it
+// held at once, queueing a task whose callable fits in std::function allocates nothing.
+class TaskQueue {
+public:
+    bool empty() const { return count == 0; }
+
+    void pushBack(std::function<void()> task) {
+        if (count == tasks.size()) {
+            std::vector<std::function<void()>> grown(std::max<size_t>(16, 2 * tasks.size()));
+            for (size_t i = 0; i < count; ++i) {
+                grown[i] = std::move(tasks[(head + i) % tasks.size()]);
+            }
+            tasks.swap(grown);
+            head = 0;
+        }
+        tasks[(head + count++) % tasks.size()] = std::move(task);
+    }
+
+    std::function<void()> popFront() {
+        std::function<void()> task = std::move(tasks[head]);
+        head = (head + 1) % tasks.size();
+        --count;
+        return task;
+    }
+
+    std::function<void()> popBack() {
+        --count;
+        return std::move(tasks[(head + count) % tasks.size()]);
+    }
+
+private:
+    std::vector<std::function<void()>> tasks;
+    size_t head = 0;  // Index of the oldest task
+    size_t count = 0;
+};
+
+// A fixed set of worker threads with work stealing. Tasks submitted from outside the pool go to a
+// shared FIFO queue. Tasks a worker submits, such as the blocks of a file it is coding, go to that
+// worker's own deque: it takes the newest first, while idle workers steal the oldest. A worker
+// waiting on a future through wait() runs stolen tasks in the meantime, so one large job split
+// into many tasks spreads over every worker, not just the one that started it. Jobs whose storage
+// the caller keeps go through post() instead of submit(), which queues them without allocating.
+class ThreadPool {
+public:
+    // Starts `threadCount` workers; 0 means one per hardware thread.
+    explicit ThreadPool(unsigned threadCount = 0) {
+        if (threadCount == 0) {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (unsigned i = 0; i < threadCount; ++i) {
+            queues.push_back(std::make_unique<WorkerQueue>());
+        }
+        for (unsigned i = 0; i < threadCount; ++i) {
+            workers.emplace_back([this, i] { workerLoop(i); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        taskReady.notify_all();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Queues `task` and returns a future for its result: on the calling worker's own deque when
+    // called from one of the pool's workers, otherwise on the shared queue.
+    template <typename Task>
+    auto submit(Task task) -> std::future<decltype(task())> {
+        auto packagedTask = std::make_shared<std::packaged_task<decltype(task())()>>(std::move(task));
+        std::future<decltype(task())> result = packagedTask->get_future();
+        push([packagedTask] { (*packagedTask)(); });
+        return result;
+    }
+
+    /**
+     * @brief Waits for a future. On one of the pool's workers, runs tasks from the workers'
+     * deques until it is ready, so waiting never idles a worker or deadlocks the pool. Tasks of
+     * the shared queue are left alone, since each may start another long job and wait in turn.
+     * @param future A future returned by submit().
+     * @return The task's result.
+     */
+    template <typename Result>
+    Result wait(std::future<Result>& future) {
+        if (currentPool == this) {
+            helpUntil([&] { return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready; },
+                      [&] { future.wait_for(kHelpPollInterval); });
+        }
+        return future.get();
+    }
+
+    /**
+     * @brief Queues a job the caller owns, without the shared state and future of submit().
+     * The job must stay alive until wait(job.done) returns.
+     * @param job An object with a `void run()` member and a `std::atomic<bool> done` member,
+     *        which is cleared now and set once run() returns.
+     */
+    template <typename Job>
+    void post(Job& job) {
+        job.done.store(false, std::memory_order_relaxed);
+        push([this, pointer = &job] {
+            pointer->run();
+            // Set under the lock, so a waiter that sees it set knows the job no longer touches it
+            {
+                std::lock_guard<std::mutex> lock(doneMutex);
+                pointer->done.store(true, std::memory_order_release);
+            }
+            jobDone.notify_all();
+        });
+    }
+
+    /**
+     * @brief Waits for a job queued with post(), helping on a worker as wait() does for a future.
+     * @param done The job's completion flag.
+     */
+    void wait(const std::atomic<bool>& done) {
+        const auto isDone = [&] { return done.load(std::memory_order_acquire); };
+        if (currentPool == this) {
+            helpUntil(isDone, [&] {
+                std::unique_lock<std::mutex> lock(doneMutex);
+                jobDone.wait_for(lock, kHelpPollInterval, isDone);
+            });
+        } else if (!isDone()) {
+            std::unique_lock<std::mutex> lock(doneMutex);
+            jobDone.wait(lock, isDone);
+        }
+    }
+
+
+    unsigned size() const { return static_cast<unsigned>(workers.size()); }
+
+private:
+    struct WorkerQueue {
+        TaskQueue tasks;
+        std::mutex mutex;
+    };
+
+    // Runs tasks from the workers' deques on the calling worker until `ready` holds, calling
+    // `idle` to sleep a little whenever there is none.
+    template <typename Ready, typename Idle>
+    void helpUntil(const Ready& ready, const Idle& idle) {
+        while (!ready()) {
+            std::function<void()> task;
+            if (takeTask(currentWorker, false, task)) {
+                task();
+            } else {
+                idle();
+            }
+        }
+    }
+
+    void push(std::function<void()> task) {
+        // The count changes under the queue's lock, so it never disagrees with the queues
+        const bool own = currentPool == this;
+        {
+            std::lock_guard<std::mutex> lock(own ? queues[currentWorker]->mutex : sharedMutex);
+            (own ? queues[currentWorker]->tasks : sharedTasks).pushBack(std::move(task));
+            queuedTasks.fetch_add(1, std::memory_order_release);
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex); // Orders the count before a sleeper's check
+        }
+        taskReady.notify_one();
+    }
+
+    /**
+     * @brief Finds a task for a worker: the newest of its own, else the oldest of another
+     * worker's deque, else, if allowed, the oldest of the shared queue.
+     * @param self The worker's index.
+     * @param includeShared Whether the shared queue may be drawn from.
+     * @param task Receives the task.
+     * @return False if there was none.
+     */
+    bool takeTask(unsigned self, bool includeShared, std::function<void()>& task) {
+        if (queuedTasks.load(std::memory_order_acquire) == 0) {
+            return false;
+        }
+        const auto take = [&](TaskQueue& tasks, std::mutex& mutex, bool newest) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (tasks.empty()) {
+                return false;
+            }
+            task = newest ? tasks.popBack() : tasks.popFront();
+            queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        };
+        if (take(queues[self]->tasks, queues[self]->mutex, true)) {
+            return true;
+        }
+        for (size_t offset = 1; offset < queues.size(); ++offset) {
+            WorkerQueue& victim = *queues[(self + offset) % queues.size()];
+            if (take(victim.tasks, victim.mutex, false)) {
+                return true;
+            }
+        }
+        return includeShared && take(sharedTasks, sharedMutex, false);
+    }
+
+    void workerLoop(unsigned self) {
+        currentPool = this;
+        currentWorker = self;
+        for (;;) {
+            std::function<void()> task;
+            if (takeTask(self, true, task)) {
+                task();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            taskReady.wait(lock, [this] { return stopping || queuedTasks.load(std::memory_order_acquire) != 0; });
+            if (stopping && queuedTasks.load(std::memory_order_acquire) == 0) {
+                return;
+            }
+        }
+    }
+
+    static inline thread_local ThreadPool* currentPool = nullptr; // The pool the calling thread works for
+    static inline thread_local unsigned currentWorker = 0;
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkerQueue>> queues; // One per worker
+    TaskQueue sharedTasks;
+    std::mutex sharedMutex;
+    std::atomic<size_t> queuedTasks{0}; // Tasks in all the queues
+    std::mutex sleepMutex;
+    std::condition_variable taskReady;
+    std::mutex doneMutex; // Guards the completion of posted jobs
+    std::condition_variable jobDone;
+    bool stopping = false;
+};
+
+#endif // THREAD_POOL_H